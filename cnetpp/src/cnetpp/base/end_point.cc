@@ -30,16 +30,59 @@
 #include <arpa/inet.h>
 #include <assert.h>
 #include <netinet/in.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/un.h>
+
+#include <algorithm>
 
 namespace cnetpp {
 namespace base {
 
+EndPoint EndPoint::UnixDomain(const StringPiece& path) {
+  EndPoint end_point;
+  end_point.unix_domain_ = true;
+  end_point.unix_path_ = path.as_string();
+  if (!end_point.unix_path_.empty() && end_point.unix_path_[0] == '@') {
+    end_point.unix_path_[0] = '\0';
+  }
+  return end_point;
+}
+
+std::string EndPoint::UnixDomainToString() const {
+  std::string res("unix:");
+  res.append(unix_path_);
+  if (IsAbstractUnixDomain()) {
+    res[5] = '@';
+  }
+  return res;
+}
+
 bool EndPoint::ToSockAddr(struct sockaddr* address,
                           socklen_t* address_len) const {
   assert(address);
   assert(address_len);
 
-  if (port_ <= 0) {
+  if (unix_domain_) {
+    auto un_address = reinterpret_cast<struct sockaddr_un*>(address);
+    // a file system path is terminated by '\0', an abstract name is not
+    bool abstract = IsAbstractUnixDomain();
+    size_t length = unix_path_.size() + (abstract ? 0 : 1);
+    if (unix_path_.empty() || length > sizeof(un_address->sun_path)) {
+      return false;
+    }
+    un_address->sun_family = AF_UNIX;
+    memcpy(un_address->sun_path, unix_path_.data(), unix_path_.size());
+    if (!abstract) {
+      un_address->sun_path[unix_path_.size()] = '\0';
+    }
+    *address_len =
+        static_cast<socklen_t>(offsetof(struct sockaddr_un, sun_path) + length);
+    return true;
+  }
+
+  // port 0 is valid for binding, the kernel picks an ephemeral one
+  if (port_ < 0 || port_ > 65535) {
     return false;
   }
 
@@ -77,8 +120,29 @@ bool EndPoint::FromSockAddr(const struct sockaddr& address,
   auto error = [this] {
     address_.mutable_address().clear();
     port_ = 0;
+    unix_domain_ = false;
+    unix_path_.clear();
     return false;
   };
+  if (address_len >= static_cast<socklen_t>(sizeof(sa_family_t)) &&
+      address.sa_family == AF_UNIX) {
+    auto un_address = reinterpret_cast<const struct sockaddr_un*>(&address);
+    size_t offset = offsetof(struct sockaddr_un, sun_path);
+    // an unbound socket, e.g. the client side of a connection, has no path
+    size_t length = static_cast<size_t>(address_len) > offset ?
+        std::min(static_cast<size_t>(address_len) - offset,
+                 sizeof(un_address->sun_path)) : 0;
+    if (length > 0 && un_address->sun_path[0] != '\0') {
+      length = strnlen(un_address->sun_path, length);
+    }
+    address_.mutable_address().clear();
+    port_ = 0;
+    unix_domain_ = true;
+    unix_path_.assign(un_address->sun_path, length);
+    return true;
+  }
+  unix_domain_ = false;
+  unix_path_.clear();
   switch (address_len) {
 //    case IPAddress::kIPv4AddressSize: {
     case sizeof(struct sockaddr_in): {
@@ -60,6 +60,12 @@ class EndPoint final {
     assert(res);
   }
 
+  // A unix domain socket end point, bound to the socket file 'path'. A path
+  // starting with '@' names a socket in the abstract namespace of linux
+  // instead, which is not visible in the file system and disappears with
+  // the socket.
+  static EndPoint UnixDomain(const StringPiece& path);
+
   EndPoint(const EndPoint&) = default;
   EndPoint& operator=(const EndPoint&) = default;
 
@@ -67,7 +73,20 @@ class EndPoint final {
   EndPoint& operator=(EndPoint&&) = default;
 
   int Family() const {
-    return address_.Family();
+    return unix_domain_ ? AF_UNIX : address_.Family();
+  }
+
+  bool IsUnixDomain() const {
+    return unix_domain_;
+  }
+  bool IsAbstractUnixDomain() const {
+    return unix_domain_ && !unix_path_.empty() && unix_path_[0] == '\0';
+  }
+
+  // sun_path of a unix domain socket end point, the name of an abstract one
+  // starts with a '\0', and it's empty if the socket is not bound
+  const std::string& unix_path() const {
+    return unix_path_;
   }
 
   int port() const {
@@ -82,13 +101,19 @@ class EndPoint final {
     return address_;
   }
 
+  // NOTE: 'address' must be large enough for the family of the end point,
+  // e.g. a sockaddr_storage
   bool ToSockAddr(struct sockaddr* address,
                   socklen_t* address_len) const;
 
   bool FromSockAddr(const struct sockaddr& address,
                     socklen_t address_len);
 
+  // unix:/path/of/socket or unix:@name for the unix domain sockets
   std::string ToString() const {
+    if (unix_domain_) {
+      return UnixDomainToString();
+    }
     std::string res;
     res.reserve(64);
     res.append(address_.ToString());
@@ -98,17 +123,26 @@ class EndPoint final {
   }
 
   std::string ToStringWithoutPort() const {
+    if (unix_domain_) {
+      return UnixDomainToString();
+    }
     return address_.ToString();
   }
 
   void Swap(EndPoint& end_point) {
     std::swap(address_, end_point.address_);
     std::swap(port_, end_point.port_);
+    std::swap(unix_domain_, end_point.unix_domain_);
+    std::swap(unix_path_, end_point.unix_path_);
   }
 
  private:
+  std::string UnixDomainToString() const;
+
   IPAddress address_;
   int port_ { 0 };
+  bool unix_domain_ { false };
+  std::string unix_path_;
 };
 
 }  // namespace base
@@ -0,0 +1,215 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/base/resolver.h>
+#include <cnetpp/base/end_point.h>
+
+#include <assert.h>
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <chrono>
+#include <future>
+
+namespace cnetpp {
+namespace base {
+
+namespace {
+
+int64_t NowInMilliseconds() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the resolver whose query the current thread is running, see the blocking
+// Resolve()
+thread_local const Resolver* current_resolver = nullptr;
+
+}  // namespace
+
+bool Resolver::Start() {
+  std::unique_ptr<concurrency::ThreadPool> thread_pool(
+      new concurrency::ThreadPool("resolver"));
+  thread_pool->set_num_threads(num_threads_);
+  thread_pool->Start();
+  std::lock_guard<std::mutex> guard(mutex_);
+  assert(!thread_pool_);
+  thread_pool_ = std::move(thread_pool);
+  return true;
+}
+
+void Resolver::Stop() {
+  std::unique_ptr<concurrency::ThreadPool> thread_pool;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    thread_pool.swap(thread_pool_);
+  }
+  if (!thread_pool) {
+    return;
+  }
+  // don't hold mutex_ here, the queries in flight take it when they complete
+  thread_pool->Stop(true);
+}
+
+void Resolver::Resolve(const std::string& hostname, Callback callback) {
+  assert(callback);
+  std::vector<IPAddress> addresses(1);
+  if (IPAddress::LiteralToNumber(hostname, &addresses[0])) {
+    callback(addresses);
+    return;
+  }
+
+  auto now = NowInMilliseconds();
+  std::unique_lock<std::mutex> guard(mutex_);
+  auto itr = cache_.find(hostname);
+  if (itr == cache_.end()) {
+    if (cache_.size() >= max_cache_size_) {
+      SweepExpired(now);
+    }
+    itr = cache_.emplace(hostname, Entry()).first;
+  } else if (itr->second.resolving) {
+    itr->second.callbacks.emplace_back(std::move(callback));
+    return;
+  } else if (itr->second.expire_time > now) {
+    addresses = itr->second.addresses;
+    guard.unlock();
+    callback(addresses);
+    return;
+  }
+  itr->second.resolving = true;
+  itr->second.callbacks.emplace_back(std::move(callback));
+  guard.unlock();
+
+  Query(hostname);
+}
+
+bool Resolver::Resolve(const std::string& hostname,
+                       std::vector<IPAddress>* addresses) {
+  assert(addresses);
+  // a callback waiting for the resolver threads on one of them may never
+  // return, once all of them wait
+  assert(current_resolver != this);
+  auto promise = std::make_shared<std::promise<std::vector<IPAddress>>>();
+  auto future = promise->get_future();
+  Resolve(hostname, [promise] (const std::vector<IPAddress>& result) {
+    promise->set_value(result);
+  });
+  *addresses = future.get();
+  return !addresses->empty();
+}
+
+void Resolver::Clear() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  for (auto itr = cache_.begin(); itr != cache_.end(); ) {
+    if (itr->second.resolving) {
+      // the query in flight completes it
+      ++itr;
+    } else {
+      itr = cache_.erase(itr);
+    }
+  }
+}
+
+void Resolver::Query(const std::string& hostname) {
+  auto complete = [this, hostname] (std::vector<IPAddress>&& addresses,
+                                    bool cacheable) {
+    auto now = NowInMilliseconds();
+    std::unique_lock<std::mutex> guard(mutex_);
+    auto itr = cache_.find(hostname);
+    assert(itr != cache_.end() && itr->second.resolving);
+    auto callbacks = std::move(itr->second.callbacks);
+    if (cacheable && cache_.size() <= max_cache_size_) {
+      itr->second.resolving = false;
+      itr->second.callbacks.clear();
+      itr->second.addresses = addresses;
+      itr->second.expire_time =
+          now + (addresses.empty() ? negative_ttl_ : positive_ttl_);
+    } else {
+      cache_.erase(itr);
+    }
+    guard.unlock();
+
+    for (auto& callback : callbacks) {
+      callback(addresses);
+    }
+  };
+
+  auto task = [this, hostname, complete] () -> bool {
+    current_resolver = this;
+    std::vector<IPAddress> addresses;
+    if (!lookup_function_(hostname, &addresses)) {
+      addresses.clear();
+    }
+    complete(std::move(addresses), true);
+    current_resolver = nullptr;
+    return true;
+  };
+  std::unique_lock<std::mutex> guard(mutex_);
+  bool added = thread_pool_ && thread_pool_->AddTask(task);
+  guard.unlock();
+  if (!added) {
+    // not running, or too many queries pending
+    complete(std::vector<IPAddress>(), false);
+  }
+}
+
+void Resolver::SweepExpired(int64_t now) {
+  for (auto itr = cache_.begin(); itr != cache_.end(); ) {
+    if (!itr->second.resolving && itr->second.expire_time <= now) {
+      itr = cache_.erase(itr);
+    } else {
+      ++itr;
+    }
+  }
+}
+
+bool Resolver::GetAddrInfo(const std::string& hostname,
+                           std::vector<IPAddress>* addresses) {
+  assert(addresses);
+  struct addrinfo* presults = nullptr;
+  struct addrinfo hint;
+  memset(&hint, 0, sizeof(hint));
+  hint.ai_family = AF_UNSPEC;
+  hint.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(hostname.c_str(), nullptr, &hint, &presults) != 0 ||
+      !presults) {
+    return false;
+  }
+  // keep the order getaddrinfo() prefers
+  for (auto p = presults; p; p = p->ai_next) {
+    EndPoint end_point;
+    if (end_point.FromSockAddr(*p->ai_addr, p->ai_addrlen)) {
+      addresses->emplace_back(std::move(end_point.mutable_address()));
+    }
+  }
+  freeaddrinfo(presults);
+  return !addresses->empty();
+}
+
+}  // namespace base
+}  // namespace cnetpp
@@ -0,0 +1,133 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_BASE_RESOLVER_H_
+#define CNETPP_BASE_RESOLVER_H_
+
+#include <cnetpp/base/ip_address.h>
+#include <cnetpp/concurrency/thread_pool.h>
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cnetpp {
+namespace base {
+
+// Resolver looks up the addresses of host names on its own threads, so that
+// the callers never block on getaddrinfo(). The results are cached, the
+// successful ones for positive_ttl and the failed ones for negative_ttl
+// milliseconds, and the concurrent lookups of a host share a single query.
+class Resolver final {
+ public:
+  // the addresses of the host, empty if it can't be resolved
+  using Callback = std::function<void(const std::vector<IPAddress>&)>;
+  // resolves a host name synchronously, GetAddrInfo() by default
+  using LookupFunction =
+      std::function<bool(const std::string&, std::vector<IPAddress>*)>;
+
+  Resolver() = default;
+  ~Resolver() {
+    Stop();
+  }
+
+  // disallow copy and move operations
+  Resolver(const Resolver&) = delete;
+  Resolver& operator=(const Resolver&) = delete;
+  Resolver(Resolver&&) = delete;
+  Resolver& operator=(Resolver&&) = delete;
+
+  // the setters must be called before Start()
+  void set_num_threads(size_t num_threads) {
+    num_threads_ = num_threads;
+  }
+  void set_positive_ttl(int64_t positive_ttl) {
+    positive_ttl_ = positive_ttl;
+  }
+  void set_negative_ttl(int64_t negative_ttl) {
+    negative_ttl_ = negative_ttl;
+  }
+  // the expired entries are swept once the cache grows to this size, and no
+  // more host is cached while it stays full
+  void set_max_cache_size(size_t max_cache_size) {
+    max_cache_size_ = max_cache_size;
+  }
+  void set_lookup_function(LookupFunction lookup_function) {
+    lookup_function_ = std::move(lookup_function);
+  }
+
+  bool Start();
+  // wait for the queries in flight, whose callbacks are all called
+  void Stop();
+
+  // The callback is called at once by the calling thread if the host name
+  // is an address literal or cached, otherwise by a resolver thread.
+  void Resolve(const std::string& hostname, Callback callback);
+
+  // the same as above but blocks until the host is resolved
+  // NOTE: it must not be called by the callbacks of this resolver, which run
+  // on its threads
+  bool Resolve(const std::string& hostname, std::vector<IPAddress>* addresses);
+
+  // drop all the cached results
+  void Clear();
+
+  static bool GetAddrInfo(const std::string& hostname,
+                          std::vector<IPAddress>* addresses);
+
+ private:
+  struct Entry {
+    std::vector<IPAddress> addresses;
+    int64_t expire_time { 0 };
+    // the callbacks waiting for the query in flight
+    std::vector<Callback> callbacks;
+    bool resolving { false };
+  };
+
+  size_t num_threads_ { 2 };
+  int64_t positive_ttl_ { 60 * 1000 };
+  int64_t negative_ttl_ { 5 * 1000 };
+  size_t max_cache_size_ { 64 * 1024 };
+  LookupFunction lookup_function_ { &Resolver::GetAddrInfo };
+
+  std::unique_ptr<concurrency::ThreadPool> thread_pool_;
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, Entry> cache_;
+
+  void Query(const std::string& hostname);
+  void SweepExpired(int64_t now);
+};
+
+}  // namespace base
+}  // namespace cnetpp
+
+#endif  // CNETPP_BASE_RESOLVER_H_
@@ -28,6 +28,13 @@
 
 #include <sys/uio.h>
 
+#if defined(linux) || defined(__linux) || defined(__linux__)
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#endif
+
+#include <algorithm>
+
 namespace cnetpp {
 namespace base {
 
@@ -92,35 +99,65 @@ bool Socket::GetBlocking(bool* value) {
 }
 
 bool Socket::Bind(const EndPoint& end_point) {
-  sockaddr address;
-  socklen_t address_len;
-  if (!end_point.ToSockAddr(&address, &address_len)) {
+  // large enough for an ipv6 address
+  struct sockaddr_storage address;
+  socklen_t address_len = sizeof(address);
+  auto sock_address = reinterpret_cast<struct sockaddr*>(&address);
+  if (!end_point.ToSockAddr(sock_address, &address_len)) {
     return false;
   }
-  return ::bind(fd_, &address, address_len) == 0;
+  return ::bind(fd_, sock_address, address_len) == 0;
 }
 
 
 bool Socket::GetLocalEndPoint(EndPoint* end_point) const {
-  struct sockaddr addr;
-  socklen_t addr_length;
-  if (getsockname(fd_, &addr, &addr_length) == 0) {
-    end_point->FromSockAddr(addr, addr_length);
+  struct sockaddr_storage addr;
+  socklen_t addr_length = sizeof(addr);
+  auto sock_addr = reinterpret_cast<struct sockaddr*>(&addr);
+  if (getsockname(fd_, sock_addr, &addr_length) == 0) {
+    end_point->FromSockAddr(*sock_addr, addr_length);
     return true;
   }
   return false;
 }
 
 bool Socket::GetPeerEndPoint(EndPoint* end_point) const {
-  struct sockaddr addr;
-  socklen_t addr_length;
-  if (getpeername(fd_, &addr, &addr_length) == 0) {
-    end_point->FromSockAddr(addr, addr_length);
+  struct sockaddr_storage addr;
+  socklen_t addr_length = sizeof(addr);
+  auto sock_addr = reinterpret_cast<struct sockaddr*>(&addr);
+  if (getpeername(fd_, sock_addr, &addr_length) == 0) {
+    end_point->FromSockAddr(*sock_addr, addr_length);
     return true;
   }
   return false;
 }
 
+bool Socket::GetPeerCredentials(pid_t* pid, uid_t* uid, gid_t* gid) const {
+#if defined(SO_PEERCRED) && defined(__linux__)
+  struct ucred credentials;
+  socklen_t length = sizeof(credentials);
+  if (getsockopt(fd_, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+    return false;
+  }
+  *pid = credentials.pid;
+  *uid = credentials.uid;
+  *gid = credentials.gid;
+  return true;
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+  if (getpeereid(fd_, uid, gid) != 0) {
+    return false;
+  }
+  *pid = -1;
+  return true;
+#else
+  (void) pid;
+  (void) uid;
+  (void) gid;
+  SetLastError(ENOPROTOOPT);
+  return false;
+#endif
+}
+
 namespace {
 
 inline int PollReadable(int fd, int64_t timeout_in_milliseconds = -1) {
@@ -176,7 +213,7 @@ bool Socket::WaitWriteable(int64_t timeout_in_milliseconds, bool restart) {
 }
 
 // Following member methods are for ListenSocket
-ListenSocket::ListenSocket(const EndPoint& end_point)
+ListenSocket::ListenSocket(const EndPoint& end_point, bool reuse_port)
     : Socket(::socket(end_point.Family(), SOCK_STREAM, 0)) {
   if (!IsValid()) {
     assert(false);
@@ -186,6 +223,11 @@ ListenSocket::ListenSocket(const EndPoint& end_point)
   
   SetReuseAddress(true);
 
+  if (reuse_port && !SetReusePort(true)) {
+    throw std::runtime_error("Can't set SO_REUSEPORT on " +
+                             end_point.ToString());
+  }
+
   if (!Bind(end_point)) {
     throw std::runtime_error("Can't bind to " + end_point.ToString());
   }
@@ -199,14 +241,16 @@ bool ListenSocket::Accept(Socket* socket,
                           EndPoint* end_point,
                           bool auto_restart) {
   assert(socket);
-  struct sockaddr address;
+  // large enough for an ipv6 or a unix domain address
+  struct sockaddr_storage address;
   socklen_t address_length = sizeof(address);
+  auto sock_address = reinterpret_cast<struct sockaddr*>(&address);
   while (true) {
-    int ret = accept(fd(), &address, &address_length);
+    int ret = accept(fd(), sock_address, &address_length);
     if (ret != -1) {
       socket->Attach(ret);
       if (end_point) {
-        end_point->FromSockAddr(address, address_length);
+        end_point->FromSockAddr(*sock_address, address_length);
       }
       return true;
     } else {
@@ -218,16 +262,57 @@ bool ListenSocket::Accept(Socket* socket,
   return false;
 }
 
+bool ListenSocket::AcceptNonBlocking(Socket* socket,
+                                     EndPoint* end_point,
+                                     bool auto_restart) {
+#if defined(SOCK_NONBLOCK) && defined(SOCK_CLOEXEC)
+  assert(socket);
+  struct sockaddr_storage address;
+  socklen_t address_length = sizeof(address);
+  auto sock_address = reinterpret_cast<struct sockaddr*>(&address);
+  while (true) {
+    int ret = accept4(fd(),
+                      sock_address,
+                      &address_length,
+                      SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (ret != -1) {
+      socket->Attach(ret);
+      if (end_point) {
+        end_point->FromSockAddr(*sock_address, address_length);
+      }
+      return true;
+    } else {
+      if (!auto_restart || GetLastError() != EINTR) {
+        break;
+      }
+    }
+  }
+  return false;
+#else
+  if (!Accept(socket, end_point, auto_restart)) {
+    return false;
+  }
+  return socket->SetCloexec(true) && socket->SetBlocking(false);
+#endif
+}
+
 // Following member methods are for DataSocket
 bool DataSocket::Connect(const EndPoint& end_point) {
-  struct sockaddr address;
+  struct sockaddr_storage address;
   socklen_t address_length = sizeof(address);
-  end_point.ToSockAddr(&address, &address_length);
-  if (connect(fd(), &address, address_length) != 0) {
+  auto sock_address = reinterpret_cast<struct sockaddr*>(&address);
+  if (!end_point.ToSockAddr(sock_address, &address_length)) {
+    SetLastError(EINVAL);
+    return false;
+  }
+  if (connect(fd(), sock_address, address_length) != 0) {
     switch (errno) {
       case EINTR:
-      case EWOULDBLOCK:
         return true;
+      case EWOULDBLOCK:
+        // a unix domain socket fails with EAGAIN if the backlog of the
+        // listener is full, rather than connecting in the background
+        return !end_point.IsUnixDomain();
       case EINPROGRESS: {
         bool blocking = true;
         if (GetBlocking(&blocking) && !blocking) {
@@ -280,6 +365,135 @@ bool DataSocket::Send(const struct iovec* buffer,
   }
 }
 
+bool DataSocket::Send(const struct iovec* buffer,
+                      size_t count,
+                      size_t* sent_length,
+                      int flags,
+                      bool auto_restart) {
+  struct msghdr msg;
+  ::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<struct iovec*>(buffer);
+  msg.msg_iovlen = count;
+  while (true) {
+    ssize_t n = ::sendmsg(fd(), &msg, flags);
+    if (n != -1) {
+      *sent_length = n;
+      return true;
+    } else if (!IsInterruptedAndRestart(auto_restart)) {
+      *sent_length = 0;
+      return false;
+    }
+  }
+}
+
+bool DataSocket::SendFile(int in_fd,
+                          off_t* offset,
+                          size_t count,
+                          size_t* sent_length,
+                          bool auto_restart) {
+  assert(offset && sent_length);
+  while (true) {
+#if defined(linux) || defined(__linux) || defined(__linux__)
+    ssize_t n = ::sendfile(fd(), in_fd, offset, count);
+#else
+    char buffer[64 * 1024];
+    ssize_t n = ::pread(in_fd,
+                        buffer,
+                        std::min(count, sizeof(buffer)),
+                        *offset);
+    if (n > 0) {
+      n = ::send(fd(), buffer, n, 0);
+      if (n > 0) {
+        *offset += n;
+      }
+    }
+#endif
+    if (n != -1) {
+      *sent_length = n;
+      return true;
+    } else if (!IsInterruptedAndRestart(auto_restart)) {
+      *sent_length = 0;
+      return false;
+    }
+  }
+}
+
+bool DataSocket::Splice(int pipe_fd,
+                        size_t count,
+                        size_t* sent_length,
+                        bool auto_restart) {
+  assert(sent_length);
+#if defined(linux) || defined(__linux) || defined(__linux__)
+  while (true) {
+    ssize_t n = ::splice(pipe_fd,
+                         nullptr,
+                         fd(),
+                         nullptr,
+                         count,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n != -1) {
+      *sent_length = n;
+      return true;
+    } else if (!IsInterruptedAndRestart(auto_restart)) {
+      *sent_length = 0;
+      return false;
+    }
+  }
+#else
+  (void) pipe_fd;
+  (void) count;
+  (void) auto_restart;
+  *sent_length = 0;
+  SetLastError(ENOTSUP);
+  return false;
+#endif
+}
+
+bool DataSocket::ReceiveZeroCopyCompletion(uint32_t* first,
+                                           uint32_t* last,
+                                           bool* copied) {
+#if (defined(linux) || defined(__linux) || defined(__linux__)) && \
+    defined(SO_EE_ORIGIN_ZEROCOPY)
+  assert(first && last && copied);
+  while (true) {
+    char control[128];
+    struct msghdr msg;
+    ::memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(fd(), &msg, MSG_ERRQUEUE) == -1) {
+      if (IsInterruptedAndRestart(true)) {
+        continue;
+      }
+      return false;
+    }
+    for (auto cmsg = CMSG_FIRSTHDR(&msg);
+         cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+          !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+      auto err = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cmsg));
+      if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        continue;
+      }
+      *first = err->ee_info;
+      *last = err->ee_data;
+      *copied = (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+      return true;
+    }
+    // not a zero-copy completion, skip it
+  }
+#else
+  (void) first;
+  (void) last;
+  (void) copied;
+  SetLastError(ENOPROTOOPT);
+  return false;
+#endif
+}
+
 bool DataSocket::Receive(void* buffer,
                          size_t buffer_size,
                          size_t* received_size,
@@ -538,14 +752,16 @@ bool UdpSocket::SendTo(const void* buffer,
                        size_t buffer_size,
                        const EndPoint& end_point,
                        size_t* sent_size) {
-  struct sockaddr address;
+  // large enough for an ipv6 address
+  struct sockaddr_storage address;
   socklen_t address_length = sizeof(address);
-  end_point.ToSockAddr(&address, &address_length);
+  end_point.ToSockAddr(reinterpret_cast<struct sockaddr*>(&address),
+                       &address_length);
   int n = sendto(fd(),
                  reinterpret_cast<const char*>(buffer),
                  buffer_size,
                  0,
-                 &address,
+                 reinterpret_cast<struct sockaddr*>(&address),
                  address_length);
   if (n >= 0) {
     *sent_size = n;
@@ -561,18 +777,19 @@ bool UdpSocket::ReceiveFrom(void* buffer,
                             size_t* received_size,
                             EndPoint* end_point,
                             int flags) {
-  struct sockaddr address;
+  struct sockaddr_storage address;
   socklen_t address_length = sizeof(address);
   int n = recvfrom(fd(),
                    reinterpret_cast<char*>(buffer),
                    buffer_size,
                    flags,
-                   &address,
+                   reinterpret_cast<struct sockaddr*>(&address),
                    &address_length);
   if (n >= 0) {
     *received_size = n;
     if (end_point) {
-      end_point->FromSockAddr(address, address_length);
+      end_point->FromSockAddr(
+          *reinterpret_cast<struct sockaddr*>(&address), address_length);
     }
     return true;
   } else {
@@ -581,6 +798,71 @@ bool UdpSocket::ReceiveFrom(void* buffer,
   return false;
 }
 
+bool UdpSocket::ReceiveMultiple(struct mmsghdr* messages,
+                                size_t count,
+                                size_t* received_count,
+                                int flags,
+                                bool auto_restart) {
+  *received_count = 0;
+#if defined(__linux__)
+  while (true) {
+    int n = ::recvmmsg(fd(), messages, static_cast<unsigned int>(count),
+                       flags, nullptr);
+    if (n != -1) {
+      *received_count = n;
+      return true;
+    } else if (!IsInterruptedAndRestart(auto_restart)) {
+      return false;
+    }
+  }
+#else
+  while (*received_count < count) {
+    auto& message = messages[*received_count];
+    ssize_t n = ::recvmsg(fd(), &message.msg_hdr, flags);
+    if (n != -1) {
+      message.msg_len = static_cast<unsigned int>(n);
+      ++*received_count;
+    } else if (!IsInterruptedAndRestart(auto_restart)) {
+      // report the error only if nothing is received, like recvmmsg()
+      return *received_count > 0;
+    }
+  }
+  return true;
+#endif
+}
+
+bool UdpSocket::SendMultiple(struct mmsghdr* messages,
+                             size_t count,
+                             size_t* sent_count,
+                             int flags,
+                             bool auto_restart) {
+  *sent_count = 0;
+#if defined(__linux__)
+  while (true) {
+    int n = ::sendmmsg(fd(), messages, static_cast<unsigned int>(count),
+                       flags);
+    if (n != -1) {
+      *sent_count = n;
+      return true;
+    } else if (!IsInterruptedAndRestart(auto_restart)) {
+      return false;
+    }
+  }
+#else
+  while (*sent_count < count) {
+    auto& message = messages[*sent_count];
+    ssize_t n = ::sendmsg(fd(), &message.msg_hdr, flags);
+    if (n != -1) {
+      message.msg_len = static_cast<unsigned int>(n);
+      ++*sent_count;
+    } else if (!IsInterruptedAndRestart(auto_restart)) {
+      return *sent_count > 0;
+    }
+  }
+  return true;
+#endif
+}
+
 }  // namespace base
 }  // namespace cnetpp
 
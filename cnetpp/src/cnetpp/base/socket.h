@@ -37,6 +37,7 @@
 #include <net/if.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <poll.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -191,6 +192,12 @@ class Socket {
 
   bool GetPeerEndPoint(EndPoint* end_point) const;
 
+  // The credentials of the process connecting a unix domain socket, taken
+  // by the kernel when it called connect(), the same as SCM_CREDENTIALS of
+  // that process carries. *pid is set to -1 where the platform doesn't
+  // report it.
+  bool GetPeerCredentials(pid_t* pid, uid_t* uid, gid_t* gid) const;
+
   bool GetReuseAddress(bool* value) {
     return GetOption(SOL_SOCKET, SO_REUSEADDR, value);
   }
@@ -198,6 +205,60 @@ class Socket {
     return SetOption(SOL_SOCKET, SO_REUSEADDR, value);
   }
 
+  // SO_REUSEPORT lets several sockets bind to the same address, the kernel
+  // distributes incoming connections among their accept queues
+  bool GetReusePort(bool* value) {
+#if defined(SO_REUSEPORT)
+    return GetOption(SOL_SOCKET, SO_REUSEPORT, value);
+#else
+    (void) value;
+    SetLastError(ENOPROTOOPT);
+    return false;
+#endif
+  }
+  bool SetReusePort(bool value = true) {
+#if defined(SO_REUSEPORT)
+    return SetOption(SOL_SOCKET, SO_REUSEPORT, value);
+#else
+    (void) value;
+    SetLastError(ENOPROTOOPT);
+    return false;
+#endif
+  }
+
+  // SO_BUSY_POLL makes a blocking receive on this socket poll the device
+  // queue for up to 'microseconds' before sleeping, SO_PREFER_BUSY_POLL
+  // additionally defers the softirq processing to the busy polling thread
+  bool SetBusyPoll(int microseconds) {
+#if defined(SO_BUSY_POLL)
+    return SetOption(SOL_SOCKET, SO_BUSY_POLL, microseconds);
+#else
+    (void) microseconds;
+    SetLastError(ENOPROTOOPT);
+    return false;
+#endif
+  }
+  bool SetPreferBusyPoll(bool value = true) {
+#if defined(SO_PREFER_BUSY_POLL)
+    return SetOption(SOL_SOCKET, SO_PREFER_BUSY_POLL, value);
+#else
+    (void) value;
+    SetLastError(ENOPROTOOPT);
+    return false;
+#endif
+  }
+
+  // SO_ZEROCOPY allows DataSocket::Send() with MSG_ZEROCOPY
+  bool SetZeroCopy(bool value = true) {
+#if defined(SO_ZEROCOPY)
+    return SetOption(SOL_SOCKET, SO_ZEROCOPY, value);
+#else
+    (void) value;
+    SetLastError(ENOPROTOOPT);
+    return false;
+#endif
+  }
+
   bool SetLinger(bool onoff = true, int timeout = 0) {
     struct linger l;
     l.l_onoff = onoff;
@@ -230,6 +291,18 @@ class Socket {
     return GetOption(IPPROTO_TCP, TCP_NODELAY, onoff);
   }
 
+  // TCP_NOTSENT_LOWAT reports the socket writable only when less than 'bytes'
+  // of the queued data are not sent yet, which keeps the kernel queue short
+  bool SetTcpNotSentLowat(int bytes) {
+#if defined(TCP_NOTSENT_LOWAT)
+    return SetOption(IPPROTO_TCP, TCP_NOTSENT_LOWAT, bytes);
+#else
+    (void) bytes;
+    SetLastError(ENOPROTOOPT);
+    return false;
+#endif
+  }
+
   // @param timeout   nullptr means no timeout
   bool WaitReadable(struct timeval* timeout = nullptr, bool restart = true) {
     int64_t timeout_in_milliseconds =
@@ -285,16 +358,27 @@ class Socket {
 class ListenSocket : public Socket {
  public:
   ListenSocket() {}
-  ListenSocket(const EndPoint& end_point);
+  // create a socket and bind it to end_point, SO_REUSEPORT is set before
+  // binding if reuse_port is true
+  ListenSocket(const EndPoint& end_point, bool reuse_port = false);
   bool Create(bool ipv6 = false) {
     return Socket::Create(ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
   }
+  // create the system socket of the family of end_point, e.g. AF_UNIX
+  bool Create(const EndPoint& end_point) {
+    return Socket::Create(end_point.Family(), SOCK_STREAM, 0);
+  }
   bool Listen(int backlog = SOMAXCONN) {
     return listen(fd(), backlog) == 0;
   }
 
   bool Accept(Socket* socket, bool auto_restart = true);
   bool Accept(Socket* socket, EndPoint* end_point, bool auto_restart = true);
+  // the accepted socket is non-blocking and close-on-exec, with accept4() it
+  // saves the fcntl() calls on platforms supporting it
+  bool AcceptNonBlocking(Socket* socket,
+                         EndPoint* end_point,
+                         bool auto_restart = true);
 };
 
 // Abstract data transfer socket
@@ -316,6 +400,36 @@ class DataSocket : public Socket {
             size_t count,
             size_t* sent_length,
             bool auto_restart = true);
+  // send with sendmsg() flags, e.g. MSG_ZEROCOPY
+  bool Send(const struct iovec* buffer,
+            size_t count,
+            size_t* sent_length,
+            int flags,
+            bool auto_restart);
+
+  // Send at most 'count' bytes of the file from *offset without copying them
+  // into the user space, *offset is advanced by the bytes sent.
+  // It's emulated by pread() and send() where sendfile() is not available.
+  bool SendFile(int in_fd,
+                off_t* offset,
+                size_t count,
+                size_t* sent_length,
+                bool auto_restart = true);
+  // Move at most 'count' bytes from the pipe into the socket, only supported
+  // on linux
+  bool Splice(int pipe_fd,
+              size_t count,
+              size_t* sent_length,
+              bool auto_restart = true);
+
+  // Read a MSG_ZEROCOPY completion from the error queue: the zero-copy sends
+  // numbered from *first to *last have completed and their buffers can be
+  // reused. *copied is set if the kernel fell back to copying the data.
+  // @return false if there is no completion queued, or on error, check
+  //         GetLastError() for details
+  bool ReceiveZeroCopyCompletion(uint32_t* first,
+                                 uint32_t* last,
+                                 bool* copied);
 
   // @return Whether received any data or connect close by peer.
   // @note If connection is closed by peer, return true and received_size
@@ -386,6 +500,10 @@ class TcpSocket : public DataSocket {
   bool Create(bool ipv6 = false) {
     return Socket::Create((ipv6 ? AF_INET6 : AF_INET), SOCK_STREAM, 0);
   }
+  // create the system socket of the family of end_point, e.g. AF_UNIX
+  bool Create(const EndPoint& end_point) {
+    return Socket::Create(end_point.Family(), SOCK_STREAM, 0);
+  }
 
   // Shutdown connection
   bool Shutdown() {
@@ -518,6 +636,15 @@ class TcpSocket : public DataSocket {
                bool auto_restart = true);
 };
 
+#if !defined(__linux__)
+// the message header of recvmmsg() and sendmmsg(), which are emulated by
+// recvmsg() and sendmsg() elsewhere
+struct mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+};
+#endif
+
 /// Represent a Udp socket
 class UdpSocket : public DataSocket {
  public:
@@ -541,6 +668,49 @@ class UdpSocket : public DataSocket {
                    size_t* received_size,
                    EndPoint* end_point,
                    int flags = 0);
+
+  // Receive at most 'count' datagrams with one recvmmsg(), the caller sets up
+  // the buffers of the messages, and msg_len of each one received is set to
+  // its length. *received_count is 0 if it fails.
+  bool ReceiveMultiple(struct mmsghdr* messages,
+                       size_t count,
+                       size_t* received_count,
+                       int flags = 0,
+                       bool auto_restart = true);
+
+  // Send at most 'count' datagrams with one sendmmsg(). It stops at the first
+  // message failing, which is sent by the next call to report its error, so
+  // it only fails if no message is sent.
+  bool SendMultiple(struct mmsghdr* messages,
+                    size_t count,
+                    size_t* sent_count,
+                    int flags = 0,
+                    bool auto_restart = true);
+
+  // UDP_SEGMENT makes the kernel, or the NIC, split every send into the
+  // datagrams of 'segment_size' bytes, only the last one may be shorter.
+  // 0 turns it off, and a message can set its own size by a control message.
+  bool SetUdpSegmentSize(int segment_size) {
+#if defined(UDP_SEGMENT)
+    return SetOption(SOL_UDP, UDP_SEGMENT, segment_size);
+#else
+    (void) segment_size;
+    SetLastError(ENOPROTOOPT);
+    return false;
+#endif
+  }
+
+  // UDP_GRO lets the kernel coalesce the datagrams of a flow into one
+  // receive, whose segment size is reported by a UDP_GRO control message
+  bool SetUdpGro(bool value = true) {
+#if defined(UDP_GRO)
+    return SetOption(SOL_UDP, UDP_GRO, value);
+#else
+    (void) value;
+    SetLastError(ENOPROTOOPT);
+    return false;
+#endif
+  }
 };
 
 }  // namespace base
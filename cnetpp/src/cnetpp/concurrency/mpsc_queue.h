@@ -0,0 +1,131 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#ifndef CNETPP_CONCURRENCY_MPSC_QUEUE_H_
+#define CNETPP_CONCURRENCY_MPSC_QUEUE_H_
+
+#include <assert.h>
+
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cnetpp {
+namespace concurrency {
+
+// An unbounded lock-free multi-producer single-consumer queue.
+// Any thread can call Push(), but only one thread at a time can call
+// TryPop(), e.g. the event poller thread which owns the queue.
+// NOTE: An element whose Push() has not returned yet may be invisible to
+// TryPop() even if elements pushed after it are already linked, so the
+// consumer must not treat a false TryPop() as a proof that no Push() is in
+// progress.
+template <typename T>
+class MpscQueue final {
+ public:
+  MpscQueue() : head_(&stub_), tail_(&stub_) {
+    stub_.next.store(nullptr, std::memory_order_relaxed);
+  }
+
+  ~MpscQueue() {
+    // the storage of tail_ has been destroyed or never been constructed
+    Node* node = tail_;
+    while (node) {
+      Node* next = node->next.load(std::memory_order_acquire);
+      if (node != tail_) {
+        reinterpret_cast<T*>(&node->storage)->~T();
+      }
+      if (node != &stub_) {
+        delete node;
+      }
+      node = next;
+    }
+  }
+
+  // disallow copy and move operations
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+  MpscQueue(MpscQueue&&) = delete;
+  MpscQueue& operator=(MpscQueue&&) = delete;
+
+  void Push(const T& value) {
+    Node* node = new Node;
+    new (&node->storage) T(value);
+    DoPush(node);
+  }
+
+  void Push(T&& value) {
+    Node* node = new Node;
+    new (&node->storage) T(std::move(value));
+    DoPush(node);
+  }
+
+  // get an element from queue, if empty, just return false
+  bool TryPop(T* value) {
+    assert(value);
+    Node* tail = tail_;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (!next) {
+      return false;
+    }
+    T* v = reinterpret_cast<T*>(&next->storage);
+    *value = std::move(*v);
+    v->~T();
+    // 'next' becomes the new stub whose storage has been destroyed
+    tail_ = next;
+    if (tail != &stub_) {
+      delete tail;
+    }
+    return true;
+  }
+
+  // only the consumer thread can call this method
+  bool Empty() const {
+    return tail_->next.load(std::memory_order_acquire) == nullptr;
+  }
+
+ private:
+  struct Node {
+    std::atomic<Node*> next { nullptr };
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  void DoPush(Node* node) {
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  Node stub_;
+  // producers append new nodes here
+  std::atomic<Node*> head_;
+  // only touched by the consumer
+  Node* tail_;
+};
+
+}  // namespace concurrency
+}  // namespace cnetpp
+
+#endif  // CNETPP_CONCURRENCY_MPSC_QUEUE_H_
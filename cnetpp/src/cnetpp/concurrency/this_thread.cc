@@ -36,6 +36,10 @@
 #endif
 #include <unistd.h>
 
+#include <climits>
+#include <fstream>
+#include <sstream>
+
 namespace cnetpp {
 namespace concurrency {
 
@@ -82,5 +86,81 @@ std::string ThisThread::GetErrorString(int err) {
   return strerror(err);
 }
 
+bool ThisThread::SetCpuAffinity(const std::vector<int>& cpus) {
+  if (cpus.empty()) {
+    return true;
+  }
+#if defined(linux) || defined(__linux) || defined(__linux__)
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (auto cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      SetLastError(EINVAL);
+      return false;
+    }
+    CPU_SET(cpu, &cpu_set);
+  }
+  int res = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  if (res != 0) {
+    SetLastError(res);
+    return false;
+  }
+  return true;
+#else
+  SetLastError(ENOTSUP);
+  return false;
+#endif
+}
+
+bool ThisThread::SetPreferredNumaNode(int node) {
+#if (defined(linux) || defined(__linux) || defined(__linux__)) && \
+    defined(SYS_set_mempolicy)
+  if (node < 0) {
+    SetLastError(EINVAL);
+    return false;
+  }
+  const int kMpolPreferred = 1;  // MPOL_PREFERRED in <linux/mempolicy.h>
+  const size_t kBits = sizeof(unsigned long) * CHAR_BIT;
+  std::vector<unsigned long> node_mask(node / kBits + 1, 0);
+  node_mask[node / kBits] |= 1UL << (node % kBits);
+  // the kernel ignores the last bit of maxnode
+  return syscall(SYS_set_mempolicy,
+                 kMpolPreferred,
+                 node_mask.data(),
+                 node_mask.size() * kBits + 1) == 0;
+#else
+  (void) node;
+  SetLastError(ENOTSUP);
+  return false;
+#endif
+}
+
+std::vector<int> ThisThread::GetNumaNodeCpus(int node) {
+  std::vector<int> cpus;
+  if (node < 0) {
+    return cpus;
+  }
+  // the cpulist looks like "0-15,32-47"
+  std::ifstream in("/sys/devices/system/node/node" + std::to_string(node) +
+                   "/cpulist");
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    std::istringstream range_in(range);
+    int first = -1;
+    int last = -1;
+    char dash = 0;
+    if (!(range_in >> first)) {
+      continue;
+    }
+    if (!(range_in >> dash >> last) || dash != '-') {
+      last = first;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
 }  // namespace concurrency
 }  // namespace cnetpp
@@ -33,6 +33,7 @@
 
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace cnetpp {
 namespace concurrency {
@@ -49,6 +50,19 @@ class ThisThread {
   static std::string GetLastErrorString();
 
   static std::string GetErrorString(int err);
+
+  // restrict the calling thread to the given cpus, an empty set is a no-op.
+  // It's only supported on linux.
+  static bool SetCpuAffinity(const std::vector<int>& cpus);
+
+  // allocate the memory of the calling thread from the numa node when
+  // possible, falling back to the other nodes when it's exhausted.
+  // It's only supported on linux.
+  static bool SetPreferredNumaNode(int node);
+
+  // the cpus of the numa node, empty if it doesn't exist or numa isn't
+  // supported
+  static std::vector<int> GetNumaNodeCpus(int node);
 };
 
 }  // namespace concurrency
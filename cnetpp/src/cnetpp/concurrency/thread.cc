@@ -25,6 +25,7 @@
 // POSSIBILITY OF SUCH DAMAGE.
 //
 #include <cnetpp/concurrency/thread.h>
+#include <cnetpp/concurrency/this_thread.h>
 #include <cnetpp/base/log.h>
 
 #include <pthread.h>
@@ -71,10 +72,30 @@ void Thread::Start() {
 #else
     pthread_setname_np(pthread_self(), name_.c_str());
 #endif
+    ApplyPlacement();
     (*task_)();
   });
 }
 
+void Thread::ApplyPlacement() {
+  // failing to place the thread costs performance only, so just complain
+  if (numa_node_ >= 0 && !ThisThread::SetPreferredNumaNode(numa_node_)) {
+    Error("Failed to prefer numa node %d for thread %s: %s",
+          numa_node_,
+          name_.c_str(),
+          ThisThread::GetLastErrorString().c_str());
+  }
+  auto cpus = cpu_affinity_;
+  if (cpus.empty() && numa_node_ >= 0) {
+    cpus = ThisThread::GetNumaNodeCpus(numa_node_);
+  }
+  if (!ThisThread::SetCpuAffinity(cpus)) {
+    Error("Failed to set the cpu affinity of thread %s: %s",
+          name_.c_str(),
+          ThisThread::GetLastErrorString().c_str());
+  }
+}
+
 void Thread::Stop() {
   Status old = Status::kRunning;
   if (!status_.compare_exchange_strong(old, Status::kStop)) {
@@ -34,6 +34,7 @@
 #include <atomic>
 #include <thread>
 #include <string>
+#include <vector>
 
 namespace cnetpp {
 namespace concurrency {
@@ -72,6 +73,25 @@ public:
     return name_;
   }
 
+  // the cpus the thread is pinned on, empty means all of them. It must be
+  // set before Start().
+  const std::vector<int>& cpu_affinity() const {
+    return cpu_affinity_;
+  }
+  void set_cpu_affinity(const std::vector<int>& cpus) {
+    cpu_affinity_ = cpus;
+  }
+
+  // the numa node the thread allocates memory from, and runs on unless a
+  // cpu affinity is set. -1 means no preference. It must be set before
+  // Start().
+  int numa_node() const {
+    return numa_node_;
+  }
+  void set_numa_node(int numa_node) {
+    numa_node_ = numa_node;
+  }
+
   Id GetId() const noexcept {
     return thread_->get_id();
   }
@@ -100,8 +120,14 @@ public:
     std::function<bool()> closure_;
   };
 
+  // apply the cpu affinity and the numa node, called in the new thread
+  void ApplyPlacement();
+
   std::string name_;
 
+  std::vector<int> cpu_affinity_;
+  int numa_node_ { -1 };
+
   std::shared_ptr<Task> task_;
 
   std::unique_ptr<std::thread> thread_;
@@ -72,6 +72,10 @@ void ThreadPool::Start() {
   for (auto& t: threads_) {
     t = std::make_unique<Thread>([this] () -> bool { DoTask(); return true; },
         name_ + "-" + std::to_string(nr));
+    if (!cpu_affinity_.empty()) {
+      t->set_cpu_affinity({ cpu_affinity_[nr % cpu_affinity_.size()] });
+    }
+    t->set_numa_node(numa_node_);
     t->Start();
     Info("Thread %s-%d started.", name_.c_str(), nr);
     nr++;
@@ -81,6 +85,7 @@ void ThreadPool::Start() {
     delay_queue_ = std::make_unique<DelayQueue>();
     delay_thread_ = std::make_unique<Thread>(
         [this] () -> bool { PollDelayTask(); return true; }, name_ + "-d");
+    delay_thread_->set_numa_node(numa_node_);
     delay_thread_->Start();
     Info("Delay thread %s-d started.", name_.c_str());
   }
@@ -62,6 +62,21 @@ class ThreadPool final {
     threads_.resize(num);
   }
 
+  // the i-th thread is pinned on cpus[i % cpus.size()], empty means no
+  // pinning. It must be set before Start().
+  void set_cpu_affinity(const std::vector<int>& cpus) {
+    assert(status_.load(std::memory_order_acquire) == Status::kInit);
+    cpu_affinity_ = cpus;
+  }
+
+  // all threads allocate memory from the numa node, and run on its cpus
+  // unless a cpu affinity is set. -1 means no preference. It must be set
+  // before Start().
+  void set_numa_node(int numa_node) {
+    assert(status_.load(std::memory_order_acquire) == Status::kInit);
+    numa_node_ = numa_node;
+  }
+
   void set_max_num_pending_tasks(size_t num) {
     max_num_pending_tasks_ = num;
   }
@@ -106,6 +121,8 @@ class ThreadPool final {
   std::shared_ptr<QueueBase> queue_;
 
   std::vector<std::unique_ptr<Thread>> threads_;
+  std::vector<int> cpu_affinity_;
+  int numa_node_ { -1 };
 
   class DelayTask : public Task {
    public:
@@ -33,61 +33,74 @@ namespace http {
 
 void HttpBase::SetCallbacks(tcp::TcpOptions& tcp_options) {
   tcp_options.set_connected_callback(
-      [this] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+      [this] (const std::shared_ptr<tcp::TcpConnection>& c) -> bool {
         return this->OnConnected(c);
       }
   );
   tcp_options.set_closed_callback(
-      [this] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+      [this] (const std::shared_ptr<tcp::TcpConnection>& c) -> bool {
         return this->OnClosed(c);
       }
   );
   tcp_options.set_received_callback(
-      [this] (std::shared_ptr<tcp::TcpConnection> c) -> bool {
+      [this] (const std::shared_ptr<tcp::TcpConnection>& c) -> bool {
         return this->OnReceived(c);
       }
   );
   tcp_options.set_sent_callback(
-      [this] (bool sent, std::shared_ptr<tcp::TcpConnection> c) -> bool {
+      [this] (bool sent,
+              const std::shared_ptr<tcp::TcpConnection>& c) -> bool {
         return this->OnSent(sent, c);
       }
   );
 }
 
-bool HttpBase::OnConnected(std::shared_ptr<tcp::TcpConnection> tcp_connection) {
+bool HttpBase::OnConnected(
+    const std::shared_ptr<tcp::TcpConnection>& tcp_connection) {
   assert(tcp_connection.get());
 
   auto http_connection = std::make_shared<HttpConnection>(tcp_connection);
   http_connections_mutex_.lock();
   http_connections_[tcp_connection->id()] = http_connection;
   http_connections_mutex_.unlock();
+  // kept alive by http_connections_ until OnClosed()
+  tcp_connection->set_context(http_connection.get());
   HandleConnected(http_connection);
 
   return http_connection->OnConnected();
 }
 
-bool HttpBase::OnReceived(std::shared_ptr<tcp::TcpConnection> tcp_connection) {
+bool HttpBase::OnReceived(
+    const std::shared_ptr<tcp::TcpConnection>& tcp_connection) {
   assert(tcp_connection.get());
-  http_connections_mutex_.lock();
-  auto itr = http_connections_.find(tcp_connection->id());
-  assert(itr != http_connections_.end());
-  auto http_connection = itr->second;
-  http_connections_mutex_.unlock();
+  auto context = static_cast<HttpConnection*>(tcp_connection->context());
+  if (!context) {
+    // closed by a callback of the same event
+    return false;
+  }
+  // the callbacks may close the connection, which drops it from
+  // http_connections_ at once
+  auto http_connection = context->shared_from_this();
   return http_connection->OnReceived();
 }
 
-bool HttpBase::OnSent(bool success,
-                      std::shared_ptr<tcp::TcpConnection> tcp_connection) {
+bool HttpBase::OnSent(
+    bool success,
+    const std::shared_ptr<tcp::TcpConnection>& tcp_connection) {
   assert(tcp_connection.get());
-  http_connections_mutex_.lock();
-  auto itr = http_connections_.find(tcp_connection->id());
-  assert(itr != http_connections_.end());
-  auto http_connection = itr->second;
-  http_connections_mutex_.unlock();
+  auto context = static_cast<HttpConnection*>(tcp_connection->context());
+  if (!context) {
+    // closed by a callback of the same event
+    return false;
+  }
+  // the callbacks may close the connection, which drops it from
+  // http_connections_ at once
+  auto http_connection = context->shared_from_this();
   return http_connection->OnSent(success);
 }
 
-bool HttpBase::OnClosed(std::shared_ptr<tcp::TcpConnection> tcp_connection) {
+bool HttpBase::OnClosed(
+    const std::shared_ptr<tcp::TcpConnection>& tcp_connection) {
   assert(tcp_connection.get());
 
   http_connections_mutex_.lock();
@@ -105,6 +118,7 @@ bool HttpBase::OnClosed(std::shared_ptr<tcp::TcpConnection> tcp_connection) {
   auto http_connection = itr->second;
   http_connections_.erase(itr);
   http_connections_mutex_.unlock();
+  tcp_connection->set_context(nullptr);
   bool ret = http_connection->OnClosed();
   return ret;
 }
@@ -69,14 +69,17 @@ class HttpBase {
       std::shared_ptr<HttpConnection> http_connection) = 0;
 
   virtual bool OnConnected(
-      std::shared_ptr<tcp::TcpConnection> tcp_connection);
+      const std::shared_ptr<tcp::TcpConnection>& tcp_connection);
 
-  virtual bool OnReceived(std::shared_ptr<tcp::TcpConnection> tcp_connection);
+  virtual bool OnReceived(
+      const std::shared_ptr<tcp::TcpConnection>& tcp_connection);
 
-  virtual bool OnSent(bool success,
-                      std::shared_ptr<tcp::TcpConnection> tcp_connection);
+  virtual bool OnSent(
+      bool success,
+      const std::shared_ptr<tcp::TcpConnection>& tcp_connection);
 
-  virtual bool OnClosed(std::shared_ptr<tcp::TcpConnection> tcp_connection);
+  virtual bool OnClosed(
+      const std::shared_ptr<tcp::TcpConnection>& tcp_connection);
 };
 
 }  // namespace http
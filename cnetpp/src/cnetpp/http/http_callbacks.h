@@ -34,6 +34,7 @@ namespace cnetpp {
 namespace http {
 
 class HttpConnection;
+class HttpResponse;
 
 using ConnectedCallbackType =
     std::function<bool(std::shared_ptr<HttpConnection>)>;
@@ -42,6 +43,10 @@ using ReceivedCallbackType =
     std::function<bool(std::shared_ptr<HttpConnection>)>;
 using SentCallbackType =
     std::function<bool(bool, std::shared_ptr<HttpConnection>)>;
+// called once for every request sent by HttpClient::SendRequest(), with a
+// nullptr response if the request failed
+using ResponseCallbackType =
+    std::function<void(std::shared_ptr<HttpResponse>)>;
 
 }  // namespace http
 }  // namespace cnetpp
@@ -27,8 +27,12 @@
 #include <cnetpp/http/http_client.h>
 #include <cnetpp/http/http_connection.h>
 #include <cnetpp/http/http_response.h>
+#include <cnetpp/concurrency/this_thread.h>
 
-#include <netdb.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <chrono>
 
 namespace cnetpp {
 namespace http {
@@ -46,6 +50,7 @@ tcp::ConnectionId HttpClient::DoConnect(
   tcp::TcpClientOptions options;
   options.set_send_buffer_size(http_options->send_buffer_size());
   options.set_receive_buffer_size(http_options->receive_buffer_size());
+  options.set_mirrored_receive_buffer(http_options->mirrored_receive_buffer());
   SetCallbacks(options);
   auto new_http_options = std::static_pointer_cast<void>(http_options);
   return tcp_client_.Connect(remote, options, new_http_options);
@@ -53,38 +58,17 @@ tcp::ConnectionId HttpClient::DoConnect(
 
 tcp::ConnectionId HttpClient::Connect(base::StringPiece url_str,
                                       const HttpClientOptions& http_options) {
-  std::string url_with_scheme = "";
-  if (!url_str.starts_with("http")) {
-    url_with_scheme.append("http://");
-  }
-  url_with_scheme.append(url_str.data(), url_str.length());
-  // parse url
   base::Uri url;
-  if (!url.Parse(url_with_scheme)) {
+  if (!ParseUrl(url_str, &url)) {
     return tcp::kInvalidConnectionId;
   }
-  
-  // resolve address of url
-  struct addrinfo *presults = nullptr;
-  struct addrinfo hint;
-  bzero(&hint, sizeof(hint));
-  hint.ai_family = AF_UNSPEC;
-  hint.ai_socktype = SOCK_STREAM;
-  std::string port_str = std::to_string(url.Port());
-  if (getaddrinfo(url.Hostname().c_str(),
-                       port_str.c_str(),
-                       &hint,
-                       &presults) != 0 ||
-      !presults) {
+  // blocks only if the host isn't cached yet
+  std::vector<base::IPAddress> addresses;
+  if (!resolver_.Resolve(url.Hostname(), &addresses)) {
     return tcp::kInvalidConnectionId;
   }
-  base::EndPoint endpoint;
-  // just pick the first item in presults as the ip address
-  if (!endpoint.FromSockAddr(*presults->ai_addr, presults->ai_addrlen)) {
-    freeaddrinfo(presults);
-    return tcp::kInvalidConnectionId;
-  }
-  freeaddrinfo(presults);
+  // just pick the first address, in the order getaddrinfo() prefers
+  base::EndPoint endpoint(addresses[0], url.Port());
 
   auto new_http_options =
       std::shared_ptr<HttpClientOptions>(new HttpClientOptions(http_options));
@@ -94,6 +78,45 @@ tcp::ConnectionId HttpClient::Connect(base::StringPiece url_str,
   return DoConnect(&endpoint, new_http_options);
 }
 
+bool HttpClient::AsyncConnect(base::StringPiece url_str,
+                              const HttpClientOptions& http_options) {
+  auto new_http_options =
+      std::shared_ptr<HttpClientOptions>(new HttpClientOptions(http_options));
+  base::Uri url;
+  if (!ParseUrl(url_str, &url)) {
+    return false;
+  }
+  new_http_options->set_remote_hostname(url.Hostname());
+  int port = url.Port();
+  resolver_.Resolve(url.Hostname(),
+      [this, new_http_options, port] (
+          const std::vector<base::IPAddress>& addresses) {
+        base::EndPoint endpoint;
+        if (!addresses.empty()) {
+          endpoint = base::EndPoint(addresses[0], port);
+        }
+        if (addresses.empty() ||
+            DoConnect(&endpoint, new_http_options) ==
+                tcp::kInvalidConnectionId) {
+          // as if the connection were closed before being established
+          if (new_http_options->closed_callback()) {
+            new_http_options->closed_callback()(
+                std::shared_ptr<HttpConnection>());
+          }
+        }
+      });
+  return true;
+}
+
+bool HttpClient::ParseUrl(base::StringPiece url_str, base::Uri* url) {
+  std::string url_with_scheme = "";
+  if (!url_str.starts_with("http")) {
+    url_with_scheme.append("http://");
+  }
+  url_with_scheme.append(url_str.data(), url_str.length());
+  return url->Parse(url_with_scheme);
+}
+
 bool HttpClient::AsyncClose(tcp::ConnectionId connection_id) {
   return tcp_client_.AsyncClosed(connection_id);
 }
@@ -114,6 +137,278 @@ bool HttpClient::HandleConnected(
   return true;
 }
 
+namespace {
+
+int64_t NowInMilliseconds() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// an idle connection must have nothing to read, otherwise the server has
+// closed it or sent something unexpected
+bool IsIdleConnectionHealthy(HttpConnection* http_connection) {
+  char c;
+  size_t received_length = 0;
+  auto tcp_connection = http_connection->tcp_connection();
+  if (tcp_connection->mutable_socket().Receive(&c,
+                                               1,
+                                               &received_length,
+                                               MSG_PEEK | MSG_DONTWAIT)) {
+    return false;
+  }
+  int error = concurrency::ThisThread::GetLastError();
+  return error == EAGAIN || error == EWOULDBLOCK;
+}
+
+}  // namespace
+
+bool HttpClient::SendRequest(base::StringPiece url_str,
+                             std::shared_ptr<HttpRequest> request,
+                             ResponseCallbackType callback) {
+  base::Uri url;
+  if (!ParseUrl(url_str, &url)) {
+    callback(std::shared_ptr<HttpResponse>());
+    return false;
+  }
+  int port = url.Port();
+  resolver_.Resolve(url.Hostname(),
+      [this, port, request, callback] (
+          const std::vector<base::IPAddress>& addresses) {
+        if (addresses.empty()) {
+          callback(std::shared_ptr<HttpResponse>());
+          return;
+        }
+        SendRequest(base::EndPoint(addresses[0], port), request, callback);
+      });
+  return true;
+}
+
+bool HttpClient::SendRequest(const base::EndPoint& remote,
+                             std::shared_ptr<HttpRequest> request,
+                             ResponseCallbackType callback) {
+  assert(request.get());
+  assert(callback);
+  auto pool = GetConnectionPool(remote);
+
+  std::vector<std::shared_ptr<HttpConnection>> stale;
+  std::unique_lock<std::mutex> guard(pool->mutex);
+  auto http_connection = CheckoutLocked(pool, &stale);
+  bool open = false;
+  if (http_connection) {
+    pool->busy[http_connection->id()] = PendingRequest { request, callback };
+  } else {
+    pool->waiting.emplace_back(PendingRequest { request, callback });
+    if (pool->total < options_.max_connections_per_endpoint()) {
+      ++pool->total;
+      ++pool->connecting;
+      open = true;
+    }
+  }
+  guard.unlock();
+
+  for (auto& c : stale) {
+    c->MarkAsClosed();
+  }
+  if (http_connection) {
+    // a failure closes the connection, which fails the request
+    http_connection->SendPacket(request);
+  } else if (open) {
+    OpenPooledConnection(pool);
+  }
+  return true;
+}
+
+HttpClient::ConnectionPool* HttpClient::GetConnectionPool(
+    const base::EndPoint& remote) {
+  auto key = remote.ToString();
+  std::lock_guard<std::mutex> guard(pools_mutex_);
+  auto itr = pools_.find(key);
+  if (itr != pools_.end()) {
+    return itr->second.get();
+  }
+
+  std::unique_ptr<ConnectionPool> pool(new ConnectionPool);
+  auto raw_pool = pool.get();
+  raw_pool->remote = remote;
+  raw_pool->options =
+      std::shared_ptr<HttpClientOptions>(new HttpClientOptions(options_));
+  raw_pool->options->set_sent_callback(nullptr);
+  raw_pool->options->set_connected_callback(
+      [this, raw_pool] (std::shared_ptr<HttpConnection> c) -> bool {
+        return this->OnPooledConnected(raw_pool, c);
+      }
+  );
+  raw_pool->options->set_received_callback(
+      [this, raw_pool] (std::shared_ptr<HttpConnection> c) -> bool {
+        return this->OnPooledReceived(raw_pool, c);
+      }
+  );
+  raw_pool->options->set_closed_callback(
+      [this, raw_pool] (std::shared_ptr<HttpConnection> c) -> bool {
+        return this->OnPooledClosed(raw_pool, c);
+      }
+  );
+  pools_[key] = std::move(pool);
+  return raw_pool;
+}
+
+std::shared_ptr<HttpConnection> HttpClient::CheckoutLocked(
+    ConnectionPool* pool,
+    std::vector<std::shared_ptr<HttpConnection>>* stale) {
+  auto deadline = NowInMilliseconds() - options_.idle_connection_timeout();
+  while (!pool->idle.empty()) {
+    auto idle = std::move(pool->idle.back());
+    pool->idle.pop_back();
+    // the connection is not closed by the event poller while it's idle in
+    // the pool, which is locked
+    if (idle.second >= deadline && IsIdleConnectionHealthy(idle.first.get())) {
+      return std::move(idle.first);
+    }
+    // it's still counted in the total until it's closed
+    stale->emplace_back(std::move(idle.first));
+  }
+  return nullptr;
+}
+
+void HttpClient::ReleaseConnection(
+    ConnectionPool* pool,
+    std::shared_ptr<HttpConnection> http_connection) {
+  std::vector<std::shared_ptr<HttpConnection>> stale;
+  std::unique_lock<std::mutex> guard(pool->mutex);
+  if (!pool->waiting.empty()) {
+    auto pending = std::move(pool->waiting.front());
+    pool->waiting.pop_front();
+    auto request = pending.request;
+    pool->busy[http_connection->id()] = std::move(pending);
+    guard.unlock();
+    http_connection->SendPacket(request);
+    return;
+  }
+
+  auto now = NowInMilliseconds();
+  auto deadline = now - options_.idle_connection_timeout();
+  // the oldest idle connections are at the front
+  while (!pool->idle.empty() && (pool->idle.front().second < deadline ||
+      pool->idle.size() >= options_.max_idle_connections_per_endpoint())) {
+    stale.emplace_back(std::move(pool->idle.front().first));
+    pool->idle.pop_front();
+  }
+  if (options_.max_idle_connections_per_endpoint() > 0) {
+    pool->idle.emplace_back(http_connection, now);
+  } else {
+    stale.emplace_back(http_connection);
+  }
+  guard.unlock();
+
+  for (auto& c : stale) {
+    c->MarkAsClosed();
+  }
+}
+
+void HttpClient::OpenPooledConnection(ConnectionPool* pool) {
+  if (DoConnect(&pool->remote, pool->options) != tcp::kInvalidConnectionId) {
+    return;
+  }
+  // as if the connection were closed before being established
+  OnPooledClosed(pool, std::shared_ptr<HttpConnection>());
+}
+
+bool HttpClient::OnPooledConnected(
+    ConnectionPool* pool,
+    std::shared_ptr<HttpConnection> http_connection) {
+  {
+    std::lock_guard<std::mutex> guard(pool->mutex);
+    assert(pool->connecting > 0);
+    --pool->connecting;
+  }
+  ReleaseConnection(pool, http_connection);
+  return true;
+}
+
+bool HttpClient::OnPooledReceived(
+    ConnectionPool* pool,
+    std::shared_ptr<HttpConnection> http_connection) {
+  auto response =
+      std::static_pointer_cast<HttpResponse>(http_connection->http_packet());
+  // the response is handed over to the callback, parse the next one into a
+  // new packet
+  http_connection->set_http_packet(
+      std::shared_ptr<HttpPacket>(new HttpResponse));
+
+  std::unique_lock<std::mutex> guard(pool->mutex);
+  auto itr = pool->busy.find(http_connection->id());
+  if (itr == pool->busy.end()) {
+    // nobody is waiting for this response
+    return false;
+  }
+  auto pending = std::move(itr->second);
+  pool->busy.erase(itr);
+  guard.unlock();
+
+  if (response->IsKeepAlive() && pending.request->IsKeepAlive()) {
+    ReleaseConnection(pool, http_connection);
+  } else {
+    // it leaves the total once it's closed
+    http_connection->MarkAsClosed();
+  }
+  pending.callback(std::move(response));
+  return true;
+}
+
+bool HttpClient::OnPooledClosed(
+    ConnectionPool* pool,
+    std::shared_ptr<HttpConnection> http_connection) {
+  std::vector<PendingRequest> failed;
+  std::unique_lock<std::mutex> guard(pool->mutex);
+  assert(pool->total > 0);
+  --pool->total;
+  if (!http_connection) {
+    // failed to connect
+    assert(pool->connecting > 0);
+    --pool->connecting;
+  } else {
+    for (auto itr = pool->idle.begin(); itr != pool->idle.end(); ++itr) {
+      if (itr->first == http_connection) {
+        pool->idle.erase(itr);
+        break;
+      }
+    }
+    auto itr = pool->busy.find(http_connection->id());
+    if (itr != pool->busy.end()) {
+      failed.emplace_back(std::move(itr->second));
+      pool->busy.erase(itr);
+    }
+  }
+  bool open = false;
+  if (!pool->waiting.empty()) {
+    if (http_connection) {
+      // replace it for the waiting requests, unless enough connections are
+      // being opened for them already
+      if (pool->connecting < pool->waiting.size() &&
+          pool->total < options_.max_connections_per_endpoint()) {
+        ++pool->total;
+        ++pool->connecting;
+        open = true;
+      }
+    } else if (pool->total == 0) {
+      // failed to connect, and no other connection will serve them
+      for (auto& pending : pool->waiting) {
+        failed.emplace_back(std::move(pending));
+      }
+      pool->waiting.clear();
+    }
+  }
+  guard.unlock();
+
+  for (auto& pending : failed) {
+    pending.callback(std::shared_ptr<HttpResponse>());
+  }
+  if (open) {
+    OpenPooledConnection(pool);
+  }
+  return true;
+}
+
 }  // namespace http
 }  // namespace cnetpp
 
@@ -29,11 +29,21 @@
 
 #include <cnetpp/http/http_base.h>
 #include <cnetpp/http/http_connection.h>
+#include <cnetpp/http/http_request.h>
+#include <cnetpp/http/http_response.h>
 #include <cnetpp/tcp/tcp_client.h>
 #include <cnetpp/base/end_point.h>
+#include <cnetpp/base/resolver.h>
 #include <cnetpp/base/uri.h>
 
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace cnetpp {
 namespace http {
@@ -44,26 +54,124 @@ class HttpClient final : public HttpBase {
   ~HttpClient() = default;
 
   bool Launch(const HttpClientOptions& http_options = HttpClientOptions()) {
+    options_ = http_options;
+    resolver_.set_num_threads(http_options.resolver_thread_count());
+    resolver_.set_positive_ttl(http_options.dns_cache_ttl());
+    resolver_.set_negative_ttl(http_options.dns_negative_cache_ttl());
+    if (!resolver_.Start()) {
+      return false;
+    }
     tcp::TcpClientOptions options;
     options.set_worker_count(http_options.worker_count());
     return tcp_client_.Launch("hcli", options);
   }
 
+  // remote may be a unix domain socket, see EndPoint::UnixDomain(), and so
+  // may the one of SendRequest()
   tcp::ConnectionId Connect(const base::EndPoint* remote,
                             const HttpClientOptions& options);
+  // the host of the url is resolved by the resolver of this client, so only
+  // the first connection to a host, or the first one after its cached
+  // addresses expire, waits for the name server
+  // NOTE: as it may block, it must not be called by the callbacks of any
+  // connection, which would stall their event poller, nor by the callbacks of
+  // AsyncConnect(), which run on the resolver threads. Use AsyncConnect()
+  // there instead.
   tcp::ConnectionId Connect(base::StringPiece url,
                             const HttpClientOptions& options);
+  // Never blocks: the connection is established after the host is resolved,
+  // and the connected callback of the options is called then. If it can't be
+  // resolved or connected, the closed callback is called with nullptr.
+  // Returns false if the url is invalid.
+  bool AsyncConnect(base::StringPiece url, const HttpClientOptions& options);
 
   bool AsyncClose(tcp::ConnectionId connection_id);
 
+  // Send the request on a keep-alive connection to the remote end point,
+  // reusing the one idle most recently, or a new one within the limits of
+  // the options passed to Launch(). The callback is called exactly once, and
+  // is given nullptr if the request failed. It's called by an event poller
+  // thread once the response arrives, but a request failed before being
+  // sent may be called back by the calling thread, even before this returns,
+  // or by a resolver thread if the host of the url can't be resolved.
+  // Returns false if it has failed at once, the callback has been called.
+  bool SendRequest(const base::EndPoint& remote,
+                   std::shared_ptr<HttpRequest> request,
+                   ResponseCallbackType callback);
+  bool SendRequest(base::StringPiece url,
+                   std::shared_ptr<HttpRequest> request,
+                   ResponseCallbackType callback);
+
  private:
   tcp::TcpClient tcp_client_;
+  HttpClientOptions options_;
+  base::Resolver resolver_;
+
+  struct PendingRequest {
+    std::shared_ptr<HttpRequest> request;
+    ResponseCallbackType callback;
+  };
+
+  // the connections to one remote end point
+  struct ConnectionPool {
+    std::mutex mutex;
+    base::EndPoint remote;
+    // shared by all the connections of this pool
+    std::shared_ptr<HttpClientOptions> options;
+    // all the connections opened, connecting, busy, idle or being closed
+    size_t total { 0 };
+    // the connections being opened, counted in the total as well
+    size_t connecting { 0 };
+    // the idle connections and since when, the most recently used at the back
+    std::deque<std::pair<std::shared_ptr<HttpConnection>, int64_t>> idle;
+    // the requests waiting for their responses, by connection
+    std::unordered_map<tcp::ConnectionId, PendingRequest> busy;
+    // the requests waiting for a connection
+    std::deque<PendingRequest> waiting;
+  };
+
+  // the pools are never removed before the client is shut down, so the
+  // callbacks of the connections keep plain pointers to them
+  std::unordered_map<std::string, std::unique_ptr<ConnectionPool>> pools_;
+  std::mutex pools_mutex_;
+
+  ConnectionPool* GetConnectionPool(const base::EndPoint& remote);
+
+  // take the healthy idle connection used most recently, closing the stale
+  // ones found on the way, must be called with pool->mutex held
+  std::shared_ptr<HttpConnection> CheckoutLocked(
+      ConnectionPool* pool,
+      std::vector<std::shared_ptr<HttpConnection>>* stale);
+
+  // hand the connection over to the next waiting request, or keep it idle
+  void ReleaseConnection(ConnectionPool* pool,
+                         std::shared_ptr<HttpConnection> http_connection);
+
+  // open one more connection for the waiting requests of the pool, it has
+  // been counted in the total by the caller
+  void OpenPooledConnection(ConnectionPool* pool);
+
+  bool OnPooledConnected(ConnectionPool* pool,
+                         std::shared_ptr<HttpConnection> http_connection);
+  bool OnPooledReceived(ConnectionPool* pool,
+                        std::shared_ptr<HttpConnection> http_connection);
+  bool OnPooledClosed(ConnectionPool* pool,
+                      std::shared_ptr<HttpConnection> http_connection);
+
+  static bool ParseUrl(base::StringPiece url_str, base::Uri* url);
 
   tcp::ConnectionId DoConnect(const base::EndPoint* remote,
                               std::shared_ptr<HttpClientOptions> http_options);
 
   bool DoShutdown() override {
-    return tcp_client_.Shutdown();
+    // no more connection is made for the hosts being resolved
+    resolver_.Stop();
+    if (!tcp_client_.Shutdown()) {
+      return false;
+    }
+    std::lock_guard<std::mutex> guard(pools_mutex_);
+    pools_.clear();
+    return true;
   }
 
   bool HandleConnected(
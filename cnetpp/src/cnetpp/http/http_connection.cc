@@ -30,16 +30,37 @@
 namespace cnetpp {
 namespace http {
 
+namespace {
+
+// the smaller bodies are copied after the headers, which is cheaper than an
+// extra slice
+const size_t kMinSharedBodySize = 16 * 1024;
+
+}  // namespace
+
 bool HttpConnection::SendPacket(std::shared_ptr<HttpPacket> http_packet) {
+  assert(http_packet);
   std::string str_packet;
-  http_packet->ToString(&str_packet);
-  return SendPacket(str_packet);
+  const std::string& body = http_packet->http_body();
+  if (body.size() < kMinSharedBodySize) {
+    http_packet->ToString(&str_packet);
+    return SendPacket(tcp::IOBuf(std::move(str_packet)));
+  }
+  http_packet->HttpHeadersToString(&str_packet);
+  tcp::IOBuf packet(std::move(str_packet));
+  // the packet keeps the body alive until it has been sent
+  packet.Append(tcp::IOBuf(http_packet, body.data(), body.size()));
+  return SendPacket(std::move(packet));
 }
 
 bool HttpConnection::SendPacket(base::StringPiece data) {
   return tcp_connection_->SendPacket(data);
 }
 
+bool HttpConnection::SendPacket(tcp::IOBuf&& data) {
+  return tcp_connection_->SendPacket(std::move(data));
+}
+
 bool HttpConnection::OnConnected() {
   if (connected_callback_) {
     connected_callback_(shared_from_this());
@@ -112,8 +112,11 @@ class HttpConnection : public std::enable_shared_from_this<HttpConnection> {
     http_packet_ = http_packet;
   }
 
+  // The body is sent without being copied if it's large, so the packet must
+  // not be modified any more once it has been passed here
   bool SendPacket(std::shared_ptr<HttpPacket> http_packet);
   bool SendPacket(base::StringPiece data);
+  bool SendPacket(tcp::IOBuf&& data);
 
   bool OnConnected();
 
@@ -29,6 +29,10 @@
 
 #include <cnetpp/http/http_callbacks.h>
 
+#include <stdint.h>
+
+#include <string>
+
 namespace cnetpp {
 namespace http {
 
@@ -75,6 +79,15 @@ class HttpOptions {
     receive_buffer_size_ = size;
   }
 
+  // see tcp::TcpOptions::mirrored_receive_buffer(), it saves moving the
+  // data of a partially received request or response on every arrival
+  bool mirrored_receive_buffer() const {
+    return mirrored_receive_buffer_;
+  }
+  void set_mirrored_receive_buffer(bool mirrored_receive_buffer) {
+    mirrored_receive_buffer_ = mirrored_receive_buffer;
+  }
+
   ConnectedCallbackType connected_callback() const {
     return connected_callback_;
   }
@@ -109,6 +122,7 @@ class HttpOptions {
   size_t tcp_receive_buffer_size_ { 32 * 1024 };
   size_t send_buffer_size_ { 0 };
   size_t receive_buffer_size_ { 0 };
+  bool mirrored_receive_buffer_ { false };
   ConnectedCallbackType connected_callback_ { nullptr };
   ClosedCallbackType closed_callback_ { nullptr };
   ReceivedCallbackType received_callback_ { nullptr };
@@ -130,8 +144,66 @@ class HttpClientOptions : public HttpOptions {
     remote_hostname_ = std::move(remote_hostname);
   }
 
+  // The limits of the connections HttpClient::SendRequest() keeps for every
+  // remote end point, taken from the options passed to HttpClient::Launch().
+  // The requests beyond max_connections_per_endpoint wait for a connection
+  // to become idle.
+  size_t max_connections_per_endpoint() const {
+    return max_connections_per_endpoint_;
+  }
+  void set_max_connections_per_endpoint(size_t max_connections) {
+    max_connections_per_endpoint_ = max_connections;
+  }
+
+  size_t max_idle_connections_per_endpoint() const {
+    return max_idle_connections_per_endpoint_;
+  }
+  void set_max_idle_connections_per_endpoint(size_t max_idle_connections) {
+    max_idle_connections_per_endpoint_ = max_idle_connections;
+  }
+
+  // an idle connection unused for so many milliseconds is closed instead of
+  // being reused
+  int64_t idle_connection_timeout() const {
+    return idle_connection_timeout_;
+  }
+  void set_idle_connection_timeout(int64_t idle_connection_timeout) {
+    idle_connection_timeout_ = idle_connection_timeout;
+  }
+
+  // The host names in the urls are resolved by so many threads of the
+  // client, taken from the options passed to HttpClient::Launch(). The
+  // addresses are cached for dns_cache_ttl milliseconds, and a failure for
+  // dns_negative_cache_ttl milliseconds.
+  size_t resolver_thread_count() const {
+    return resolver_thread_count_;
+  }
+  void set_resolver_thread_count(size_t resolver_thread_count) {
+    resolver_thread_count_ = resolver_thread_count;
+  }
+
+  int64_t dns_cache_ttl() const {
+    return dns_cache_ttl_;
+  }
+  void set_dns_cache_ttl(int64_t dns_cache_ttl) {
+    dns_cache_ttl_ = dns_cache_ttl;
+  }
+
+  int64_t dns_negative_cache_ttl() const {
+    return dns_negative_cache_ttl_;
+  }
+  void set_dns_negative_cache_ttl(int64_t dns_negative_cache_ttl) {
+    dns_negative_cache_ttl_ = dns_negative_cache_ttl;
+  }
+
  private:
   std::string remote_hostname_;
+  size_t max_connections_per_endpoint_ { 64 };
+  size_t max_idle_connections_per_endpoint_ { 8 };
+  int64_t idle_connection_timeout_ { 60 * 1000 };
+  size_t resolver_thread_count_ { 2 };
+  int64_t dns_cache_ttl_ { 60 * 1000 };
+  int64_t dns_negative_cache_ttl_ { 5 * 1000 };
 };
 
 class HttpServerOptions : public HttpOptions {
@@ -43,6 +43,8 @@ bool HttpServer::Launch(const base::EndPoint& local_address,
   tcp_options.set_worker_count(http_options.worker_count());
   tcp_options.set_send_buffer_size(http_options.send_buffer_size());
   tcp_options.set_receive_buffer_size(http_options.receive_buffer_size());
+  tcp_options.set_mirrored_receive_buffer(
+      http_options.mirrored_receive_buffer());
   SetCallbacks(tcp_options);
   return tcp_server_.Launch(local_address, tcp_options);
 }
@@ -41,6 +41,7 @@ class HttpServer final : public HttpBase {
   virtual ~HttpServer() = default;
 
   // you must first call this method before you do any requests
+  // local_address may be a unix domain socket, see EndPoint::UnixDomain()
   bool Launch(const base::EndPoint& local_address,
               const HttpServerOptions& options = HttpServerOptions());
 
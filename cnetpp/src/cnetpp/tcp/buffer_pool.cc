@@ -0,0 +1,280 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/tcp/buffer_pool.h>
+
+#include <assert.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <vector>
+
+namespace cnetpp {
+namespace tcp {
+
+namespace {
+
+const size_t kNumClasses = 13;  // 1KB ... 4MB
+static_assert((BufferPool::kMinBlockSize << (kNumClasses - 1)) ==
+              BufferPool::kMaxPooledBlockSize, "wrong number of classes");
+
+std::atomic<size_t> cached_bytes_limit { 16 * 1024 * 1024 };
+std::atomic<bool> huge_pages_enabled { false };
+
+size_t ClassOf(size_t block_size) {
+  size_t index = 0;
+  while ((BufferPool::kMinBlockSize << index) < block_size) {
+    ++index;
+  }
+  return index;
+}
+
+char* AllocateBlock(size_t block_size) {
+  if (block_size < BufferPool::kHugePageSize) {
+    return static_cast<char*>(::operator new(block_size));
+  }
+  void* block = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+  if (huge_pages_enabled.load(std::memory_order_relaxed) &&
+      block_size % BufferPool::kHugePageSize == 0) {
+    block = ::mmap(nullptr, block_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif
+  if (block == MAP_FAILED) {
+    block = ::mmap(nullptr, block_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+#if defined(MADV_HUGEPAGE)
+    if (huge_pages_enabled.load(std::memory_order_relaxed)) {
+      ::madvise(block, block_size, MADV_HUGEPAGE);
+    }
+#endif
+  }
+  return static_cast<char*>(block);
+}
+
+void FreeBlock(char* block, size_t block_size) {
+  if (block_size < BufferPool::kHugePageSize) {
+    ::operator delete(block);
+  } else {
+    ::munmap(block, block_size);
+  }
+}
+
+// set when the cache of the thread has been destroyed, the buffers freed by
+// the thread_local or static objects destroyed later bypass it
+thread_local bool thread_cache_destroyed = false;
+
+#if defined(linux) || defined(__linux) || defined(__linux__)
+char* MapMirroredBlock(size_t block_size) {
+  int fd = ::memfd_create("cnetpp_ring_buffer", MFD_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  char* block = nullptr;
+  if (::ftruncate(fd, block_size) == 0) {
+    // reserve the address range first, then map the file into both halves
+    void* base = ::mmap(nullptr, 2 * block_size, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base != MAP_FAILED) {
+      block = static_cast<char*>(base);
+      if (::mmap(block, block_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+          ::mmap(block + block_size, block_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        ::munmap(base, 2 * block_size);
+        block = nullptr;
+      }
+    }
+  }
+  // the mappings keep the memory alive
+  ::close(fd);
+  return block;
+}
+#else
+char* MapMirroredBlock(size_t block_size) {
+  (void) block_size;
+  return nullptr;
+}
+#endif
+
+void UnmapMirroredBlock(char* block, size_t block_size) {
+  ::munmap(block, 2 * block_size);
+}
+
+struct ThreadCache {
+  ~ThreadCache() {
+    Trim();
+    thread_cache_destroyed = true;
+  }
+
+  void Trim() {
+    for (size_t i = 0; i < kNumClasses; ++i) {
+      for (auto block : free_blocks[i]) {
+        FreeBlock(block, BufferPool::kMinBlockSize << i);
+      }
+      free_blocks[i].clear();
+      for (auto block : mirrored_free_blocks[i]) {
+        UnmapMirroredBlock(block, BufferPool::kMinBlockSize << i);
+      }
+      mirrored_free_blocks[i].clear();
+    }
+    cached_bytes = 0;
+  }
+
+  std::vector<char*> free_blocks[kNumClasses];
+  std::vector<char*> mirrored_free_blocks[kNumClasses];
+  size_t cached_bytes { 0 };
+};
+
+ThreadCache* GetThreadCache() {
+  if (thread_cache_destroyed) {
+    return nullptr;
+  }
+  static thread_local ThreadCache cache;
+  return &cache;
+}
+
+}  // namespace
+
+size_t BufferPool::BlockSize(size_t size) {
+  if (size > kMaxPooledBlockSize) {
+    // rounded up to the huge pages, which doesn't waste much at this size
+    return (size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+  }
+  size_t block_size = kMinBlockSize;
+  while (block_size < size) {
+    block_size <<= 1;
+  }
+  return block_size;
+}
+
+char* BufferPool::Allocate(size_t size) {
+  if (size == 0) {
+    return nullptr;
+  }
+  size_t block_size = BlockSize(size);
+  auto cache = GetThreadCache();
+  if (block_size <= kMaxPooledBlockSize && cache) {
+    auto& free_blocks = cache->free_blocks[ClassOf(block_size)];
+    if (!free_blocks.empty()) {
+      char* block = free_blocks.back();
+      free_blocks.pop_back();
+      cache->cached_bytes -= block_size;
+      return block;
+    }
+  }
+  return AllocateBlock(block_size);
+}
+
+void BufferPool::Free(char* block, size_t size) {
+  if (!block) {
+    return;
+  }
+  size_t block_size = BlockSize(size);
+  auto cache = GetThreadCache();
+  if (block_size <= kMaxPooledBlockSize && cache &&
+      cache->cached_bytes + block_size <=
+          cached_bytes_limit.load(std::memory_order_relaxed)) {
+    cache->free_blocks[ClassOf(block_size)].push_back(block);
+    cache->cached_bytes += block_size;
+    return;
+  }
+  FreeBlock(block, block_size);
+}
+
+char* BufferPool::AllocateMirrored(size_t size, size_t* block_size) {
+  assert(block_size);
+  static const size_t page_size = ::sysconf(_SC_PAGESIZE);
+  *block_size = BlockSize(std::max(size, page_size));
+  if (*block_size % page_size != 0) {
+    return nullptr;
+  }
+  auto cache = GetThreadCache();
+  if (*block_size <= kMaxPooledBlockSize && cache) {
+    auto& free_blocks = cache->mirrored_free_blocks[ClassOf(*block_size)];
+    if (!free_blocks.empty()) {
+      char* block = free_blocks.back();
+      free_blocks.pop_back();
+      cache->cached_bytes -= *block_size;
+      return block;
+    }
+  }
+  return MapMirroredBlock(*block_size);
+}
+
+void BufferPool::FreeMirrored(char* block, size_t block_size) {
+  if (!block) {
+    return;
+  }
+  auto cache = GetThreadCache();
+  if (block_size <= kMaxPooledBlockSize && cache &&
+      cache->cached_bytes + block_size <=
+          cached_bytes_limit.load(std::memory_order_relaxed)) {
+    cache->mirrored_free_blocks[ClassOf(block_size)].push_back(block);
+    cache->cached_bytes += block_size;
+    return;
+  }
+  UnmapMirroredBlock(block, block_size);
+}
+
+void BufferPool::Trim() {
+  auto cache = GetThreadCache();
+  if (cache) {
+    cache->Trim();
+  }
+}
+
+size_t BufferPool::CachedBytes() {
+  auto cache = GetThreadCache();
+  return cache ? cache->cached_bytes : 0;
+}
+
+size_t BufferPool::max_cached_bytes_per_thread() {
+  return cached_bytes_limit.load(std::memory_order_relaxed);
+}
+
+void BufferPool::set_max_cached_bytes_per_thread(size_t max_cached_bytes) {
+  cached_bytes_limit.store(max_cached_bytes, std::memory_order_relaxed);
+}
+
+bool BufferPool::use_huge_pages() {
+  return huge_pages_enabled.load(std::memory_order_relaxed);
+}
+
+void BufferPool::set_use_huge_pages(bool use_huge_pages) {
+  huge_pages_enabled.store(use_huge_pages, std::memory_order_relaxed);
+}
+
+}  // namespace tcp
+}  // namespace cnetpp
+
@@ -0,0 +1,85 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_TCP_BUFFER_POOL_H_
+#define CNETPP_TCP_BUFFER_POOL_H_
+
+#include <stddef.h>
+
+namespace cnetpp {
+namespace tcp {
+
+// A size-classed pool of the buffer storage. Every thread caches the freed
+// blocks of each class up to max_cached_bytes_per_thread, so the buffers of
+// the connections served by an event poller thread are recycled by that thread
+// without any lock. The classes are the powers of two from kMinBlockSize to
+// kMaxPooledBlockSize, the larger blocks are not cached.
+// NOTE: a block may be freed by another thread than the one allocating it, it
+// goes to the cache of the freeing thread then.
+class BufferPool {
+ public:
+  static const size_t kMinBlockSize = 1024;
+  static const size_t kMaxPooledBlockSize = 4 * 1024 * 1024;
+  // the blocks at least this large are mapped directly
+  static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+  // the size of the block holding 'size' bytes
+  static size_t BlockSize(size_t size);
+
+  // return a block of at least 'size' bytes, nullptr if size is 0
+  static char* Allocate(size_t size);
+  // 'size' must be the one passed to Allocate()
+  static void Free(char* block, size_t size);
+
+  // return a block of at least 'size' bytes whose pages are mapped twice back
+  // to back, i.e. block[i] and block[i + *block_size] are the same byte, so
+  // any span of at most *block_size bytes starting in the first copy is
+  // contiguous. nullptr if it fails, e.g. out of memfd or of memory mappings
+  // (see vm.max_map_count), every block takes two of them.
+  static char* AllocateMirrored(size_t size, size_t* block_size);
+  static void FreeMirrored(char* block, size_t block_size);
+
+  // release the blocks cached by the calling thread
+  static void Trim();
+
+  // the bytes cached by the calling thread
+  static size_t CachedBytes();
+
+  static size_t max_cached_bytes_per_thread();
+  static void set_max_cached_bytes_per_thread(size_t max_cached_bytes);
+
+  // If true, the blocks of at least kHugePageSize bytes are backed by the
+  // huge pages, falling back to the transparent huge pages if none is
+  // reserved.
+  static bool use_huge_pages();
+  static void set_use_huge_pages(bool use_huge_pages);
+};
+
+}  // namespace tcp
+}  // namespace cnetpp
+
+#endif  // CNETPP_TCP_BUFFER_POOL_H_
+
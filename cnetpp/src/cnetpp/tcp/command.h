@@ -38,7 +38,7 @@ namespace tcp {
 // Caller thread should use command to add or remove a connection,
 // It includes:
 //    the command type,
-//    the tcp connection,
+//    the tcp connection, which is either owned or borrowed
 class Command final {
  public:
   enum class Type {
@@ -50,8 +50,18 @@ class Command final {
     kWriteable = 0x10,
   };
 
+  // the command keeps the connection alive, it's required by the commands
+  // queued for another thread
   Command(int type,
           std::shared_ptr<ConnectionBase> connection)
+      : type_(type),
+        connection_(connection.get()),
+        owner_(std::move(connection)) {
+  }
+  // the command borrows the connection, which saves touching the reference
+  // count. It's only for the commands processed immediately by the event
+  // poller thread, where the connection is kept alive by the event center.
+  Command(int type, ConnectionBase* connection)
       : type_(type),
         connection_(connection) {
   }
@@ -61,13 +71,15 @@ class Command final {
   Command(Command&& c) {
     if (this != &c) {
       type_ = c.type_;
-      connection_ = std::move(c.connection_);
+      connection_ = c.connection_;
+      owner_ = std::move(c.owner_);
     }
   }
   Command& operator=(Command&& c) {
     if (this != &c) {
       type_ = c.type_;
-      connection_ = std::move(c.connection_);
+      connection_ = c.connection_;
+      owner_ = std::move(c.owner_);
     }
     return *this;
   }
@@ -78,12 +90,14 @@ class Command final {
     if (this != &c) {
       type_ = c.type_;
       connection_ = c.connection_;
+      owner_ = c.owner_;
     }
   }
   Command& operator=(const Command& c) {
     if (this != &c) {
       type_ = c.type_;
       connection_ = c.connection_;
+      owner_ = c.owner_;
     }
     return *this;
   }
@@ -92,13 +106,19 @@ class Command final {
     return type_;
   }
 
-  std::shared_ptr<ConnectionBase> connection() const {
+  ConnectionBase* connection() const {
     return connection_;
   }
 
+  // null if the connection is borrowed
+  const std::shared_ptr<ConnectionBase>& owner() const {
+    return owner_;
+  }
+
  private:
   int type_;
-  std::shared_ptr<ConnectionBase> connection_;
+  ConnectionBase* connection_;
+  std::shared_ptr<ConnectionBase> owner_;
 };
 
 }  // namespace tcp
@@ -65,6 +65,27 @@ class ConnectionBase : public std::enable_shared_from_this<ConnectionBase> {
     return id_;
   }
 
+  // the index of the event poller which serves this connection, a negative
+  // value means it hasn't been placed by the event center yet
+  // NOTE: it must be set before the connection is added to the event center
+  int event_poller_id() const {
+    return event_poller_id_;
+  }
+  void set_event_poller_id(int event_poller_id) {
+    event_poller_id_ = event_poller_id;
+  }
+
+  // the generation of the event poller slot holding this connection, it's
+  // registered along with the fd so that the events left by a closed
+  // connection are not delivered to a new one reusing the fd
+  // NOTE: only the event poller thread can access it
+  uint32_t generation() const {
+    return generation_;
+  }
+  void set_generation(uint32_t generation) {
+    generation_ = generation;
+  }
+
   const std::thread::id& ep_thread_id() const {
     return ep_thread_id_;
   }
@@ -82,6 +103,7 @@ class ConnectionBase : public std::enable_shared_from_this<ConnectionBase> {
     connected_callback_ = std::move(connected_callback);
   }
 
+  // the event mask last registered to the event poller
   int cached_event_type() const {
     return cached_event_type_;
   }
@@ -96,26 +118,60 @@ class ConnectionBase : public std::enable_shared_from_this<ConnectionBase> {
     state_ = state;
   }
 
+  // Only meaningful in edge-triggered mode: true after the poller reported
+  // the socket writable and before a send hits EAGAIN.
+  // NOTE: only the event poller thread can access it
+  bool writeable() const {
+    return writeable_;
+  }
+  void set_writeable(bool writeable) {
+    writeable_ = writeable;
+  }
+
+  // true if the event poller should stop polling the socket for reading
+  virtual bool reading_paused() const {
+    return false;
+  }
+
+  // a listen connection is not counted as a connection of its event poller,
+  // see EventCenter::PlacementPolicy::kLeastConnections
+  virtual bool is_listener() const {
+    return false;
+  }
+
   // These three methods will be called by the event poller thread when a
   // socket fd becomes readable or writable
   // NOTE: user should not care about them
   virtual void HandleReadableEvent(EventCenter* event_center) = 0;
   virtual void HandleWriteableEvent(EventCenter* event_center) = 0;
   virtual void HandleCloseConnection() = 0;
+  // called when an error is queued on the socket, return false if the
+  // connection has been closed and the other events should be dropped
+  virtual bool HandleErrorEvent(EventCenter* event_center) {
+    (void) event_center;
+    MarkAsClosed(true);
+    return false;
+  }
   virtual void MarkAsClosed(bool immediately = true) = 0;
 
  protected:
   ConnectionBase(std::shared_ptr<EventCenter> event_center, int fd)
       : event_center_(event_center),
+        event_center_ptr_(event_center.get()),
         id_(ConnectionIdGenerator::Generate()) {
     socket_.Attach(fd);
   }
 
   std::weak_ptr<EventCenter> event_center_;
+  // only for the event poller threads, which the event center outlives
+  EventCenter* event_center_ptr_;
 
   ConnectionId id_;
   base::TcpSocket socket_;
 
+  int event_poller_id_ { -1 };
+  uint32_t generation_ { 0 };
+
   // the event poller thread id
   std::thread::id ep_thread_id_;
 
@@ -124,6 +180,8 @@ class ConnectionBase : public std::enable_shared_from_this<ConnectionBase> {
   int cached_event_type_ { 0 };
 
   State state_ { State::kConnecting };
+
+  bool writeable_ { false };
 };
 
 }  // namespace tcp
@@ -31,6 +31,8 @@
 #include <cnetpp/concurrency/this_thread.h>
 #include <cnetpp/base/log.h>
 
+#include <algorithm>
+
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -51,36 +53,39 @@ bool EpollEventPollerImpl::DoInit() {
 
 bool EpollEventPollerImpl::Poll() {
   // before starting polling, we first process all the pending command events
-  if (!ProcessInterrupt()) {
+  // the interrupter is reset below only if it fired, which saves a read()
+  // call on every loop
+  if (!ProcessPendingCommands()) {
     return false;
   }
+  ProcessTimers();
 
-  int count { 0 };
-  do {
-    count = ::epoll_wait(epoll_fd_,
-                         &epoll_events_[0],
-                         epoll_events_.size(),
-                         -1);
-  } while (count == -1 &&
-      cnetpp::concurrency::ThisThread::GetLastError() == EINTR);
-
+  int timeout = NextTimeout();
+  int count = busy_poll_us_ > 0 ? BusyWait(timeout) : EpollWait(timeout);
   if (count < 0) {
     return false;
   }
 
   for (auto i = 0; i < count; ++i) {
-    auto fd = epoll_events_[i].data.fd;
+    auto fd = static_cast<int>(epoll_events_[i].data.u64 & 0xffffffffu);
     if (fd == interrupter_->get_read_fd()) {
-      // we have some command events to be processed
-      //if (!ProcessInterrupt()) {
-      //  return false;
-      //}
+      // we have some command events to be processed, they will be handled
+      // at the beginning of the next Poll()
+      interrupter_->Reset();
     } else {
-      Event event(fd);
-      if (epoll_events_[i].events & (EPOLLHUP | EPOLLERR)) {
+      Event event(fd,
+                  static_cast<int>(Event::Type::kDummy),
+                  static_cast<uint32_t>(epoll_events_[i].data.u64 >> 32));
+      if (epoll_events_[i].events & EPOLLHUP) {
         event.mutable_mask() |= static_cast<int>(Event::Type::kClose);
       } else {
-        if (epoll_events_[i].events & (EPOLLIN | EPOLLRDBAND | EPOLLRDNORM)) {
+        if (epoll_events_[i].events & EPOLLERR) {
+          event.mutable_mask() |= static_cast<int>(Event::Type::kError);
+        }
+        // a half closed peer is reported as readable, the following recv()
+        // returns 0 and closes the connection
+        if (epoll_events_[i].events &
+            (EPOLLIN | EPOLLRDBAND | EPOLLRDNORM | EPOLLRDHUP)) {
           event.mutable_mask() |= static_cast<int>(Event::Type::kRead);
         }
         if (epoll_events_[i].events & (EPOLLOUT | EPOLLWRNORM | EPOLLWRBAND)) {
@@ -97,11 +102,56 @@ bool EpollEventPollerImpl::Poll() {
   return true;
 }
 
+int EpollEventPollerImpl::EpollWait(int timeout) {
+  int count { 0 };
+  do {
+    count = ::epoll_wait(epoll_fd_,
+                         &epoll_events_[0],
+                         epoll_events_.size(),
+                         timeout);
+  } while (count == -1 &&
+      cnetpp::concurrency::ThisThread::GetLastError() == EINTR);
+  return count;
+}
+
+int EpollEventPollerImpl::BusyWait(int timeout) {
+  if (timeout == 0) {
+    // some timers are due, this wait says nothing about the event rate
+    return EpollWait(0);
+  }
+
+  int64_t start = NowInMicroseconds();
+  int64_t budget = BusyPollBudget();
+  int count { 0 };
+  if (budget > 0) {
+    int64_t deadline = start + budget;
+    if (timeout > 0) {
+      deadline = std::min(deadline, start + timeout * int64_t(1000));
+    }
+    do {
+      count = EpollWait(0);
+    } while (count == 0 && NowInMicroseconds() < deadline);
+    if (count == 0 && timeout > 0) {
+      timeout -= static_cast<int>((NowInMicroseconds() - start) / 1000);
+      timeout = std::max(timeout, 0);
+    }
+  }
+  if (count == 0 && timeout != 0) {
+    count = EpollWait(timeout);
+  }
+  UpdateBusyPoll(NowInMicroseconds() - start);
+  return count;
+}
+
 bool EpollEventPollerImpl::AddPollerEvent(Event&& ev) {
   struct epoll_event epoll_ev {0u, 0};
-  epoll_ev.data.fd = ev.fd();
+  epoll_ev.data.u64 = ToEpollData(ev);
   epoll_ev.events = EPOLLIN;
-  if (ev.mask() & static_cast<int>(Event::Type::kWrite)) {
+  if (edge_triggered_ && ev.fd() != interrupter_->get_read_fd()) {
+    // register both directions once, connections track the readiness and
+    // never call ModifyPollerEvent()
+    epoll_ev.events |= EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  } else if (ev.mask() & static_cast<int>(Event::Type::kWrite)) {
     epoll_ev.events |= EPOLLOUT;
   }
   return ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, ev.fd(), &epoll_ev) == 0;
@@ -109,8 +159,10 @@ bool EpollEventPollerImpl::AddPollerEvent(Event&& ev) {
 
 bool EpollEventPollerImpl::ModifyPollerEvent(Event&& ev) {
   struct epoll_event epoll_ev {0u, 0};
-  epoll_ev.data.fd = ev.fd();
-  epoll_ev.events = EPOLLIN;
+  epoll_ev.data.u64 = ToEpollData(ev);
+  if (ev.mask() & static_cast<int>(Event::Type::kRead)) {
+    epoll_ev.events |= EPOLLIN;
+  }
   if (ev.mask() & static_cast<int>(Event::Type::kWrite)) {
     epoll_ev.events |= EPOLLOUT;
   }
@@ -41,10 +41,13 @@ namespace tcp {
 
 class EpollEventPollerImpl : public EventPoller {
  public:
-  explicit EpollEventPollerImpl(int id, size_t max_connections)
+  EpollEventPollerImpl(int id,
+                       size_t max_connections,
+                       bool edge_triggered = false)
       : EventPoller(id, max_connections),
         epoll_fd_(-1),
         epoll_events_(max_connections) {
+    edge_triggered_ = edge_triggered;
   }
 
   ~EpollEventPollerImpl() = default;
@@ -65,6 +68,19 @@ class EpollEventPollerImpl : public EventPoller {
 
   std::vector<epoll_event> epoll_events_;
 
+  // epoll_wait() restarted on EINTR
+  int EpollWait(int timeout);
+  // spin on a non-blocking epoll_wait() for the busy polling budget before
+  // blocking for at most 'timeout' milliseconds
+  int BusyWait(int timeout);
+
+  // the generation tag is kept in the high 32 bits of epoll_event.data, and
+  // returned with the fd, so dispatching an event needs no lookup
+  static uint64_t ToEpollData(const Event& ev) {
+    return (static_cast<uint64_t>(ev.generation()) << 32) |
+        static_cast<uint32_t>(ev.fd());
+  }
+
   bool AddPollerEvent(Event&& ev) override;
   bool ModifyPollerEvent(Event&& ev) override;
   bool RemovePollerEvent(Event&& ev) override;
@@ -27,6 +27,8 @@
 #ifndef CNETPP_TCP_EVENT_H_
 #define CNETPP_TCP_EVENT_H_
 
+#include <stdint.h>
+
 namespace cnetpp {
 namespace tcp {
 
@@ -39,20 +41,26 @@ class Event {
     kRead = 0x01,
     kWrite = 0x02,
     kClose = 0x04,
+    // an error is queued on the socket while the peer has not hung up, e.g.
+    // a MSG_ZEROCOPY completion, the connection decides whether to close
+    kError = 0x08,
   };
 
   explicit Event(int fd) : fd_(fd), mask_(static_cast<int>(Type::kDummy)) {
   }
-  Event(int fd, int mask) : fd_(fd), mask_(mask) {
+  Event(int fd, int mask, uint32_t generation = 0)
+      : fd_(fd), mask_(mask), generation_(generation) {
   }
 
   Event(Event&& e) {
     fd_ = e.fd_;
     mask_ = e.mask_;
+    generation_ = e.generation_;
   }
   Event& operator=(Event&& e) {
     fd_ = e.fd_;
     mask_ = e.mask_;
+    generation_ = e.generation_;
     return *this;
   }
 
@@ -70,9 +78,16 @@ class Event {
     return mask_;
   }
 
+  // the generation of the connection slot the event belongs to, 0 means the
+  // poller doesn't track it and the event is always delivered
+  uint32_t generation() const {
+    return generation_;
+  }
+
  private:
   int fd_;
   int mask_;
+  uint32_t generation_ { 0 };
 };
 
 }  // namespace tcp
@@ -26,10 +26,13 @@
 //
 #include <cnetpp/tcp/event_center.h>
 #include <cnetpp/tcp/event_poller.h>
+#include <cnetpp/tcp/tcp_options.h>
 #include <cnetpp/concurrency/thread.h>
 #include <cnetpp/concurrency/task.h>
 #include <cnetpp/base/log.h>
 
+#include <algorithm>
+#include <chrono>
 #include <thread>
 
 namespace cnetpp {
@@ -37,6 +40,11 @@ namespace tcp {
 
 namespace {
   const size_t kDefaultThreadNum = 5;
+
+  int64_t NowInMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
 }
 
 std::shared_ptr<EventCenter> EventCenter::New(const std::string& name,
@@ -48,17 +56,58 @@ std::shared_ptr<EventCenter> EventCenter::New(const std::string& name,
     thread_num = kDefaultThreadNum;
   }
 
-  return std::shared_ptr<EventCenter>(new EventCenter(name, thread_num));
+  return std::shared_ptr<EventCenter>(
+      new EventCenter(name, thread_num, TcpOptions()));
+}
+
+std::shared_ptr<EventCenter> EventCenter::New(const std::string& name,
+    const TcpOptions& options) {
+  size_t thread_num = options.worker_count();
+  if (thread_num <= 0) {
+    thread_num = std::thread::hardware_concurrency();
+  }
+  if (thread_num <= 0) {
+    thread_num = kDefaultThreadNum;
+  }
+
+  return std::shared_ptr<EventCenter>(
+      new EventCenter(name, thread_num, options));
 }
 
-EventCenter::EventCenter(const std::string& name, size_t thread_num)
-    : internal_event_poller_infos_(thread_num), name_(name) {
+EventCenter::EventCenter(const std::string& name,
+                         size_t thread_num,
+                         const TcpOptions& options)
+    : internal_event_poller_infos_(thread_num),
+      name_(name),
+      placement_policy_(options.placement_policy()) {
   for (size_t i = 0; i < thread_num; ++i) {
     internal_event_poller_infos_[i] =
         std::make_shared<InternalEventPollerInfo>();
-    internal_event_poller_infos_[i]->event_poller_ = EventPoller::New(i);
+    internal_event_poller_infos_[i]->event_poller_ =
+        EventPoller::New(i,
+                         1024,
+                         options.edge_triggered(),
+                         options.event_poller_type());
     assert((internal_event_poller_infos_[i]->event_poller_).get());
+    internal_event_poller_infos_[i]->event_poller_->set_busy_poll_us(
+        options.busy_poll_us());
+    internal_event_poller_infos_[i]->connections_.resize(1024);
+    auto& cpus = options.worker_cpu_affinity();
+    if (!cpus.empty()) {
+      internal_event_poller_infos_[i]->cpu_affinity_ = {
+        cpus[i % cpus.size()]
+      };
+    }
+    auto& numa_nodes = options.worker_numa_nodes();
+    if (!numa_nodes.empty()) {
+      internal_event_poller_infos_[i]->numa_node_ =
+          numa_nodes[i % numa_nodes.size()];
+    }
   }
+  // the poller implementation may not support edge-triggered mode, or may
+  // support it only
+  edge_triggered_ = thread_num > 0 &&
+      internal_event_poller_infos_[0]->event_poller_->edge_triggered();
 }
 
 bool EventCenter::Launch() {
@@ -74,6 +123,8 @@ bool EventCenter::Launch() {
     // Can not start the thread until put it into vector
     auto t = std::make_shared<concurrency::Thread>(task,
         name_ + "-poller-" + std::to_string(i));
+    t->set_cpu_affinity(internal_event_poller_infos_[i]->cpu_affinity_);
+    t->set_numa_node(internal_event_poller_infos_[i]->numa_node_);
     internal_event_poller_infos_[i]->event_poller_thread_ = t;
     t->Start();
   }
@@ -87,23 +138,103 @@ void EventCenter::Shutdown() {
   internal_event_poller_infos_.clear();
 }
 
-void EventCenter::AddCommand(const Command& command, bool async) {
-  int id = command.connection()->id() % internal_event_poller_infos_.size();
+void EventCenter::PlaceConnection(ConnectionBase* connection) {
+  assert(connection);
+  if (connection->event_poller_id() >= 0) {
+    return;
+  }
 
-  auto& info = internal_event_poller_infos_[id];
-  if (async) {
-    {
-      std::lock_guard<std::mutex> guard(info->pending_commands_mutex_);
-      (info->pending_commands_).push_back(command);
+  size_t n = internal_event_poller_infos_.size();
+  // start from a rotating position, so that ties are broken in turn
+  size_t id = next_event_poller_id_.fetch_add(1, std::memory_order_relaxed) % n;
+  switch (placement_policy_) {
+    case PlacementPolicy::kLeastConnections: {
+      size_t min = internal_event_poller_infos_[id]->num_connections_.load(
+          std::memory_order_relaxed);
+      for (size_t i = 1; i < n && min > 0; ++i) {
+        size_t j = (id + i) % n;
+        size_t num = internal_event_poller_infos_[j]->num_connections_.load(
+            std::memory_order_relaxed);
+        if (num < min) {
+          min = num;
+          id = j;
+        }
+      }
+      break;
+    }
+    case PlacementPolicy::kLeastLoopLag: {
+      int64_t min = internal_event_poller_infos_[id]->loop_lag_.load(
+          std::memory_order_relaxed);
+      for (size_t i = 1; i < n && min > 0; ++i) {
+        size_t j = (id + i) % n;
+        int64_t lag = internal_event_poller_infos_[j]->loop_lag_.load(
+            std::memory_order_relaxed);
+        if (lag < min) {
+          min = lag;
+          id = j;
+        }
+      }
+      break;
     }
+    default:
+      break;
+  }
+  connection->set_event_poller_id(static_cast<int>(id));
+}
 
-    info->event_poller_->Interrupt();
+size_t EventCenter::GetEventPollerId(const ConnectionBase& connection) const {
+  if (connection.event_poller_id() >= 0) {
+    assert(static_cast<size_t>(connection.event_poller_id()) <
+        internal_event_poller_infos_.size());
+    return connection.event_poller_id();
+  }
+  return connection.id() % internal_event_poller_infos_.size();
+}
+
+void EventCenter::AddCommand(Command command, bool async) {
+  if (command.type() & static_cast<int>(Command::Type::kAddConn)) {
+    PlaceConnection(command.connection());
+  }
+  auto& info =
+      internal_event_poller_infos_[GetEventPollerId(*command.connection())];
+  if ((command.type() & static_cast<int>(Command::Type::kAddConn)) &&
+      !command.connection()->is_listener()) {
+    // counted before it's really added, so that a burst of new connections
+    // will not be placed onto the same event poller
+    info->num_connections_.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (async) {
+    // the queued command must keep the connection alive
+    assert(command.owner());
+    (info->pending_commands_).Push(std::move(command));
+
+    // only the first producer after the last drain needs to wake up the
+    // event poller, the others' commands will be drained together
+    if (!info->wakeup_pending_.exchange(true, std::memory_order_acq_rel)) {
+      info->wakeup_time_.store(NowInMicroseconds(), std::memory_order_relaxed);
+      info->event_poller_->Interrupt();
+    }
   } else {
-    assert(command.connection()->ep_thread_id() == std::this_thread::get_id());
+    assert(info->event_poller_thread_->GetId() == std::this_thread::get_id());
     ProcessPendingCommand(info, command);
   }
 }
 
+TimerWheel::TimerId EventCenter::AddTimer(const ConnectionBase& connection,
+                                          int64_t delay_ms,
+                                          TimerWheel::Callback callback) {
+  auto& info = internal_event_poller_infos_[GetEventPollerId(connection)];
+  assert(info->event_poller_thread_->GetId() == std::this_thread::get_id());
+  return info->event_poller_->AddTimer(delay_ms, std::move(callback));
+}
+
+bool EventCenter::CancelTimer(const ConnectionBase& connection,
+                              TimerWheel::TimerId id) {
+  auto& info = internal_event_poller_infos_[GetEventPollerId(connection)];
+  assert(info->event_poller_thread_->GetId() == std::this_thread::get_id());
+  return info->event_poller_->CancelTimer(id);
+}
+
 bool EventCenter::ProcessAllPendingCommands(size_t id) {
   if (id >= internal_event_poller_infos_.size()) {
     return false;
@@ -115,13 +246,22 @@ bool EventCenter::ProcessAllPendingCommands(size_t id) {
     return false;
   }
 
-  std::vector<Command> pending_commands;
-  {
-    std::lock_guard<std::mutex> guard(info->pending_commands_mutex_);
-    pending_commands.swap(info->pending_commands_);
+  // clear the flag before draining, so that a command pushed after this
+  // point either is drained below or interrupts the poller again
+  if (info->wakeup_pending_.exchange(false, std::memory_order_acq_rel)) {
+    int64_t wakeup_time = info->wakeup_time_.load(std::memory_order_relaxed);
+    if (wakeup_time > 0) {
+      int64_t lag = std::max<int64_t>(NowInMicroseconds() - wakeup_time, 0);
+      int64_t avg = info->loop_lag_.load(std::memory_order_relaxed);
+      info->loop_lag_.store(avg + (lag - avg) / 8, std::memory_order_relaxed);
+    }
   }
 
-  for (auto& command : pending_commands) {
+  (info->removed_connections_).clear();
+
+  Command command(static_cast<int>(Command::Type::kDummy),
+                  std::shared_ptr<ConnectionBase>());
+  while ((info->pending_commands_).TryPop(&command)) {
     ProcessPendingCommand(info, command);
   }
   return true;
@@ -129,21 +269,58 @@ bool EventCenter::ProcessAllPendingCommands(size_t id) {
 
 void EventCenter::ProcessPendingCommand(InternalEventPollerInfoPtr info,
     const Command& command) {
+  if (command.type() & static_cast<int>(Command::Type::kAddConn)) {
+    // 0 is reserved for the untagged events
+    if (++info->next_generation_ == 0) {
+      ++info->next_generation_;
+    }
+    command.connection()->set_generation(info->next_generation_);
+  }
   if (info->event_poller_->ProcessCommand(command)) {
     if (command.type() & static_cast<int>(Command::Type::kAddConn)) {
-      info->connections_[command.connection()->socket().fd()] =
-        command.connection();
+      size_t fd = command.connection()->socket().fd();
+      auto& connections = info->connections_;
+      if (fd >= connections.size()) {
+        connections.resize(std::max(fd + 1, connections.size() * 2));
+      }
+      assert(command.owner());
+      connections[fd].connection = command.owner();
+      connections[fd].generation = command.connection()->generation();
       command.connection()->set_ep_thread_id();
       command.connection()->HandleReadableEvent(this);
     } else if (command.type() &
         static_cast<int>(Command::Type::kRemoveConnImmediately)) {
-      (info->connections_).erase(command.connection()->socket().fd());
+      size_t fd = command.connection()->socket().fd();
+      auto& connections = info->connections_;
+      if (fd < connections.size() &&
+          connections[fd].connection.get() == command.connection()) {
+        (info->removed_connections_).push_back(
+            std::move(connections[fd].connection));
+        if (!command.connection()->is_listener()) {
+          info->num_connections_.fetch_sub(1, std::memory_order_relaxed);
+        }
+      }
       command.connection()->HandleCloseConnection();
     } else if (command.type() &
         static_cast<int>(Command::Type::kRemoveConn)) {
       command.connection()->set_state(ConnectionBase::State::kClosing);
       command.connection()->HandleWriteableEvent(this);
+    } else if (edge_triggered_ &&
+        (command.type() & static_cast<int>(Command::Type::kWriteable))) {
+      // no EPOLLOUT edge will arrive if the socket is already writable, so
+      // flush the newly queued data right now
+      if (command.connection()->writeable()) {
+        command.connection()->HandleWriteableEvent(this);
+      }
+    } else if (edge_triggered_ && command.type() ==
+        static_cast<int>(Command::Type::kReadable)) {
+      // the connection stopped reading before EAGAIN to be fair to others,
+      // no new edge will arrive so resume it here
+      command.connection()->HandleReadableEvent(this);
     }
+  } else if ((command.type() & static_cast<int>(Command::Type::kAddConn)) &&
+      !command.connection()->is_listener()) {
+    info->num_connections_.fetch_sub(1, std::memory_order_relaxed);
   }
 }
 
@@ -158,16 +335,27 @@ bool EventCenter::ProcessEvent(const Event& event, size_t id) {
   }
 
   auto& connections = internal_event_poller_infos_[id]->connections_;
-  auto itr = connections.find(event.fd());
-  if (itr != connections.end()) {
-    auto connection = itr->second;
+  if (static_cast<size_t>(fd) >= connections.size()) {
+    return true;
+  }
+  auto& slot = connections[fd];
+  if (slot.connection &&
+      (event.generation() == 0 || event.generation() == slot.generation)) {
+    // a removed connection stays alive till the next loop, so there is no
+    // need to hold a reference here
+    auto connection = slot.connection.get();
     if (event.mask() & static_cast<int>(Event::Type::kClose)) {
       connection->MarkAsClosed(true);
     } else {
+      if ((event.mask() & static_cast<int>(Event::Type::kError)) &&
+          !connection->HandleErrorEvent(this)) {
+        return true;
+      }
       if (event.mask() & static_cast<int>(Event::Type::kRead)) {
         connection->HandleReadableEvent(this);
       }
       if (event.mask() & static_cast<int>(Event::Type::kWrite)) {
+        connection->set_writeable(true);
         connection->HandleWriteableEvent(this);
       }
     }
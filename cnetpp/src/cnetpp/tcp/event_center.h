@@ -30,20 +30,30 @@
 #include <cnetpp/tcp/command.h>
 #include <cnetpp/tcp/connection_base.h>
 #include <cnetpp/tcp/event.h>
+#include <cnetpp/tcp/event_poller.h>
+#include <cnetpp/concurrency/mpsc_queue.h>
 #include <cnetpp/concurrency/thread.h>
 
+#include <atomic>
 #include <memory>
 #include <vector>
-#include <unordered_map>
-#include <mutex>
 
 namespace cnetpp {
 namespace tcp {
 
-class EventPoller;
+class TcpOptions;
 
 class EventCenter final : public std::enable_shared_from_this<EventCenter> {
  public:
+  // how new connections are distributed among the event pollers
+  enum class PlacementPolicy {
+    kRoundRobin = 0x0,
+    // the event poller serving the fewest connections
+    kLeastConnections = 0x1,
+    // the event poller which picked up its last wakeup most quickly
+    kLeastLoopLag = 0x2,
+  };
+
   // Create an EventCenter instance
   // NOTE: This class is not singleton, so we can create more than one
   // EventCenter instances in one process. e.g. We can create two servers to
@@ -52,6 +62,11 @@ class EventCenter final : public std::enable_shared_from_this<EventCenter> {
   // it will use the number of logical processers.
   static std::shared_ptr<EventCenter> New(const std::string& name,
       size_t thread_num = 0);
+  // Create an EventCenter instance configured by the poller related fields of
+  // 'options', e.g. worker_count, edge_triggered, placement_policy,
+  // event_poller_type and busy_poll_us.
+  static std::shared_ptr<EventCenter> New(const std::string& name,
+      const TcpOptions& options);
 
   ~EventCenter() = default;
 
@@ -59,14 +74,45 @@ class EventCenter final : public std::enable_shared_from_this<EventCenter> {
 
   void Shutdown();
 
-  void AddCommand(const Command& command, bool async = true);
+  // If async is true, the command is queued for the connection's event poller
+  // thread, which will be woken up only if it has not been signaled since
+  // it drained the queue last time. Otherwise the command is processed
+  // immediately, so the caller must be the event poller thread.
+  void AddCommand(Command command, bool async = true);
+
+  // Choose an event poller for a new connection by the placement policy,
+  // unless it has been pinned to one already. It must be called before the
+  // connection is visible to other threads, AddCommand() calls it for kAddConn
+  // commands if the caller hasn't.
+  void PlaceConnection(ConnectionBase* connection);
+
+  // Add a timer onto the event poller serving the connection, it fires on
+  // that event poller thread after delay_ms milliseconds.
+  // NOTE: it must be called within that event poller thread
+  TimerWheel::TimerId AddTimer(const ConnectionBase& connection,
+                               int64_t delay_ms,
+                               TimerWheel::Callback callback);
+  bool CancelTimer(const ConnectionBase& connection, TimerWheel::TimerId id);
 
   bool ProcessAllPendingCommands(size_t id);
 
   bool ProcessEvent(const Event& event, size_t id);
 
+  // true if the event pollers work in edge-triggered mode, in which case the
+  // connections must drain the socket until EAGAIN and never re-arm interest
+  bool edge_triggered() const {
+    return edge_triggered_;
+  }
+
+  // the number of event pollers (and their threads)
+  size_t thread_num() const {
+    return internal_event_poller_infos_.size();
+  }
+
  private:
-  EventCenter(const std::string& name, size_t thread_num = 0);
+  EventCenter(const std::string& name,
+              size_t thread_num,
+              const TcpOptions& options);
 
   class InternalEventTask final : public concurrency::Task {
    public:
@@ -86,19 +132,42 @@ class EventCenter final : public std::enable_shared_from_this<EventCenter> {
   // just for short typing
   using ConnectionPtr = std::shared_ptr<ConnectionBase>;
 
+  struct ConnectionSlot {
+    ConnectionPtr connection;
+    // bumped every time the slot is filled, see ConnectionBase::generation()
+    uint32_t generation { 0 };
+  };
+
   struct InternalEventPollerInfo {
     std::shared_ptr<concurrency::Thread> event_poller_thread_;
+    // where the event poller thread is placed, see TcpOptions
+    std::vector<int> cpu_affinity_;
+    int numa_node_ { -1 };
 
     std::shared_ptr<EventPoller> event_poller_;
 
-    std::vector<Command> pending_commands_;
-    std::mutex pending_commands_mutex_;
-
-    // all of closures
+    // commands from all threads, only drained by the event poller thread
+    concurrency::MpscQueue<Command> pending_commands_;
+    // true if the event poller has been interrupted and has not drained the
+    // pending commands yet, so that other producers can skip the interrupt
+    std::atomic<bool> wakeup_pending_ { false };
+    // when wakeup_pending_ was set, in microseconds of the steady clock
+    std::atomic<int64_t> wakeup_time_ { 0 };
+    // the moving average of the time from an interrupt to the drain of the
+    // pending commands, in microseconds, written by the event poller thread
+    std::atomic<int64_t> loop_lag_ { 0 };
+    // the connections placed on this event poller and not removed yet
+    std::atomic<size_t> num_connections_ { 0 };
+
+    // all of closures, indexed by fd
     // When some event arrives, the EventPoller will call the EventCallback.
     // No need to be protected by lock, because only the corresponding
     // EventPoller thread can access this structure
-    std::unordered_map<int, ConnectionPtr> connections_;
+    std::vector<ConnectionSlot> connections_;
+    // the connections removed while dispatching, they are kept alive until
+    // the next loop because their handlers may be still on the stack
+    std::vector<ConnectionPtr> removed_connections_;
+    uint32_t next_generation_ { 0 };
   };
 
   using InternalEventPollerInfoPtr = std::shared_ptr<InternalEventPollerInfo>;
@@ -107,6 +176,13 @@ class EventCenter final : public std::enable_shared_from_this<EventCenter> {
 
   std::string name_;
 
+  bool edge_triggered_ { false };
+
+  PlacementPolicy placement_policy_ { PlacementPolicy::kRoundRobin };
+  std::atomic<size_t> next_event_poller_id_ { 0 };
+
+  size_t GetEventPollerId(const ConnectionBase& connection) const;
+
   void ProcessPendingCommand(InternalEventPollerInfoPtr info,
       const Command& command);
 
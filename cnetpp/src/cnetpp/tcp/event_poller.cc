@@ -28,26 +28,62 @@
 #include <cnetpp/tcp/event_center.h>
 #include <cnetpp/tcp/interrupter.h>
 
+#include <cnetpp/tcp/select_event_poller_impl.h>
+#include <cnetpp/base/log.h>
+
 #if defined(linux) || defined(__linux) || defined(__linux__)
 #include <cnetpp/tcp/epoll_event_poller_impl.h>
+#include <cnetpp/tcp/io_uring_event_poller_impl.h>
+#include <cnetpp/tcp/poll_event_poller_impl.h>
 #elif defined(macintosh) || defined(__APPLE__) || defined(__APPLE_CC__)
 #include <cnetpp/tcp/poll_event_poller_impl.h>
-#else
-#include <cnetpp/tcp/select_event_poller_impl.h>
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
 namespace cnetpp {
 namespace tcp {
 
 std::shared_ptr<EventPoller> EventPoller::New(size_t id,
-                                              size_t max_connections) {
+                                              size_t max_connections,
+                                              bool edge_triggered,
+                                              Type type) {
+  switch (type) {
+    case Type::kIoUring:
+#if defined(CNETPP_HAVE_IO_URING)
+      if (IoUringEventPollerImpl::IsSupported()) {
+        return std::shared_ptr<EventPoller>(
+            new IoUringEventPollerImpl(id, max_connections));
+      }
+#endif
+      Info("io_uring is not supported, use the default event poller instead.");
+      break;
+    case Type::kPoll:
+#if defined(linux) || defined(__linux) || defined(__linux__) || \
+  defined(macintosh) || defined(__APPLE__) || defined(__APPLE_CC__)
+      return std::shared_ptr<EventPoller>(
+          new PollEventPollerImpl(id, max_connections));
+#else
+      break;
+#endif
+    case Type::kSelect:
+      return std::shared_ptr<EventPoller>(
+          new SelectEventPollerImpl(id, max_connections));
+    default:
+      break;
+  }
+
 #if defined(linux) || defined(__linux) || defined(__linux__)
   return std::shared_ptr<EventPoller>(
-      new EpollEventPollerImpl(id, max_connections));
+      new EpollEventPollerImpl(id, max_connections, edge_triggered));
 #elif defined(macintosh) || defined(__APPLE__) || defined(__APPLE_CC__)
+  (void) edge_triggered;
   return std::shared_ptr<EventPoller>(
       new PollEventPollerImpl(id, max_connections));
 #else
+  (void) edge_triggered;
   return std::shared_ptr<EventPoller>(
       new SelectEventPollerImpl(id, max_connections));
 #endif
@@ -84,25 +120,77 @@ bool EventPoller::ProcessCommand(const Command& command) {
     type |= static_cast<int>(Event::Type::kWrite);
   }
   if (command.type() & static_cast<int>(Command::Type::kAddConn)) {
-    return AddPollerEvent(Event(command.connection()->socket().fd(), type));
+    command.connection()->set_cached_event_type(type);
+    return AddPollerEvent(Event(command.connection()->socket().fd(),
+                                type,
+                                command.connection()->generation()));
   } else if (command.type() & static_cast<int>(Command::Type::kRemoveConnImmediately)) {
     type |= static_cast<int>(Event::Type::kClose);
     return RemovePollerEvent(Event(command.connection()->socket().fd(), type));
   } else if (command.type() & static_cast<int>(Command::Type::kReadable) ||
       command.type() & static_cast<int>(Command::Type::kWriteable)) {
-    if (command.type() == command.connection()->cached_event_type()) {
+    if (edge_triggered_) {
+      // the socket has been registered for both directions already
+      return true;
+    }
+    if (command.connection()->reading_paused()) {
+      // the connection has too much output queued, see TcpConnection
+      type &= ~static_cast<int>(Event::Type::kRead);
+    }
+    if (type == command.connection()->cached_event_type()) {
       return true;
     }
-    command.connection()->set_cached_event_type(command.type());
-    return ModifyPollerEvent(Event(command.connection()->socket().fd(), type));
+    command.connection()->set_cached_event_type(type);
+    return ModifyPollerEvent(Event(command.connection()->socket().fd(),
+                                   type,
+                                   command.connection()->generation()));
   } else if (command.type() & static_cast<int>(Command::Type::kRemoveConn)) {
     return true;
   }
   return false;
 }
 
+int64_t EventPoller::Now() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int EventPoller::NextTimeout() const {
+  int64_t timeout = timer_wheel_.NextTimeout(Now());
+  if (timeout > std::numeric_limits<int>::max()) {
+    timeout = std::numeric_limits<int>::max();
+  }
+  return static_cast<int>(timeout);
+}
+
+int64_t EventPoller::NowInMicroseconds() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t EventPoller::BusyPollBudget() const {
+  if (busy_poll_us_ <= 0 || average_wait_us_ > busy_poll_us_) {
+    return 0;
+  }
+  // spin somewhat longer than the average wait so that most events are
+  // picked up without sleeping, but never for a negligible time
+  return std::min(busy_poll_us_,
+                  std::max(average_wait_us_ * 2, busy_poll_us_ / 4));
+}
+
+void EventPoller::UpdateBusyPoll(int64_t wait_us) {
+  // clamp the long idle periods, so that the average drops back below the
+  // budget after a few short waits once the traffic resumes
+  wait_us = std::min(wait_us, busy_poll_us_ * 4);
+  average_wait_us_ += (wait_us - average_wait_us_) / 8;
+}
+
 bool EventPoller::ProcessInterrupt() {
   interrupter_->Reset();
+  return ProcessPendingCommands();
+}
+
+bool EventPoller::ProcessPendingCommands() {
   auto event_center = event_center_.lock();
   if (event_center) {
     return event_center->ProcessAllPendingCommands(id_);
@@ -29,6 +29,7 @@
 
 #include <cnetpp/tcp/event.h>
 #include <cnetpp/tcp/interrupter.h>
+#include <cnetpp/tcp/timer_wheel.h>
 
 #include <memory>
 
@@ -45,6 +46,18 @@ class EventCenter;
  */
 class EventPoller {
  public:
+  // the implementations of EventPoller
+  enum class Type {
+    // epoll on linux, poll on mac os and select on the others
+    kDefault = 0x0,
+    kEpoll = 0x1,
+    // falls back to kDefault if the kernel doesn't support it, always works
+    // in edge-triggered mode
+    kIoUring = 0x2,
+    kPoll = 0x3,
+    kSelect = 0x4,
+  };
+
   virtual ~EventPoller() {
   }
 
@@ -53,10 +66,16 @@ class EventPoller {
    * @param id              the identifier of the EventPoller
    * @param max_connections the maximum numbers of connections this event poller
    *                        supports
+   * @param edge_triggered  register sockets in edge-triggered mode if the
+   *                        implementation supports it
+   * @param type            the implementation, kDefault is used instead if
+   *                        it's not available on this platform
    * @return the EventPoller instance
    */
   static std::shared_ptr<EventPoller> New(size_t id,
-                                          size_t max_connections = 1024);
+                                          size_t max_connections = 1024,
+                                          bool edge_triggered = false,
+                                          Type type = Type::kDefault);
   
   /**
    * Initialize the EventPoller.
@@ -110,6 +129,25 @@ class EventPoller {
     return id_;
   }
 
+  /**
+   * @return true if sockets are registered once for both directions in
+   * edge-triggered mode, so kReadable/kWriteable commands never touch the
+   * underlying poller
+   */
+  bool edge_triggered() const {
+    return edge_triggered_;
+  }
+
+  /**
+   * Enable the adaptive busy polling, see TcpOptions::busy_poll_us().
+   * Only the epoll event poller supports it, the others ignore it.
+   * @param busy_poll_us the maximum microseconds to spin, 0 disables it
+   */
+  void set_busy_poll_us(int64_t busy_poll_us) {
+    busy_poll_us_ = busy_poll_us > 0 ? busy_poll_us : 0;
+    average_wait_us_ = busy_poll_us_ / 2;
+  }
+
   /**
    * Process Command from user thread or Connection callbacks.
    * @param command Command
@@ -118,12 +156,49 @@ class EventPoller {
    */
   virtual bool ProcessCommand(const Command& command);
 
+  /**
+   * Add a timer which fires on the event poller thread after delay_ms
+   * milliseconds.
+   * @return the id used to cancel the timer
+   * @note this function must be called within the event poller thread
+   */
+  TimerWheel::TimerId AddTimer(int64_t delay_ms,
+                               TimerWheel::Callback callback) {
+    return timer_wheel_.Add(Now() + delay_ms, std::move(callback));
+  }
+  /**
+   * @return false if the timer has fired or been cancelled
+   * @note this function must be called within the event poller thread
+   */
+  bool CancelTimer(TimerWheel::TimerId id) {
+    return timer_wheel_.Cancel(id);
+  }
+
  protected:
   EventPoller(int id, size_t max_connections)
       : id_(id),
-        max_connections_(max_connections) {
+        max_connections_(max_connections),
+        timer_wheel_(Now()) {
   }
 
+  // the monotonic time in milliseconds the timers are counted in
+  static int64_t Now();
+
+  // run the expired timers, called by Poll() before waiting
+  void ProcessTimers() {
+    timer_wheel_.Advance(Now());
+  }
+  // the timeout in milliseconds for the next wait, -1 means infinite
+  int NextTimeout() const;
+
+  static int64_t NowInMicroseconds();
+
+  // the microseconds to spin before blocking, 0 if the events arrive so
+  // rarely that spinning would only burn the cpu
+  int64_t BusyPollBudget() const;
+  // feed the microseconds the last wait took until it returned
+  void UpdateBusyPoll(int64_t wait_us);
+
   // child classes should implement this method if it want to do some extra
   // intializations.
   virtual bool DoInit() {
@@ -134,7 +209,11 @@ class EventPoller {
   virtual void DoShutdown() {
   }
 
+  // reset the interrupter and process all pending commands
   virtual bool ProcessInterrupt();
+  // process all pending commands without resetting the interrupter, used by
+  // implementations which reset the interrupter only when it really fired
+  bool ProcessPendingCommands();
 
   virtual bool AddPollerEvent(Event&& event) = 0;
   virtual bool ModifyPollerEvent(Event&& event) = 0;
@@ -142,8 +221,16 @@ class EventPoller {
 
   int id_ { 0 }; // the id
   size_t max_connections_ { 1024 };
+  bool edge_triggered_ { false };
   std::weak_ptr<EventCenter> event_center_;
 
+  TimerWheel timer_wheel_;
+
+  // the maximum busy polling budget in microseconds, 0 means disabled
+  int64_t busy_poll_us_ { 0 };
+  // the moving average of the time waited for an event, in microseconds
+  int64_t average_wait_us_ { 0 };
+
   // used for interrupting the select run loop.
   // We first add the pipe_read_fd_ to the select read fdset. When one thread wants
   // to interrupt the poll thread, we can write a byte to pipe_write_fd_ of the
@@ -0,0 +1,188 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/tcp/io_buf.h>
+#include <cnetpp/tcp/buffer_pool.h>
+
+#include <assert.h>
+#include <string.h>
+
+namespace cnetpp {
+namespace tcp {
+
+IOBuf::IOBuf(std::string&& data) {
+  if (data.empty()) {
+    return;
+  }
+  // the string doesn't move any more once it's owned by the shared_ptr, so
+  // its buffer stays valid even if it's a short one stored inline
+  auto holder = std::make_shared<std::string>(std::move(data));
+  size_ = holder->size();
+  first_ = Slice { holder, holder->data(), holder->size() };
+}
+
+IOBuf::IOBuf(std::shared_ptr<const void> holder,
+             const char* data,
+             size_t length) {
+  if (length == 0) {
+    return;
+  }
+  assert(data);
+  size_ = length;
+  first_ = Slice { std::move(holder), data, length };
+}
+
+IOBuf::IOBuf(std::shared_ptr<const std::string> data) {
+  if (!data || data->empty()) {
+    return;
+  }
+  size_ = data->size();
+  const char* bytes = data->data();
+  first_ = Slice { std::move(data), bytes, size_ };
+}
+
+IOBuf IOBuf::Copy(base::StringPiece data) {
+  size_t length = data.size();
+  if (length < BufferPool::kMinBlockSize / 2) {
+    return IOBuf(data.as_string());
+  }
+  // the larger ones are recycled by the BufferPool, wasting at most half
+  char* block = BufferPool::Allocate(length);
+  ::memcpy(block, data.data(), length);
+  std::shared_ptr<const void> holder(block, [length] (const void* p) {
+    BufferPool::Free(static_cast<char*>(const_cast<void*>(p)), length);
+  });
+  return IOBuf(std::move(holder), block, length);
+}
+
+void IOBuf::Append(IOBuf&& that) {
+  assert(&that != this);
+  if (size_ == 0) {
+    *this = std::move(that);
+    return;
+  }
+  if (that.size_ == 0) {
+    return;
+  }
+  size_t size = size_ + that.size_;
+  PushBack(std::move(that.first_));
+  for (size_t i = that.head_; i < that.more_.size(); ++i) {
+    PushBack(std::move(that.more_[i]));
+  }
+  size_ = size;
+  that.Clear();
+}
+
+void IOBuf::Append(const IOBuf& that) {
+  assert(&that != this);
+  if (that.size_ == 0) {
+    return;
+  }
+  size_t size = size_ + that.size_;
+  PushBack(that.first_);
+  for (size_t i = that.head_; i < that.more_.size(); ++i) {
+    PushBack(that.more_[i]);
+  }
+  size_ = size;
+}
+
+size_t IOBuf::GetReadPositions(struct iovec* read_positions, size_t n) const {
+  assert(read_positions || n == 0);
+  if (size_ == 0 || n == 0) {
+    return 0;
+  }
+  read_positions[0].iov_base = const_cast<char*>(first_.data);
+  read_positions[0].iov_len = first_.length;
+  size_t count = 1;
+  for (size_t i = head_; i < more_.size() && count < n; ++i, ++count) {
+    read_positions[count].iov_base = const_cast<char*>(more_[i].data);
+    read_positions[count].iov_len = more_[i].length;
+  }
+  return count;
+}
+
+void IOBuf::CommitRead(size_t n) {
+  assert(n <= size_);
+  size_ -= n;
+  while (n > 0) {
+    if (n < first_.length) {
+      first_.data += n;
+      first_.length -= n;
+      break;
+    }
+    n -= first_.length;
+    PopFront();
+  }
+}
+
+void IOBuf::AppendToString(std::string* result) const {
+  assert(result);
+  result->reserve(result->size() + size_);
+  if (size_ == 0) {
+    return;
+  }
+  result->append(first_.data, first_.length);
+  for (size_t i = head_; i < more_.size(); ++i) {
+    result->append(more_[i].data, more_[i].length);
+  }
+}
+
+std::string IOBuf::ToString() const {
+  std::string result;
+  AppendToString(&result);
+  return result;
+}
+
+void IOBuf::PushBack(Slice slice) {
+  if (first_.length == 0) {
+    first_ = std::move(slice);
+  } else {
+    more_.emplace_back(std::move(slice));
+  }
+}
+
+void IOBuf::PopFront() {
+  if (head_ == more_.size()) {
+    first_ = Slice();
+    return;
+  }
+  first_ = std::move(more_[head_++]);
+  if (head_ == more_.size()) {
+    // keeps the capacity for the next slices
+    more_.clear();
+    head_ = 0;
+  }
+}
+
+void IOBuf::Clear() {
+  first_ = Slice();
+  more_.clear();
+  head_ = 0;
+  size_ = 0;
+}
+
+}  // namespace tcp
+}  // namespace cnetpp
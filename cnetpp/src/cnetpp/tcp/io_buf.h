@@ -0,0 +1,132 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_TCP_IO_BUF_H_
+#define CNETPP_TCP_IO_BUF_H_
+
+#include <cnetpp/base/string_piece.h>
+
+#include <sys/uio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cnetpp {
+namespace tcp {
+
+// A chain of refcounted immutable slices, used to send data without copying
+// it. Appending, copying or sharing an IOBuf never copies the bytes, only
+// IOBuf::Copy() does. Most packets are one or two slices, so the first slice
+// is kept inline and only the others go to a vector.
+// NOTE: the bytes must not be modified while any IOBuf refers to them, and an
+// IOBuf itself is not thread safe.
+class IOBuf {
+ public:
+  IOBuf() = default;
+  // adopt the string without copying it
+  explicit IOBuf(std::string&& data);
+  // share 'length' bytes at 'data', which are kept alive by 'holder'
+  IOBuf(std::shared_ptr<const void> holder, const char* data, size_t length);
+  // share the whole string
+  explicit IOBuf(std::shared_ptr<const std::string> data);
+
+  IOBuf(const IOBuf&) = default;
+  IOBuf& operator=(const IOBuf&) = default;
+  // the moved-from IOBuf is empty
+  IOBuf(IOBuf&& that) noexcept
+      : first_(std::move(that.first_)),
+        more_(std::move(that.more_)),
+        head_(that.head_),
+        size_(that.size_) {
+    that.Clear();
+  }
+  IOBuf& operator=(IOBuf&& that) noexcept {
+    if (this != &that) {
+      first_ = std::move(that.first_);
+      more_ = std::move(that.more_);
+      head_ = that.head_;
+      size_ = that.size_;
+      that.Clear();
+    }
+    return *this;
+  }
+
+  // a copy of 'data', it's the only way to copy the bytes
+  static IOBuf Copy(base::StringPiece data);
+
+  size_t Size() const {
+    return size_;
+  }
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  // the number of slices in the chain
+  size_t NumSlices() const {
+    return size_ == 0 ? 0 : 1 + more_.size() - head_;
+  }
+
+  // append the slices of 'that' to the end of the chain
+  void Append(IOBuf&& that);
+  void Append(const IOBuf& that);
+
+  // fill at most 'n' iovecs with the unread slices from the front, and return
+  // the number of iovecs filled.
+  // NOTE: if you indeed read some data, you must call CommitRead()
+  size_t GetReadPositions(struct iovec* read_positions, size_t n) const;
+  // drop the first n bytes, releasing the slices completely read
+  void CommitRead(size_t n);
+
+  void AppendToString(std::string* result) const;
+  std::string ToString() const;
+
+ private:
+  struct Slice {
+    std::shared_ptr<const void> holder;
+    const char* data { nullptr };
+    size_t length { 0 };
+  };
+
+  // The unread slices are first_ and then more_[head_:], first_ is empty
+  // only if the IOBuf is. The slices read from more_ are dropped once all
+  // of them are, so that reading from the front is O(1).
+  Slice first_;
+  std::vector<Slice> more_;
+  size_t head_ { 0 };
+  size_t size_ { 0 };
+
+  void PushBack(Slice slice);
+  // drop first_, the next slice takes its place
+  void PopFront();
+  void Clear();
+};
+
+}  // namespace tcp
+}  // namespace cnetpp
+
+#endif  // CNETPP_TCP_IO_BUF_H_
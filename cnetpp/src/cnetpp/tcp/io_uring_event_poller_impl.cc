@@ -0,0 +1,408 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#if defined(linux) || defined(__linux) || defined(__linux__)
+#include <cnetpp/tcp/io_uring_event_poller_impl.h>
+
+#if defined(CNETPP_HAVE_IO_URING)
+#include <cnetpp/tcp/event.h>
+#include <cnetpp/tcp/event_center.h>
+#include <cnetpp/concurrency/this_thread.h>
+#include <cnetpp/base/log.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace cnetpp {
+namespace tcp {
+
+namespace {
+
+// the user_data of the requests whose completions are not interesting, e.g.
+// the poll removals, it never equals a registered fd which is non-negative
+const uint64_t kIgnoredUserData = ~static_cast<uint64_t>(0);
+const uint64_t kNoPollRequest = kIgnoredUserData;
+
+const unsigned kMaxRingEntries = 4096;
+
+int IoUringSetup(unsigned entries, struct io_uring_params* params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int IoUringEnter(int fd,
+                 unsigned to_submit,
+                 unsigned min_complete,
+                 unsigned flags,
+                 const void* arg = nullptr,
+                 size_t arg_size = 0) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter,
+                                    fd,
+                                    to_submit,
+                                    min_complete,
+                                    flags,
+                                    arg,
+                                    arg_size));
+}
+
+// the same as epoll_event.data, see EpollEventPollerImpl::ToEpollData()
+uint64_t ToUserData(const Event& ev) {
+  return (static_cast<uint64_t>(ev.generation()) << 32) |
+      static_cast<uint32_t>(ev.fd());
+}
+
+}  // namespace
+
+bool IoUringEventPollerImpl::IsSupported() {
+  static const bool supported = [] () -> bool {
+    // arm a multishot poll request on an eventfd and signal it, old kernels
+    // either reject the request or finish it after the first completion
+    IoUringEventPollerImpl poller(0, 4);
+    if (!poller.SetupRing(4)) {
+      return false;
+    }
+    int fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd < 0) {
+      return false;
+    }
+    bool result = false;
+    if (poller.ArmPoll(fd, static_cast<uint64_t>(fd)) &&
+        ::eventfd_write(fd, 1) == 0 &&
+        poller.Submit(1)) {
+      unsigned head = *poller.cq_head_;
+      unsigned tail = __atomic_load_n(poller.cq_tail_, __ATOMIC_ACQUIRE);
+      if (head != tail) {
+        auto& cqe = poller.cqes_[head & poller.cq_mask_];
+        result = cqe.res > 0 && (cqe.flags & IORING_CQE_F_MORE);
+      }
+    }
+    ::close(fd);
+    return result;
+  }();
+  return supported;
+}
+
+bool IoUringEventPollerImpl::DoInit() {
+  unsigned entries = static_cast<unsigned>(
+      std::min<size_t>(std::max<size_t>(max_connections_, 4), kMaxRingEntries));
+  return SetupRing(entries);
+}
+
+bool IoUringEventPollerImpl::SetupRing(unsigned entries) {
+  struct io_uring_params params;
+  ::memset(&params, 0, sizeof(params));
+  // every connection may have a completion in flight in addition to the
+  // submissions of one loop
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  params.cq_entries = entries * 4;
+  ring_fd_ = IoUringSetup(entries, &params);
+  if (ring_fd_ < 0) {
+    Error("io_uring_setup() failed. erro message: %s",
+        concurrency::ThisThread::GetErrorString(
+          concurrency::ThisThread::GetLastError()).c_str());
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    TeardownRing();
+    return false;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      TeardownRing();
+      return false;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    TeardownRing();
+    return false;
+  }
+  sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+  char* sq = static_cast<char*>(sq_ring_);
+  sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sq_entries_ = params.sq_entries;
+  char* cq = static_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+  cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+
+  sq_local_tail_ = *sq_tail_;
+  to_submit_ = 0;
+  return true;
+}
+
+void IoUringEventPollerImpl::TeardownRing() {
+  if (sqes_) {
+    ::munmap(sqes_, sqes_size_);
+    sqes_ = nullptr;
+  }
+  if (cq_ring_ && cq_ring_ != sq_ring_) {
+    ::munmap(cq_ring_, cq_ring_size_);
+  }
+  cq_ring_ = nullptr;
+  if (sq_ring_) {
+    ::munmap(sq_ring_, sq_ring_size_);
+    sq_ring_ = nullptr;
+  }
+  if (ring_fd_ >= 0) {
+    ::close(ring_fd_);
+    ring_fd_ = -1;
+  }
+}
+
+struct io_uring_sqe* IoUringEventPollerImpl::GetSqe() {
+  if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >=
+      sq_entries_) {
+    // the kernel consumes the submissions synchronously, so the ring is
+    // available again after this
+    if (!Submit(0)) {
+      return nullptr;
+    }
+  }
+  unsigned index = sq_local_tail_ & sq_mask_;
+  struct io_uring_sqe* sqe = &sqes_[index];
+  ::memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  ++sq_local_tail_;
+  ++to_submit_;
+  return sqe;
+}
+
+bool IoUringEventPollerImpl::Submit(unsigned min_complete, int timeout) {
+  __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+  unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+  // the timeout is passed along with the wait, supported since 5.11, which
+  // is older than the multishot poll requests
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  if (min_complete > 0 && timeout >= 0) {
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000LL;
+    ::memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+  while (true) {
+    int ret = (flags & IORING_ENTER_EXT_ARG) ?
+        IoUringEnter(ring_fd_, to_submit_, min_complete, flags,
+                     &arg, sizeof(arg)) :
+        IoUringEnter(ring_fd_, to_submit_, min_complete, flags);
+    if (ret >= 0) {
+      to_submit_ -= std::min(static_cast<unsigned>(ret), to_submit_);
+      return true;
+    }
+    int error = concurrency::ThisThread::GetLastError();
+    if (error == EINTR) {
+      continue;
+    }
+    if (error == ETIME) {
+      // the sqes have been submitted, and no completion arrived in time
+      to_submit_ = 0;
+      return true;
+    }
+    if (error == EBUSY || error == EAGAIN) {
+      // the completion queue is overflowed, reap the completions first
+      return true;
+    }
+    Error("io_uring_enter() failed. erro message: %s",
+        concurrency::ThisThread::GetErrorString(error).c_str());
+    return false;
+  }
+}
+
+bool IoUringEventPollerImpl::ArmPoll(int fd, uint64_t user_data) {
+  struct io_uring_sqe* sqe = GetSqe();
+  if (!sqe) {
+    return false;
+  }
+  uint32_t events = POLLIN;
+  if (!interrupter_ || fd != interrupter_->get_read_fd()) {
+    events |= POLLOUT | POLLRDHUP;
+  }
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  events = (events << 16) | (events >> 16);
+#endif
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = events;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = user_data;
+  return true;
+}
+
+bool IoUringEventPollerImpl::Poll() {
+  // before starting polling, we first process all the pending command events
+  // the registrations queued by them are submitted along with the wait below
+  if (!ProcessPendingCommands()) {
+    return false;
+  }
+  ProcessTimers();
+
+  if (!Submit(1, NextTimeout())) {
+    return false;
+  }
+
+  completions_.clear();
+  unsigned head = *cq_head_;
+  unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    completions_.push_back(cqes_[head & cq_mask_]);
+  }
+  __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+
+  for (auto& cqe : completions_) {
+    if (cqe.user_data == kIgnoredUserData) {
+      continue;
+    }
+    auto fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+    if (!(cqe.flags & IORING_CQE_F_MORE) && cqe.res != -ECANCELED &&
+        static_cast<size_t>(fd) < poll_requests_.size() &&
+        poll_requests_[fd] == cqe.user_data) {
+      // the kernel may finish a multishot request, e.g. when the completion
+      // queue overflows, so arm it again if the fd is still registered
+      if (!ArmPoll(fd, cqe.user_data)) {
+        return false;
+      }
+    }
+    if (cqe.res < 0) {
+      continue;
+    }
+
+    if (fd == interrupter_->get_read_fd()) {
+      // we have some command events to be processed, they will be handled
+      // at the beginning of the next Poll()
+      interrupter_->Reset();
+      continue;
+    }
+
+    Event event(fd,
+                static_cast<int>(Event::Type::kDummy),
+                static_cast<uint32_t>(cqe.user_data >> 32));
+    if (cqe.res & (POLLHUP | POLLNVAL)) {
+      event.mutable_mask() |= static_cast<int>(Event::Type::kClose);
+    } else {
+      if (cqe.res & POLLERR) {
+        event.mutable_mask() |= static_cast<int>(Event::Type::kError);
+      }
+      // a half closed peer is reported as readable, the following recv()
+      // returns 0 and closes the connection
+      if (cqe.res & (POLLIN | POLLPRI | POLLRDHUP)) {
+        event.mutable_mask() |= static_cast<int>(Event::Type::kRead);
+      }
+      if (cqe.res & POLLOUT) {
+        event.mutable_mask() |= static_cast<int>(Event::Type::kWrite);
+      }
+    }
+
+    std::shared_ptr<EventCenter> event_center = event_center_.lock();
+    if (!event_center || !event_center->ProcessEvent(event, id_)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IoUringEventPollerImpl::AddPollerEvent(Event&& ev) {
+  if (ev.fd() < 0) {
+    return false;
+  }
+  size_t fd = ev.fd();
+  if (fd >= poll_requests_.size()) {
+    poll_requests_.resize(std::max(fd + 1, poll_requests_.size() * 2),
+                          kNoPollRequest);
+  }
+  uint64_t user_data = ToUserData(ev);
+  if (!ArmPoll(ev.fd(), user_data)) {
+    return false;
+  }
+  poll_requests_[fd] = user_data;
+  return true;
+}
+
+bool IoUringEventPollerImpl::ModifyPollerEvent(Event&& ev) {
+  // both directions are watched since the fd is added, see edge_triggered()
+  (void) ev;
+  return true;
+}
+
+bool IoUringEventPollerImpl::RemovePollerEvent(Event&& ev) {
+  if (!(ev.mask() & static_cast<int>(Event::Type::kClose))) {
+    return false;
+  }
+  size_t fd = ev.fd();
+  if (fd >= poll_requests_.size() || poll_requests_[fd] == kNoPollRequest) {
+    return false;
+  }
+  struct io_uring_sqe* sqe = GetSqe();
+  if (!sqe) {
+    return false;
+  }
+  sqe->opcode = IORING_OP_POLL_REMOVE;
+  sqe->fd = -1;
+  sqe->addr = poll_requests_[fd];
+  sqe->user_data = kIgnoredUserData;
+  poll_requests_[fd] = kNoPollRequest;
+  // the poll request holds a reference of the socket, cancel it right now
+  // so that the socket is really closed by the following close()
+  return Submit(0);
+}
+
+}  // namespace tcp
+}  // namespace cnetpp
+
+#endif  // defined(CNETPP_HAVE_IO_URING)
+#endif  // defined(linux) || defined(__linux) || defined(__linux__)
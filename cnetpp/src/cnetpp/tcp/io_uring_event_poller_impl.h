@@ -0,0 +1,140 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#if defined(linux) || defined(__linux) || defined(__linux__)
+#ifndef CNETPP_TCP_IO_URING_EVENT_POLLER_IMPL_H_
+#define CNETPP_TCP_IO_URING_EVENT_POLLER_IMPL_H_
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// multishot poll requests appeared in the same header as IORING_POLL_ADD_MULTI
+#if defined(IORING_POLL_ADD_MULTI)
+#define CNETPP_HAVE_IO_URING 1
+
+#include <cnetpp/tcp/event_poller.h>
+#include <cnetpp/tcp/event.h>
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace cnetpp {
+namespace tcp {
+
+// The readiness of every socket is watched by a multishot poll request of an
+// io_uring instance. All of the registrations queued while handling the
+// commands and events are submitted together with the wait for completions,
+// so one loop costs a single io_uring_enter() however many connections are
+// added or removed.
+// A multishot poll reports the wakeups of a socket instead of its state, so
+// this event poller always works in edge-triggered mode.
+// NOTE: it only replaces epoll_wait() for the readiness, the reads and writes
+// are still plain syscalls of the connections rather than io_uring requests.
+// So it's not expected to beat EpollEventPollerImpl, at best it saves the
+// epoll_ctl() calls of the connections coming and going in bursts.
+class IoUringEventPollerImpl : public EventPoller {
+ public:
+  IoUringEventPollerImpl(int id, size_t max_connections)
+      : EventPoller(id, max_connections) {
+    edge_triggered_ = true;
+  }
+
+  ~IoUringEventPollerImpl() {
+    TeardownRing();
+  }
+
+  // true if the kernel supports io_uring with multishot poll requests (5.13+)
+  // and it's not disabled, e.g. by seccomp or kernel.io_uring_disabled
+  static bool IsSupported();
+
+ protected:
+  bool DoInit() override;
+
+  void DoShutdown() override {
+    TeardownRing();
+  }
+
+  bool Poll() override;
+
+ private:
+  int ring_fd_ { -1 };
+
+  // the mapped submission queue, completion queue and sqe array
+  void* sq_ring_ { nullptr };
+  size_t sq_ring_size_ { 0 };
+  void* cq_ring_ { nullptr };
+  size_t cq_ring_size_ { 0 };
+  struct io_uring_sqe* sqes_ { nullptr };
+  size_t sqes_size_ { 0 };
+
+  unsigned* sq_head_ { nullptr };
+  unsigned* sq_tail_ { nullptr };
+  unsigned* sq_array_ { nullptr };
+  unsigned sq_mask_ { 0 };
+  unsigned sq_entries_ { 0 };
+  unsigned* cq_head_ { nullptr };
+  unsigned* cq_tail_ { nullptr };
+  struct io_uring_cqe* cqes_ { nullptr };
+  unsigned cq_mask_ { 0 };
+
+  // the sqes filled but not submitted yet
+  unsigned sq_local_tail_ { 0 };
+  unsigned to_submit_ { 0 };
+
+  // the user_data of the poll request watching each fd, used to cancel or
+  // re-arm it
+  std::vector<uint64_t> poll_requests_;
+
+  // the completions copied out of the ring, so that the ring can be reused
+  // while they are being dispatched
+  std::vector<struct io_uring_cqe> completions_;
+
+  bool SetupRing(unsigned entries);
+  void TeardownRing();
+
+  // get a free sqe, the queued ones are submitted if the ring is full
+  struct io_uring_sqe* GetSqe();
+  // submit all of the queued sqes, and wait for at least min_complete
+  // completions or timeout milliseconds, -1 means no timeout
+  bool Submit(unsigned min_complete, int timeout = -1);
+
+  bool ArmPoll(int fd, uint64_t user_data);
+
+  bool AddPollerEvent(Event&& ev) override;
+  bool ModifyPollerEvent(Event&& ev) override;
+  bool RemovePollerEvent(Event&& ev) override;
+};
+
+}  // namespace tcp
+}  // namespace cnetpp
+
+#endif  // defined(IORING_POLL_ADD_MULTI)
+#endif  // CNETPP_TCP_IO_URING_EVENT_POLLER_IMPL_H_
+#endif  // define(linux) || defined(__linux) || defined(__linux__)
@@ -31,56 +31,182 @@
 #include <cnetpp/base/socket.h>
 
 #include <assert.h>
+#include <errno.h>
+
+#include <algorithm>
 
 namespace cnetpp {
 namespace tcp {
 
+namespace {
+
+// how long accepting is paused once out of fds or memory
+const int64_t kAcceptRetryDelay = 100;  // ms
+
+}  // namespace
+
 // This method will be called when a socket fd becomes readable
 void ListenConnection::HandleReadableEvent(EventCenter* event_center) {
   assert(event_center);
+  if (accept_paused_) {
+    // an edge arrived before the timer, see PauseAccepting()
+    return;
+  }
+
+  size_t budget = std::max<size_t>(options_.accept_budget(), 1);
+  for (size_t i = 0; i < budget; ++i) {
+    AcceptResult result = AcceptConnection(event_center);
+    if (result == AcceptResult::kDrained) {
+      return;
+    } else if (result == AcceptResult::kNoResources) {
+      PauseAccepting(event_center);
+      return;
+    } else if (result == AcceptResult::kFailed) {
+      // go on with the rest after the other events, like below
+      break;
+    }
+  }
 
+  // The budget is used up, or a connection failed, before EAGAIN. Resume
+  // accepting after the other events of this event poller are handled. The
+  // level-triggered pollers report it readable again anyway, no more
+  // notification will arrive in edge-triggered mode.
+  if (event_center->edge_triggered()) {
+    event_center->AddCommand(
+        Command(static_cast<int>(Command::Type::kReadable), shared_from_this()),
+        true);
+  }
+}
+
+void ListenConnection::PauseAccepting(EventCenter* event_center) {
+  accept_paused_ = true;
+  if (!event_center->edge_triggered()) {
+    // stop polling it, see reading_paused()
+    event_center->AddCommand(
+        Command(static_cast<int>(Command::Type::kReadable), this), false);
+  }
+  std::weak_ptr<ConnectionBase> weak_listener = shared_from_this();
+  event_center->AddTimer(*this, kAcceptRetryDelay, [weak_listener] () {
+    auto listener = std::static_pointer_cast<ListenConnection>(
+        weak_listener.lock());
+    if (!listener) {
+      return;
+    }
+    listener->accept_paused_ = false;
+    auto event_center = listener->event_center_.lock();
+    if (event_center) {
+      // polls it again, or accepts right now in edge-triggered mode as the
+      // pending connections raise no new edge
+      event_center->AddCommand(
+          Command(static_cast<int>(Command::Type::kReadable), listener),
+          false);
+    }
+  });
+}
+
+ListenConnection::AcceptResult ListenConnection::AcceptConnection(
+    EventCenter* event_center) {
   base::ListenSocket listen_socket;
   listen_socket.Attach(socket_.fd());
 
   base::TcpSocket new_socket;
   base::EndPoint remote_end_point;
-  if (!listen_socket.Accept(&new_socket, &remote_end_point)) {
+  if (!listen_socket.AcceptNonBlocking(&new_socket, &remote_end_point)) {
+    int error = base::Socket::GetLastError();
     listen_socket.Detach();
-    return;
+    switch (error) {
+      case EMFILE:
+      case ENFILE:
+      case ENOBUFS:
+      case ENOMEM:
+        return AcceptResult::kNoResources;
+      // the errors of the pending connection, see accept(2)
+      case ECONNABORTED:
+      case EINTR:
+      case EPERM:
+      case EPROTO:
+      case ENETDOWN:
+      case ENOPROTOOPT:
+      case EHOSTDOWN:
+      case ENONET:
+      case EHOSTUNREACH:
+      case EOPNOTSUPP:
+      case ENETUNREACH:
+        return AcceptResult::kFailed;
+      default:
+        // EAGAIN, or the listen socket itself is broken and retrying it
+        // would not help
+        return AcceptResult::kDrained;
+    }
   }
   listen_socket.Detach();
 
-  new_socket.SetCloexec(true);
-  new_socket.SetBlocking(false);
+#if !defined(linux) && !defined(__linux) && !defined(__linux__)
+  // linux copies these options from the listen socket, see TcpServer::Listen()
   new_socket.SetTcpNoDelay(true);
   new_socket.SetKeepAlive(true);
   new_socket.SetLinger(false);
   new_socket.SetSendBufferSize(options_.tcp_send_buffer_size());
   new_socket.SetReceiveBufferSize(options_.tcp_receive_buffer_size());
+  if (options_.tcp_not_sent_lowat() > 0) {
+    new_socket.SetTcpNotSentLowat(options_.tcp_not_sent_lowat());
+  }
+#endif
 
   ConnectionFactory cf;
   auto new_connection =
       cf.CreateConnection(event_center_.lock(), new_socket.fd(), false);
   auto new_tcp_connection =
       std::static_pointer_cast<TcpConnection>(new_connection);
-  new_tcp_connection->set_closed_callback(options_.closed_callback());
-  new_tcp_connection->set_sent_callback(options_.sent_callback());
-  new_tcp_connection->set_received_callback(options_.received_callback());
+  if (options_.handler()) {
+    new_tcp_connection->set_handler(options_.handler());
+  } else {
+    new_tcp_connection->set_closed_callback(options_.closed_callback());
+    new_tcp_connection->set_sent_callback(options_.sent_callback());
+    new_tcp_connection->set_received_callback(options_.received_callback());
+  }
   new_tcp_connection->set_state(TcpConnection::State::kConnected);
   new_tcp_connection->SetSendBufferSize(options_.send_buffer_size());
   new_tcp_connection->SetRecvBufferSize(options_.receive_buffer_size());
+  new_tcp_connection->mutable_recv_buffer().SetMirrored(
+      options_.mirrored_receive_buffer());
+  new_tcp_connection->SetReadBudget(options_.read_budget());
+  new_tcp_connection->SetCoalesceReceivedCallbacks(
+      options_.coalesce_received_callbacks());
+  new_tcp_connection->SetZeroCopyThreshold(options_.zero_copy_threshold());
+  new_tcp_connection->SetSendWatermarks(
+      options_.send_high_watermark(),
+      options_.send_low_watermark(),
+      options_.pause_reading_on_high_watermark());
+  new_tcp_connection->set_high_watermark_callback(
+      options_.high_watermark_callback());
+  new_tcp_connection->set_low_watermark_callback(
+      options_.low_watermark_callback());
   new_tcp_connection->set_remote_end_point(std::move(remote_end_point));
 
   new_socket.Detach();
 
-  if (connected_callback_) {
+  if (options_.reuse_port()) {
+    // the kernel has already balanced this connection onto our poller, keep
+    // serving it here without a cross-thread handoff
+    new_connection->set_event_poller_id(event_poller_id());
+  } else {
+    // place it before the user sees it, so that the packets sent in the
+    // connected callback go to the right event poller
+    event_center->PlaceConnection(new_connection.get());
+  }
+
+  if (options_.handler()) {
+    options_.handler()->OnConnected(*new_tcp_connection);
+  } else if (connected_callback_) {
     // call callback user defined
     connected_callback_(new_tcp_connection);
   }
 
   event_center->AddCommand(
-      Command(static_cast<int>(Command::Type::kAddConn), new_connection), true);
-  return;
+      Command(static_cast<int>(Command::Type::kAddConn), new_connection),
+      !options_.reuse_port());
+  return AcceptResult::kAccepted;
 }
 
 void ListenConnection::HandleWriteableEvent(EventCenter* event_center) {
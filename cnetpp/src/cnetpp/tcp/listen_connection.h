@@ -59,6 +59,12 @@ class ListenConnection : public ConnectionBase {
   }
   virtual void MarkAsClosed(bool immediately = true) override {
   }
+  virtual bool reading_paused() const override {
+    return accept_paused_;
+  }
+  virtual bool is_listener() const override {
+    return true;
+  }
 
  private:
   ListenConnection(std::shared_ptr<EventCenter> event_center, int fd)
@@ -66,6 +72,27 @@ class ListenConnection : public ConnectionBase {
   }
 
   TcpServerOptions options_;
+
+  enum class AcceptResult {
+    kAccepted,
+    // no pending connection is left
+    kDrained,
+    // the pending connection is gone, e.g. reset by the peer, the others
+    // may be accepted still
+    kFailed,
+    // out of fds or memory, nothing can be accepted for a while
+    kNoResources,
+  };
+
+  // accept one pending connection and dispatch it to an event poller
+  // NOTE: HandleReadableEvent() calls it at most accept_budget times
+  AcceptResult AcceptConnection(EventCenter* event_center);
+
+  // stop accepting and polling the listen socket for a while, which would
+  // be reported readable again and again without a connection accepted
+  void PauseAccepting(EventCenter* event_center);
+  // only accessed by the event poller thread
+  bool accept_paused_ { false };
 };
 
 }  // namespace tcp
@@ -46,6 +46,7 @@ bool PollEventPollerImpl::Poll() {
   if (!ProcessInterrupt()) {
     return false;
   }
+  ProcessTimers();
 
   // should not happen
   // because we have at least one fd in the fd sets(pipe read fd)
@@ -54,8 +55,9 @@ bool PollEventPollerImpl::Poll() {
   }
 
   int count = 0;
+  int timeout = NextTimeout();
   do {
-    count = ::poll(&(poll_fds_[0]), poll_fds_end_, -1);
+    count = ::poll(&(poll_fds_[0]), poll_fds_end_, timeout);
   } while (count == -1 &&
            cnetpp::concurrency::ThisThread::GetLastError() == EINTR);
 
@@ -83,10 +85,14 @@ bool PollEventPollerImpl::Poll() {
     Event event(fd);
     int revents = poll_fds_[i].revents;
 
-    if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+    if (revents & (POLLHUP | POLLNVAL)) {
       has_event = true;
       event.mutable_mask() |= static_cast<int>(Event::Type::kClose);
     } else {
+      if (revents & POLLERR) {
+        has_event = true;
+        event.mutable_mask() |= static_cast<int>(Event::Type::kError);
+      }
       if (revents & (POLLIN | POLLRDNORM | POLLPRI | POLLRDBAND)) {
         has_event = true;
         event.mutable_mask() |= static_cast<int>(Event::Type::kRead);
@@ -42,9 +42,23 @@ bool RingBuffer::Resize(size_t new_size) {
   if (new_size < size_) {
     return false;
   }
-  char* tmp = new char[new_size];
+  char* tmp = nullptr;
+  size_t capacity = new_size;
+  bool mirrored = mirrored_;
+  if (mirrored && new_size > 0) {
+    tmp = BufferPool::AllocateMirrored(new_size, &capacity);
+    if (!tmp) {
+      mirrored = false;
+      capacity = new_size;
+    }
+  }
+  if (!tmp) {
+    tmp = BufferPool::Allocate(new_size);
+  }
   if (size_ > 0) {
-    if (end_ <= begin_) {
+    if (mirrored_) {
+      ::memcpy(tmp, buffer_ + begin_, size_);
+    } else if (end_ <= begin_) {
       // readable data is splited into two slices
       ::memcpy(tmp, buffer_ + begin_, capacity_ - begin_);
       ::memcpy(tmp + capacity_ - begin_, buffer_, end_);
@@ -52,21 +66,55 @@ bool RingBuffer::Resize(size_t new_size) {
       ::memcpy(tmp, buffer_ + begin_, end_ - begin_);
     }
   }
-  delete [] buffer_;
+  Release();
   buffer_ = tmp;
-  capacity_ = new_size;
+  capacity_ = capacity;
+  mirrored_ = mirrored;
   begin_ =  0;
   end_ = size_;
   return true;
 }
 
+bool RingBuffer::SetMirrored(bool mirrored) {
+  if (size_ > 0) {
+    return false;
+  }
+  if (mirrored != mirrored_) {
+    Release();
+    buffer_ = nullptr;
+    capacity_ = 0;
+    begin_ = 0;
+    end_ = 0;
+    mirrored_ = mirrored;
+  }
+  return true;
+}
+
+void RingBuffer::Release() {
+  if (mirrored_) {
+    BufferPool::FreeMirrored(buffer_, capacity_);
+  } else {
+    BufferPool::Free(buffer_, capacity_);
+  }
+}
+
 void RingBuffer::GetWritePositions(struct iovec* write_positions, size_t n) {
   assert(write_positions);
   assert(n == 2);
 
+  if (mirrored_) {
+    write_positions[0].iov_base = buffer_ + end_;
+    write_positions[0].iov_len = capacity_ - size_;
+    write_positions[1].iov_base = buffer_;
+    write_positions[1].iov_len = 0;
+    return;
+  }
+
   if (Full()) {
     // buffer is full, no extra writable space to store new data
+    write_positions[0].iov_base = buffer_;
     write_positions[0].iov_len = 0;
+    write_positions[1].iov_base = buffer_;
     write_positions[1].iov_len = 0;
     return;
   }
@@ -81,6 +129,7 @@ void RingBuffer::GetWritePositions(struct iovec* write_positions, size_t n) {
     // writable space is continuous
     write_positions[0].iov_base = buffer_ + end_;
     write_positions[0].iov_len = begin_ - end_;
+    write_positions[1].iov_base = buffer_;
     write_positions[1].iov_len = 0;
   }
 }
@@ -104,9 +153,19 @@ void RingBuffer::GetReadPositions(struct iovec* read_positions, size_t n) {
   assert(read_positions);
   assert(n == 2);
 
+  if (mirrored_) {
+    read_positions[0].iov_base = buffer_ + begin_;
+    read_positions[0].iov_len = size_;
+    read_positions[1].iov_base = buffer_;
+    read_positions[1].iov_len = 0;
+    return;
+  }
+
   if (Empty()) {
     // buffer is empty, no extra readable data
+    read_positions[0].iov_base = buffer_;
     read_positions[0].iov_len = 0;
+    read_positions[1].iov_base = buffer_;
     read_positions[1].iov_len = 0;
     return;
   }
@@ -121,6 +180,9 @@ void RingBuffer::GetReadPositions(struct iovec* read_positions, size_t n) {
     // readable data is continuous
     read_positions[0].iov_base = buffer_ + begin_;
     read_positions[0].iov_len = end_ - begin_;
+    // readv()/writev() may fail with EFAULT on a wild pointer even if the
+    // length is zero
+    read_positions[1].iov_base = buffer_;
     read_positions[1].iov_len = 0;
   }
 }
@@ -149,6 +211,12 @@ bool RingBuffer::Write(base::StringPiece data) {
     return false;
   }
 
+  if (mirrored_) {
+    ::memcpy(buffer_ + end_, data.data(), data.length());
+    CommitWrite(data.length());
+    return true;
+  }
+
   size_ += data.length();
 
   if (end_ >= begin_) {
@@ -196,6 +264,12 @@ bool RingBuffer::Read(char* data, size_t n) {
     return false;
   }
 
+  if (mirrored_) {
+    memcpy(data, buffer_ + begin_, n);
+    CommitRead(n);
+    return true;
+  }
+
   size_ -= n;
 
   if (end_ <= begin_) {
@@ -221,20 +295,19 @@ bool RingBuffer::ReadUint32(uint32_t* value) {
   if (size_ < sizeof(uint32_t)) {
     return false;
   }
-  if (end_ <= begin_) {
+  if (!mirrored_ && end_ <= begin_) {
     Reform();
   }
 
   base::StringPiece buf(buffer_ + begin_, size_);
   *value = ntohl(base::StringUtils::ToUint32(buf));
-  begin_ += sizeof(uint32_t);
-  size_ -= sizeof(uint32_t);
+  CommitRead(sizeof(uint32_t));
   return true;
 }
 
 int RingBuffer::ReadVarint32(uint32_t* value) {
   assert(value);
-  if (end_ <= begin_) {
+  if (!mirrored_ && end_ <= begin_) {
     Reform();
   }
 
@@ -245,8 +318,7 @@ int RingBuffer::ReadVarint32(uint32_t* value) {
   } else if (consumed == 0) {
     return 0;
   } else {
-    begin_ += consumed;
-    size_ -= consumed;
+    CommitRead(consumed);
     return 1;
   }
 }
@@ -255,7 +327,8 @@ bool RingBuffer::DoFind(base::StringPiece delimiters, base::StringPiece* data) {
   if (size_ <= 0) {
     return false;
   }
-  if (end_ <= begin_) {
+  // the readable data is always contiguous in the mirrored storage
+  if (!mirrored_ && end_ <= begin_) {
     Reform();
   }
   
@@ -276,7 +349,7 @@ void RingBuffer::Reform() {
     if (end_ <= static_cast<int>(capacity_) - begin_) {
       char* tmp = new char[end_];
       ::memcpy(tmp, buffer_, end_);
-      ::memcpy(buffer_, buffer_ + begin_, capacity_ - begin_);
+      ::memmove(buffer_, buffer_ + begin_, capacity_ - begin_);
       ::memcpy(buffer_ + capacity_ - begin_, tmp, end_);
       delete [] tmp;
     } else {
@@ -28,6 +28,7 @@
 #define CNETPP_TCP_RING_BUFFER_H_
 
 #include <cnetpp/base/string_piece.h>
+#include <cnetpp/tcp/buffer_pool.h>
 
 #include <sys/uio.h>
 #include <string.h>
@@ -38,23 +39,21 @@
 namespace cnetpp {
 namespace tcp {
 
-// buffer class designed for TCP connection
+// buffer class designed for TCP connection, the storage is drawn from the
+// BufferPool
 // NOTE: You should not use this class across multi-threads unless you know how
 // this class is implemented
 class RingBuffer {
  public:
   explicit RingBuffer(size_t buffer_size)
-      : buffer_(new char[buffer_size]),
+      : buffer_(BufferPool::Allocate(buffer_size)),
         begin_(0),
         end_(0),
         size_(0),
         capacity_(buffer_size) {
-    assert(buffer_);
   }
   ~RingBuffer() {
-    if (buffer_) {
-      delete [] buffer_;
-    }
+    Release();
   }
 
   size_t Capacity() {
@@ -68,6 +67,24 @@ class RingBuffer {
   // if new_size is less than size_, resize will fail
   bool Resize(size_t new_size);
 
+  // If true, the storage is mapped twice back to back, so that the readable
+  // and the writable space are always contiguous, i.e. the positions are
+  // returned in one iovec and Find() never moves the data. The capacity is
+  // rounded up to the BufferPool block size then. It falls back to the plain
+  // storage if the mapping fails. Return false if the buffer is not empty.
+  bool SetMirrored(bool mirrored);
+  bool mirrored() const {
+    return mirrored_;
+  }
+
+  // return the storage to the BufferPool if the buffer is empty, it's
+  // allocated again by the next Resize()
+  void Shrink() {
+    if (size_ == 0 && buffer_) {
+      Resize(0);
+    }
+  }
+
   size_t Length() {
     return size_;
   }
@@ -127,6 +144,7 @@ class RingBuffer {
     std::swap(end_, that.end_);
     std::swap(size_, that.size_);
     std::swap(capacity_, that.capacity_);
+    std::swap(mirrored_, that.mirrored_);
   }
 
  private:
@@ -136,7 +154,9 @@ class RingBuffer {
   int end_;
   size_t size_;
   size_t capacity_;
+  bool mirrored_ { false };
 
+  void Release();
   void Reform();
   bool DoFind(base::StringPiece delimiters, base::StringPiece* data);
 };
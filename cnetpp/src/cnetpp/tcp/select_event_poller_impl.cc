@@ -41,6 +41,7 @@ bool SelectEventPollerImpl::Poll() {
   if (!ProcessInterrupt()) {
     return false;
   }
+  ProcessTimers();
 
   int count{0};
   fd_set rd_fds, wr_fds, ex_fds;
@@ -49,8 +50,14 @@ bool SelectEventPollerImpl::Poll() {
     return true;
   }
 
+  int timeout = NextTimeout();
+  struct timeval tv { timeout / 1000, (timeout % 1000) * 1000 };
   do {
-    count = ::select(max_fd + 1, &rd_fds, &wr_fds, &ex_fds, nullptr);
+    count = ::select(max_fd + 1,
+                     &rd_fds,
+                     &wr_fds,
+                     &ex_fds,
+                     timeout >= 0 ? &tv : nullptr);
   } while (count == -1 &&
            cnetpp::concurrency::ThisThread::GetLastError() == EINTR);
 
@@ -65,11 +72,16 @@ bool SelectEventPollerImpl::Poll() {
     }
   }
 
+  // collect the events first, the handlers may add or remove fds
+  std::vector<Event> events;
   for (auto fd_info_itr = select_fds_.begin();
        fd_info_itr != select_fds_.end();
        ++fd_info_itr) {
     bool has_event = false;
     int fd = fd_info_itr->first;
+    if (fd == interrupter_->get_read_fd()) {
+      continue;
+    }
     Event event(fd);
     if (FD_ISSET(fd, &ex_fds)) {
       has_event = true;
@@ -86,10 +98,14 @@ bool SelectEventPollerImpl::Poll() {
     }
 
     if(has_event) {
-      auto event_center = event_center_.lock();
-      if (!event_center || !event_center->ProcessEvent(event, id_)) {
-        return false;
-      }
+      events.push_back(std::move(event));
+    }
+  }
+
+  for (auto& event : events) {
+    auto event_center = event_center_.lock();
+    if (!event_center || !event_center->ProcessEvent(event, id_)) {
+      return false;
     }
   }
   return true;
@@ -29,20 +29,74 @@
 
 #include <functional>
 #include <memory>
+#include <utility>
 
 namespace cnetpp {
 namespace tcp {
 
 class TcpConnection;
 
+// The connection is passed by reference, so calling a callback doesn't touch
+// its reference count. The callbacks taking it by value still work, copy it
+// only when keeping it.
 using ConnectedCallbackType =
-    std::function<bool(std::shared_ptr<TcpConnection>)>;
+    std::function<bool(const std::shared_ptr<TcpConnection>&)>;
 using ClosedCallbackType =
-    std::function<bool(std::shared_ptr<TcpConnection>)>;
+    std::function<bool(const std::shared_ptr<TcpConnection>&)>;
 using ReceivedCallbackType =
-    std::function<bool(std::shared_ptr<TcpConnection>)>;
+    std::function<bool(const std::shared_ptr<TcpConnection>&)>;
 using SentCallbackType =
-    std::function<bool(bool, std::shared_ptr<TcpConnection>)>;
+    std::function<bool(bool, const std::shared_ptr<TcpConnection>&)>;
+using TimerCallbackType =
+    std::function<void(const std::shared_ptr<TcpConnection>&)>;
+// the second argument is the number of bytes queued for sending
+using WatermarkCallbackType =
+    std::function<void(const std::shared_ptr<TcpConnection>&, size_t)>;
+
+// TcpHandler takes the place of the connected, received, sent and closed
+// callbacks. The connections keep a plain pointer to one handler shared by
+// all of them, and pass themselves by reference, see TcpHandlerServer.
+class TcpHandler {
+ public:
+  virtual ~TcpHandler() = default;
+
+  virtual bool OnConnected(TcpConnection& connection) = 0;
+  virtual bool OnReceived(TcpConnection& connection) = 0;
+  virtual bool OnSent(bool success, TcpConnection& connection) = 0;
+  virtual bool OnClosed(TcpConnection& connection) = 0;
+};
+
+// Forwards the events to a Handler known at compile time, whose methods
+// have the same signatures as those of TcpHandler but needn't be virtual,
+// so they are inlined here.
+template <typename Handler>
+class TcpHandlerAdapter final : public TcpHandler {
+ public:
+  template <typename... Args>
+  explicit TcpHandlerAdapter(Args&&... args)
+      : handler_(std::forward<Args>(args)...) {
+  }
+
+  Handler& handler() {
+    return handler_;
+  }
+
+  bool OnConnected(TcpConnection& connection) override {
+    return handler_.OnConnected(connection);
+  }
+  bool OnReceived(TcpConnection& connection) override {
+    return handler_.OnReceived(connection);
+  }
+  bool OnSent(bool success, TcpConnection& connection) override {
+    return handler_.OnSent(success, connection);
+  }
+  bool OnClosed(TcpConnection& connection) override {
+    return handler_.OnClosed(connection);
+  }
+
+ private:
+  Handler handler_;
+};
 
 }  // namespace tcp
 }  // namespace cnetpp
@@ -28,6 +28,7 @@
 #include <cnetpp/tcp/connection_factory.h>
 #include <cnetpp/base/end_point.h>
 #include <cnetpp/base/socket.h>
+#include <cnetpp/base/log.h>
 
 #include <fcntl.h>
 #include <sys/types.h>
@@ -42,7 +43,7 @@ namespace tcp {
 
 bool TcpClient::Launch(const std::string& name,
     const TcpClientOptions& options) {
-  event_center_ = EventCenter::New(name, options.worker_count());
+  event_center_ = EventCenter::New(name, options);
   assert(event_center_.get());
   return event_center_->Launch();
 }
@@ -59,16 +60,29 @@ ConnectionId TcpClient::Connect(const base::EndPoint* remote,
   assert(remote);
 
   base::TcpSocket socket;
-  if (!socket.Create() ||
+  // the tcp options don't apply to the unix domain sockets
+  bool is_tcp = !remote->IsUnixDomain();
+  if (!socket.Create(*remote) ||
       !socket.SetCloexec() ||
       !socket.SetBlocking(false) ||
-      !socket.SetTcpNoDelay() ||
+      (is_tcp && !socket.SetTcpNoDelay()) ||
       !socket.SetKeepAlive() ||
       !socket.SetSendBufferSize(options.tcp_send_buffer_size()) ||
       !socket.SetReceiveBufferSize(options.tcp_receive_buffer_size()) ||
       !socket.Connect(*remote)) {
     return kInvalidConnectionId;
   }
+  if (options.socket_busy_poll_us() > 0 &&
+      (!socket.SetBusyPoll(options.socket_busy_poll_us()) ||
+       !socket.SetPreferBusyPoll(true))) {
+    Info("Failed to enable busy polling on the socket to %s",
+         remote->ToString().c_str());
+  }
+  if (is_tcp && options.tcp_not_sent_lowat() > 0 &&
+      !socket.SetTcpNotSentLowat(options.tcp_not_sent_lowat())) {
+    Info("Failed to set TCP_NOTSENT_LOWAT on the socket to %s",
+         remote->ToString().c_str());
+  }
 
   InternalConnectionContext cc;
   cc.status = Status::kConnecting;
@@ -80,38 +94,51 @@ ConnectionId TcpClient::Connect(const base::EndPoint* remote,
   auto tcp_connection = std::static_pointer_cast<TcpConnection>(connection);
   tcp_connection->SetSendBufferSize(options.send_buffer_size());
   tcp_connection->SetRecvBufferSize(options.receive_buffer_size());
+  tcp_connection->mutable_recv_buffer().SetMirrored(
+      options.mirrored_receive_buffer());
+  tcp_connection->SetReadBudget(options.read_budget());
+  tcp_connection->SetCoalesceReceivedCallbacks(
+      options.coalesce_received_callbacks());
+  tcp_connection->SetZeroCopyThreshold(options.zero_copy_threshold());
+  tcp_connection->SetSendWatermarks(options.send_high_watermark(),
+                                    options.send_low_watermark(),
+                                    options.pause_reading_on_high_watermark());
+  tcp_connection->set_high_watermark_callback(
+      options.high_watermark_callback());
+  tcp_connection->set_low_watermark_callback(options.low_watermark_callback());
   tcp_connection->set_cookie(cookie);
   tcp_connection->set_remote_end_point(*remote);
+  tcp_connection->set_connect_timeout(options.connect_timeout());
   cc.tcp_connection = tcp_connection;
   std::unique_lock<std::mutex> guard(contexts_mutex_);
-  contexts_[connection->id()] = cc;
+  // the context stays at the same address until OnClosed() erases it, which
+  // is the last callback of the connection
+  InternalConnectionContext* context = &(contexts_[connection->id()] = cc);
   guard.unlock();
 
   tcp_connection->set_connected_callback(
-      [this] (std::shared_ptr<TcpConnection> c) -> bool {
-        return this->OnConnected(c);
+      [this, context] (const std::shared_ptr<TcpConnection>& c) -> bool {
+        return this->OnConnected(context, c);
       }
   );
   tcp_connection->set_closed_callback(
-      [this] (std::shared_ptr<TcpConnection> c) -> bool {
-        return this->OnClosed(c);
-      }
-  );
-  tcp_connection->set_sent_callback(
-      [this] (bool status, std::shared_ptr<TcpConnection> c) -> bool {
-        return this->OnSent(status, c);
-      }
-  );
-  tcp_connection->set_received_callback(
-      [this] (std::shared_ptr<TcpConnection> c) -> bool {
-        return this->OnReceived(c);
+      [this, context] (const std::shared_ptr<TcpConnection>& c) -> bool {
+        return this->OnClosed(context, c);
       }
   );
+  // nothing to do before the user's callbacks on the hot path, so they are
+  // called directly without looking up the context
+  tcp_connection->set_sent_callback(options.sent_callback());
+  tcp_connection->set_received_callback(options.received_callback());
 
   socket.Detach();
 
+  // the connection becomes writable once it's established
   event_center_->AddCommand(
-      Command(static_cast<int>(Command::Type::kAddConn), connection), true);
+      Command(static_cast<int>(Command::Type::kAddConn) |
+              static_cast<int>(Command::Type::kWriteable),
+              connection),
+      true);
   return connection->id();
 }
 
@@ -128,67 +155,28 @@ bool TcpClient::AsyncClosed(ConnectionId connection_id) {
 }
 
 bool TcpClient::OnConnected(
-    std::shared_ptr<TcpConnection> tcp_connection) {
+    InternalConnectionContext* context,
+    const std::shared_ptr<TcpConnection>& tcp_connection) {
   assert(tcp_connection.get());
-  std::unique_lock<std::mutex> guard(contexts_mutex_);
-  auto itr = contexts_.find(tcp_connection->id());
-  assert(itr != contexts_.end());
-  itr->second.status = Status::kConnected;
-  if (itr->second.options.connected_callback()) {
-    auto& cb = itr->second.options.mutable_connected_callback();
-    guard.unlock();
-    return cb(tcp_connection);
+  context->status = Status::kConnected;
+  if (context->options.connected_callback()) {
+    return context->options.connected_callback()(tcp_connection);
   }
   return true;
 }
 
 bool TcpClient::OnClosed(
-    std::shared_ptr<TcpConnection> tcp_connection) {
+    InternalConnectionContext* context,
+    const std::shared_ptr<TcpConnection>& tcp_connection) {
   assert(tcp_connection.get());
-  std::unique_lock<std::mutex> guard(contexts_mutex_);
-  auto itr = contexts_.find(tcp_connection->id());
-  assert(itr != contexts_.end());
-  itr->second.status = Status::kClosed;
+  context->status = Status::kClosed;
   bool res = true;
-  if (itr->second.options.closed_callback()) {
-    auto& cb = itr->second.options.mutable_closed_callback();
-    guard.unlock();
-    res = cb(tcp_connection);
-    guard.lock();
-    contexts_.erase(itr);
-    return res;
+  if (context->options.closed_callback()) {
+    res = context->options.closed_callback()(tcp_connection);
   }
-  contexts_.erase(itr);
-  return res;
-}
-
-bool TcpClient::OnSent(bool success,
-                       std::shared_ptr<TcpConnection> tcp_connection) {
-  assert(tcp_connection.get());
-  std::unique_lock<std::mutex> guard(contexts_mutex_);
-  auto itr = contexts_.find(tcp_connection->id());
-  assert(itr != contexts_.end());
-  assert(itr->second.status == Status::kConnected);
-  if (itr->second.options.sent_callback()) {
-    auto& cb = itr->second.options.mutable_sent_callback();
-    guard.unlock();
-    return cb(success, tcp_connection);
-  }
-  return true;
-}
-
-bool TcpClient::OnReceived(std::shared_ptr<TcpConnection> tcp_connection) {
-  assert(tcp_connection.get());
   std::unique_lock<std::mutex> guard(contexts_mutex_);
-  auto itr = contexts_.find(tcp_connection->id());
-  assert(itr != contexts_.end());
-  assert(itr->second.status == Status::kConnected);
-  if (itr->second.options.received_callback()) {
-    auto& cb = itr->second.options.mutable_received_callback();
-    guard.unlock();
-    return cb(tcp_connection);
-  }
-  return true;
+  contexts_.erase(tcp_connection->id());
+  return res;
 }
 
 }  // namespace tcp
@@ -82,13 +82,13 @@ class TcpClient final {
   std::unordered_map<ConnectionId, InternalConnectionContext> contexts_;
   std::mutex contexts_mutex_;
 
-  bool OnConnected(std::shared_ptr<TcpConnection> tcp_connection);
+  // the contexts are only locked for connecting and closing, the callbacks
+  // of a connection reach its context directly
+  bool OnConnected(InternalConnectionContext* context,
+                   const std::shared_ptr<TcpConnection>& tcp_connection);
 
-  bool OnClosed(std::shared_ptr<TcpConnection> tcp_connection);
-
-  bool OnSent(bool success, std::shared_ptr<TcpConnection> tcp_connection);
-
-  bool OnReceived(std::shared_ptr<TcpConnection> tcp_connection);
+  bool OnClosed(InternalConnectionContext* context,
+                const std::shared_ptr<TcpConnection>& tcp_connection);
 };
 
 }  // namespace tcp
@@ -25,73 +25,308 @@
 // POSSIBILITY OF SUCH DAMAGE.
 //
 #include <cnetpp/tcp/tcp_connection.h>
+#include <cnetpp/tcp/buffer_pool.h>
 #include <cnetpp/tcp/command.h>
 #include <cnetpp/tcp/ring_buffer.h>
 #include <cnetpp/tcp/event_center.h>
 #include <cnetpp/base/socket.h>
 
 #include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 
 namespace cnetpp {
 namespace tcp {
 
+namespace {
+
+// set on the sends using the pages of the packets directly
+#if defined(MSG_ZEROCOPY)
+const int kZeroCopyFlag = MSG_ZEROCOPY;
+#else
+const int kZeroCopyFlag = 0;
+#endif
+
+// the minimum average length of the slices sent with MSG_ZEROCOPY
+const size_t kMinZeroCopySliceLength = 4096;
+
+// the initial size of the receive buffers, unless configured
+const size_t kMinReceiveBufferSize = 4096;
+
+// an empty receive buffer of its initial size is given back once no data
+// has arrived for this long
+const int64_t kReceiveBufferIdleTimeout = 1000;  // ms
+
+// the maximum number of iovecs gathered for one writev()
+#if defined(IOV_MAX)
+const size_t kMaxSendIovecs = IOV_MAX < 1024 ? IOV_MAX : 1024;
+#else
+const size_t kMaxSendIovecs = 1024;
+#endif
+
+}  // namespace
+
 bool TcpConnection::SendPacket() {
-  Command command(static_cast<int>(Command::Type::kReadable) |
-                  static_cast<int>(Command::Type::kWriteable),
-                  shared_from_this());
-  std::shared_ptr<EventCenter> event_center = event_center_.lock();
-  if (!event_center.get()) {
+  return PostCommand(static_cast<int>(Command::Type::kReadable) |
+                     static_cast<int>(Command::Type::kWriteable));
+}
+
+bool TcpConnection::PostCommand(int type) {
+  if (ep_thread_id_ == std::this_thread::get_id()) {
+    // the event center outlives the running event poller threads
+    event_center_ptr_->AddCommand(Command(type, this), false);
+    return true;
+  }
+  auto event_center = event_center_.lock();
+  if (!event_center) {
     return false;
   }
-  event_center->AddCommand(command,
-      ep_thread_id_ != std::this_thread::get_id());
+  event_center->AddCommand(Command(type, shared_from_this()), true);
   return true;
 }
 
 bool TcpConnection::SendPacket(base::StringPiece data) {
-  auto send_buffer = std::make_unique<RingBuffer>(data.size());
-  bool r = send_buffer->Write(data);
-  assert(r);
-  return SendPacket(std::move(send_buffer));
+  return SendPacket(IOBuf::Copy(data));
 }
 
 bool TcpConnection::SendPacket(std::unique_ptr<RingBuffer>&& data) {
+  assert(data);
+  std::shared_ptr<RingBuffer> holder(std::move(data));
+  struct iovec slices[2];
+  holder->GetReadPositions(slices, 2);
+  IOBuf packet;
+  for (auto& slice : slices) {
+    packet.Append(IOBuf(holder,
+                        static_cast<const char*>(slice.iov_base),
+                        slice.iov_len));
+  }
+  return SendPacket(std::move(packet));
+}
+
+bool TcpConnection::SendPacket(IOBuf&& data) {
+  if (ep_thread_id_ == std::this_thread::get_id() && SendDirectly(&data)) {
+    return true;
+  }
+  size_t length = data.Size();
+  bool above_high_watermark = false;
   {
     concurrency::SpinLock::ScopeGuard guard(send_lock_);
     send_buffers_.emplace_back(std::move(data));
+    // before the command, so that it stops polling for reading if paused
+    above_high_watermark = AddQueuedBytes(length);
+  }
+  if (above_high_watermark && high_watermark_callback_) {
+    high_watermark_callback_(
+        std::static_pointer_cast<TcpConnection>(shared_from_this()),
+        queued_bytes());
+  }
+  return SendPacket();
+}
+
+bool TcpConnection::SendDirectly(IOBuf* data) {
+  // Only in the callbacks of this connection's events, whose EventScope
+  // calls the sent callback once they return. Elsewhere, e.g. in a timer or
+  // the callback of another connection, nothing would call it in time.
+  // The large packets go through HandleWriteableEvent() for MSG_ZEROCOPY.
+  if (handling_events_ == 0 ||
+      state_ != State::kConnected || !sending_buffers_.empty() ||
+      !zero_copy_batches_.empty() ||
+      (zero_copy_threshold_ > 0 && data->Size() >= zero_copy_threshold_)) {
+    return false;
+  }
+  {
+    concurrency::SpinLock::ScopeGuard guard(send_lock_);
+    if (!send_buffers_.empty()) {
+      return false;
+    }
+  }
+  struct iovec buffers[kMaxSendIovecs];
+  size_t count = data->GetReadPositions(buffers, kMaxSendIovecs);
+  size_t sent_length = 0;
+  if (!socket_.Send(buffers, count, &sent_length, true)) {
+    // the errors are handled by HandleWriteableEvent()
+    return false;
+  }
+  data->CommitRead(sent_length);
+  if (!data->Empty()) {
+    return false;
+  }
+  // not called here, the caller may hold a lock the callback takes, or
+  // send again from it without bound
+  ++deferred_sent_packets_;
+  return true;
+}
+
+TcpConnection::EventScope::EventScope(TcpConnection* connection)
+    : connection_(connection) {
+  ++connection_->handling_events_;
+}
+
+TcpConnection::EventScope::~EventScope() {
+  if (connection_->handling_events_ == 1) {
+    // still in the scope, so the callbacks may write directly as well
+    connection_->FireDeferredSentCallbacks();
+  }
+  --connection_->handling_events_;
+}
+
+void TcpConnection::FireDeferredSentCallbacks() {
+  while (deferred_sent_packets_ > 0) {
+    size_t num_sent_packets = deferred_sent_packets_;
+    deferred_sent_packets_ = 0;
+    FireSentCallbacks(num_sent_packets);
+  }
+}
+
+bool TcpConnection::SendFile(int fd, off_t offset, size_t length) {
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    return false;
+  }
+  int dup_fd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (dup_fd < 0) {
+    return false;
+  }
+  std::unique_ptr<FileRegion> file(
+      new FileRegion(dup_fd, offset, length, S_ISFIFO(st.st_mode)));
+  {
+    concurrency::SpinLock::ScopeGuard guard(send_lock_);
+    send_buffers_.emplace_back(std::move(file));
   }
   return SendPacket();
 }
 
+TcpConnection::FileRegion::~FileRegion() {
+  ::close(fd);
+}
+
+TimerWheel::TimerId TcpConnection::AddTimer(int64_t delay_ms,
+    const TimerCallbackType& callback) {
+  auto event_center = event_center_.lock();
+  if (!event_center) {
+    return TimerWheel::kInvalidTimerId;
+  }
+  // the timer should not keep the connection alive
+  std::weak_ptr<ConnectionBase> weak_connection = shared_from_this();
+  return event_center->AddTimer(*this, delay_ms,
+      [weak_connection, callback] () {
+        auto connection = weak_connection.lock();
+        if (connection && connection->state() != State::kClosed) {
+          callback(std::static_pointer_cast<TcpConnection>(connection));
+        }
+      });
+}
+
+bool TcpConnection::CancelTimer(TimerWheel::TimerId id) {
+  auto event_center = event_center_.lock();
+  if (!event_center) {
+    return false;
+  }
+  return event_center->CancelTimer(*this, id);
+}
+
+void TcpConnection::ScheduleReceiveBufferShrink() {
+  if (shrink_timer_ != TimerWheel::kInvalidTimerId) {
+    received_since_shrink_timer_ = true;
+    return;
+  }
+  shrink_timer_ = AddTimer(kReceiveBufferIdleTimeout,
+      [] (std::shared_ptr<TcpConnection> c) {
+        c->shrink_timer_ = TimerWheel::kInvalidTimerId;
+        if (c->received_since_shrink_timer_) {
+          // still busy, check again later
+          c->received_since_shrink_timer_ = false;
+          c->ScheduleReceiveBufferShrink();
+        } else if (c->recv_buffer_.Empty()) {
+          // an idle connection holds no receive buffer
+          c->recv_buffer_.Shrink();
+        }
+      });
+}
+
+bool TcpConnection::FinishConnecting(EventCenter* event_center,
+                                     bool* failed) {
+  int error = 0;
+  socklen_t error_length = sizeof(error);
+  if (!socket_.GetOption(SOL_SOCKET, SO_ERROR, &error, &error_length) ||
+      (error && error != EINPROGRESS)) {
+    status_ = error;
+    *failed = true;
+    return false;
+  }
+  base::EndPoint peer;
+  if (error == EINPROGRESS || !socket_.GetPeerEndPoint(&peer)) {
+    if (error != EINPROGRESS &&
+        concurrency::ThisThread::GetLastError() != ENOTCONN) {
+      *failed = true;
+      return false;
+    }
+    // not established yet, it's reported writable when done
+    if (connect_timeout_ > 0 &&
+        connect_timer_ == TimerWheel::kInvalidTimerId) {
+      connect_timer_ = AddTimer(connect_timeout_,
+          [] (std::shared_ptr<TcpConnection> c) {
+            if (c->state() == State::kConnecting) {
+              c->status_ = ETIMEDOUT;
+              c->MarkAsClosed(true);
+            }
+          });
+    }
+    return false;
+  }
+
+  state_ = State::kConnected;
+  if (connect_timer_ != TimerWheel::kInvalidTimerId) {
+    event_center->CancelTimer(*this, connect_timer_);
+    connect_timer_ = TimerWheel::kInvalidTimerId;
+  }
+  if (connected_callback_) {
+    // call callback user defined
+    connected_callback_(
+        std::static_pointer_cast<TcpConnection>(shared_from_this()));
+  }
+  return true;
+}
+
 // This method will be called when a socket fd becomes readable
 void TcpConnection::HandleReadableEvent(EventCenter* event_center) {
+  EventScope scope(this);
   bool closed = false;
 
   if (state_ == State::kConnecting) {
-    int error = 0;
-    socklen_t error_length = sizeof(error);
-    if (!socket_.GetOption(SOL_SOCKET, SO_ERROR, &error, &error_length) ||
-        (error && error != EINPROGRESS)) {
-      closed = true;
-    } else if (error == EINPROGRESS) {
-      return;
-    } else {
-      state_ = State::kConnected;
-      if (connected_callback_) {
-        // call callback user defined
-        connected_callback_(
-            std::static_pointer_cast<TcpConnection>(shared_from_this()));
+    bool failed = false;
+    if (!FinishConnecting(event_center, &failed)) {
+      if (!failed) {
+        return;
       }
+      closed = true;
     }
   }
 
   if (state_ == State::kConnected) {
     // handle new arrival data
-    while (true) {
+    size_t total_received_length = 0;
+    bool budget_used_up = false;
+    // one strong reference serves all the callbacks of this event
+    std::shared_ptr<TcpConnection> self;
+    while (!reading_paused()) {
+      if (read_budget_ > 0 && total_received_length >= read_budget_) {
+        budget_used_up = true;
+        break;
+      }
       if (recv_buffer_.Capacity() - recv_buffer_.Size() < 512) {
-        recv_buffer_.Resize(recv_buffer_.Capacity() + 4096);
+        if (recv_buffer_.Capacity() > 0) {
+          recv_buffer_grown_ = true;
+        }
+        // grow geometrically, so a large message is copied O(log n) times
+        recv_buffer_.Resize(BufferPool::BlockSize(
+            std::max(recv_buffer_.Capacity() * 2,
+                     std::max(receive_buffer_size_, kMinReceiveBufferSize))));
       }
       struct iovec buffers[2];
       recv_buffer_.GetWritePositions(buffers, 2);
@@ -107,129 +342,424 @@ void TcpConnection::HandleReadableEvent(EventCenter* event_center) {
       } else {
         // really received data
         recv_buffer_.CommitWrite(received_length);
-        if (received_callback_) {
-          if (!received_callback_(
-              std::static_pointer_cast<TcpConnection>(shared_from_this()))) {
-            closed = true;
-            break;
-          }
+        total_received_length += received_length;
+        if (!coalesce_received_callbacks_ && !NotifyReceived(&self)) {
+          closed = true;
+          break;
         }
       }
     }
+    if (coalesce_received_callbacks_ && total_received_length > 0) {
+      // the data received before the peer closed is delivered as well
+      if (!NotifyReceived(&self)) {
+        closed = true;
+      }
+    }
+    if (budget_used_up && !closed && event_center->edge_triggered()) {
+      // no more notification will arrive for the data left in the socket in
+      // edge-triggered mode, so resume reading after the other events of
+      // this event poller are handled
+      event_center->AddCommand(
+          Command(static_cast<int>(Command::Type::kReadable),
+                  shared_from_this()),
+          true);
+    }
+    if (total_received_length > 0 && recv_buffer_.Empty()) {
+      if (recv_buffer_grown_) {
+        // grown for a large message, which is rare, so it's given back
+        // to the BufferPool of this thread right away
+        recv_buffer_.Shrink();
+        recv_buffer_grown_ = false;
+      } else {
+        ScheduleReceiveBufferShrink();
+      }
+    }
   }
 
   bool tmp = false;
   if (closed && state_ != State::kClosed) {
     // remove this connection from event center
     Command command(static_cast<int>(Command::Type::kRemoveConnImmediately),
-                    shared_from_this());
+                    this);
     event_center->AddCommand(command, false/* only ep thread could be here */);
   }
 }
 
 void TcpConnection::HandleWriteableEvent(EventCenter* event_center) {
-  send_lock_.Lock();
-  if (send_buffers_.empty()) {
-    send_lock_.Unlock();
+  EventScope scope(this);
+  if (state_ == State::kConnecting) {
+    bool failed = false;
+    if (!FinishConnecting(event_center, &failed)) {
+      if (failed) {
+        Command command(
+            static_cast<int>(Command::Type::kRemoveConnImmediately),
+            this);
+        event_center->AddCommand(command, false);
+      }
+      return;
+    }
+  }
+
+  if (sending_buffers_.empty()) {
+    // take all the queued packets at once, the spinlock is not touched again
+    // until they have been sent
+    concurrency::SpinLock::ScopeGuard guard(send_lock_);
+    sending_buffers_.splice(sending_buffers_.end(), send_buffers_);
+  }
+  if (sending_buffers_.empty()) {
     if (state_ == State::kConnected) {
+      if (event_center->edge_triggered()) {
+        // interest is never re-armed in edge-triggered mode
+        return;
+      }
       Command command(static_cast<int>(Command::Type::kReadable),
-          shared_from_this());
+          this);
       event_center->AddCommand(command, false);
     } else if (state_ == State::kClosing) {
-      Command command(static_cast<int>(Command::Type::kRemoveConnImmediately),
-          shared_from_this());
-      event_center->AddCommand(command, false);
+      if (zero_copy_batches_.empty()) {
+        Command command(
+            static_cast<int>(Command::Type::kRemoveConnImmediately),
+            this);
+        event_center->AddCommand(command, false);
+      } else if (!event_center->edge_triggered()) {
+        // it's closed once the zero-copy sends complete, see
+        // HandleErrorEvent(), stop polling for writable till then
+        Command command(static_cast<int>(Command::Type::kReadable),
+            this);
+        event_center->AddCommand(command, false);
+      }
     }
     // do nothing
     return;
   }
-  send_lock_.Unlock();
 
   bool closed = false;
-  if (state_ == State::kConnecting) {
-    int error = 0;
-    socklen_t error_length = sizeof(error);
-    if (!socket_.GetOption(SOL_SOCKET, SO_ERROR, &error, &error_length) ||
-        (error && error != EINPROGRESS)) {
-      closed = true;
-    } else if (error == EINPROGRESS) {
-      return;
-    } else {
-      state_ = State::kConnected;
-      if (connected_callback_) {
-        // call callback user defined
-        connected_callback_(
-            std::static_pointer_cast<TcpConnection>(shared_from_this()));
-      }
-    }
-  }
-
+  // The sent and the low watermark callbacks are called once the loop is
+  // done. They may send packets or close this connection, which handles the
+  // writable event again right here, and would change sending_buffers_
+  // under the loop.
+  size_t num_sent_packets = 0;
   if (state_ == State::kConnected || state_ == State::kClosing) {
+    struct iovec buffers[kMaxSendIovecs];
     while (true) {
-      send_lock_.Lock();
-      auto& send_buffer = send_buffers_.front();
-      send_lock_.Unlock();
-      size_t sent_length = 0;
-      struct iovec buffers[2];
-      send_buffer->GetReadPositions(buffers, 2);
-      bool ret = socket_.Send(buffers, 2, &sent_length, true);
-      status_ = cnetpp::concurrency::ThisThread::GetLastError();
-      //error_message_ = cnetpp::concurrency::ThisThread::GetLastErrorString();
-      if (!ret && status_ == EAGAIN) {
-        return;
-      } else if (!ret) {
-        closed = true;
-        break;
+      size_t count = 0;
+      size_t gathered_length = 0;
+      bool is_file = sending_buffers_.front().file != nullptr;
+      if (is_file) {
+        gathered_length = sending_buffers_.front().Size();
       } else {
-        if (sent_length > 0) {
-          if (sent_length != send_buffer->Size()) {
-            send_buffer->CommitRead(sent_length);
-            int type = static_cast<int>(Command::Type::kReadable) |
-              static_cast<int>(Command::Type::kWriteable);
-            event_center->AddCommand(Command(type, shared_from_this()), false);
-            return;
-          } else {
-            bool all_sent = false;
-            send_lock_.Lock();
-            send_buffers_.pop_front();
-            if (send_buffers_.empty()) {
-              all_sent = true;
-            }
-            send_lock_.Unlock();
-            if (all_sent && state_ != State::kClosing) {
-              int type = static_cast<int>(Command::Type::kReadable);
-              event_center->AddCommand(Command(type, shared_from_this()),
-                  false);
-            }
-            if (sent_callback_) {
-              sent_callback_(true,
-                  std::static_pointer_cast<TcpConnection>(shared_from_this()));
-            }
-            if (all_sent) {
-              if (state_ == State::kClosing) {
-                closed = true;
-              }
-              break;
-            }
+        count = GatherSendBuffers(buffers, kMaxSendIovecs);
+        for (size_t i = 0; i < count; ++i) {
+          gathered_length += buffers[i].iov_len;
+        }
+      }
+      size_t sent_length = 0;
+      // every slice pins at least one page, so small slices are copied
+      bool zero_copy = !is_file && zero_copy_threshold_ > 0 &&
+          gathered_length >= zero_copy_threshold_ &&
+          gathered_length >= count * kMinZeroCopySliceLength;
+      if (is_file && gathered_length > 0) {
+        if (!SendFileRegion(&sent_length)) {
+          if (status_ == EAGAIN || status_ == EWOULDBLOCK) {
+            writeable_ = false;
+            break;
           }
+          closed = true;
+          break;
+        } else if (sent_length == 0) {
+          // the file is shorter than promised or the pipe has been closed
+          status_ = EIO;
+          closed = true;
+          break;
+        }
+      } else if (gathered_length > 0) {
+        bool ret = false;
+        if (zero_copy) {
+          ret = socket_.Send(buffers, count, &sent_length, kZeroCopyFlag, true);
+          status_ = cnetpp::concurrency::ThisThread::GetLastError();
+          if (!ret && (status_ == ENOBUFS || status_ == EAGAIN ||
+                status_ == EWOULDBLOCK)) {
+            // ENOBUFS means out of the locked memory for pinning pages, and
+            // a zero-copy send may fail with EAGAIN while there is room for
+            // a copy, in which case no writable event follows. Copy it.
+            zero_copy = false;
+          }
+        }
+        if (!zero_copy) {
+          ret = socket_.Send(buffers, count, &sent_length, true);
+          status_ = cnetpp::concurrency::ThisThread::GetLastError();
+        }
+        if (!ret && (status_ == EAGAIN || status_ == EWOULDBLOCK)) {
+          // the write interest stays armed in level-triggered mode
+          writeable_ = false;
+          break;
+        } else if (!ret) {
+          closed = true;
+          break;
+        }
+      }
+
+      if (zero_copy) {
+        // the data must stay untouched until the kernel reports completion,
+        // and so must the sent_callback
+        ZeroCopyBatch batch;
+        batch.seq = zero_copy_seq_++;
+        batch.num_packets = CommitSendBuffers(sent_length, &batch.data);
+        zero_copy_batches_.emplace_back(std::move(batch));
+      } else if (!zero_copy_batches_.empty()) {
+        // keep the sent_callback in order
+        zero_copy_batches_.back().num_packets +=
+            CommitSendBuffers(sent_length, nullptr);
+      } else {
+        num_sent_packets += CommitSendBuffers(sent_length, nullptr);
+      }
+      if (sending_buffers_.empty()) {
+        concurrency::SpinLock::ScopeGuard guard(send_lock_);
+        sending_buffers_.splice(sending_buffers_.end(), send_buffers_);
+      }
+      if (sending_buffers_.empty()) {
+        if (state_ == State::kClosing) {
+          closed = zero_copy_batches_.empty();
+        } else if (!event_center->edge_triggered()) {
+          int type = static_cast<int>(Command::Type::kReadable);
+          event_center->AddCommand(Command(type, this), false);
         }
+        break;
+      }
+      if (sent_length < gathered_length && !event_center->edge_triggered()) {
+        // the socket send buffer is likely full, wait for the next writable
+        // event as the write interest stays armed. In edge-triggered mode
+        // keep writing till EAGAIN, a short write doesn't guarantee an
+        // EPOLLOUT edge, e.g. a MSG_ZEROCOPY send may stop early.
+        break;
       }
     }
   }
 
+  // Inside another event of this connection, e.g. for a packet its received
+  // callback queues in edge-triggered mode, that one calls them as it
+  // returns, so that they are not called inside SendPacket().
+  deferred_sent_packets_ += num_sent_packets;
+  if (handling_events_ == 1) {
+    FireDeferredSentCallbacks();
+  }
+  HandleLowWatermark(event_center);
+  // the callbacks may have closed it already
   if (closed && state_ != State::kClosed) {
     Command command(static_cast<int>(Command::Type::kRemoveConnImmediately),
-                    shared_from_this());
+                    this);
     event_center->AddCommand(command, false);
   }
 }
 
+size_t TcpConnection::GatherSendBuffers(struct iovec* buffers,
+                                        size_t max_count) {
+  size_t count = 0;
+  for (auto& send_buffer : sending_buffers_) {
+    if (count == max_count || send_buffer.file) {
+      break;
+    }
+    count += send_buffer.data.GetReadPositions(buffers + count,
+                                               max_count - count);
+  }
+  return count;
+}
+
+bool TcpConnection::SendFileRegion(size_t* sent_length) {
+  FileRegion* file = sending_buffers_.front().file.get();
+  assert(file);
+  bool ret = false;
+  if (file->pipe) {
+    ret = socket_.Splice(file->fd, file->length, sent_length, true);
+  } else {
+    off_t offset = file->offset;
+    ret = socket_.SendFile(file->fd, &offset, file->length, sent_length, true);
+  }
+  status_ = cnetpp::concurrency::ThisThread::GetLastError();
+  return ret;
+}
+
+size_t TcpConnection::CommitSendBuffers(size_t sent_length, IOBuf* sent) {
+  size_t num_sent_packets = 0;
+  // the packet bytes sent, accounted at once to take send_lock_ once
+  size_t sent_data_length = 0;
+  while (!sending_buffers_.empty()) {
+    auto& send_buffer = sending_buffers_.front();
+    if (send_buffer.Size() > sent_length) {
+      if (!send_buffer.file) {
+        sent_data_length += sent_length;
+      }
+      if (send_buffer.file) {
+        send_buffer.file->offset += sent_length;
+        send_buffer.file->length -= sent_length;
+        break;
+      }
+      if (sent && sent_length > 0) {
+        // the unsent part is kept alive a bit longer, which doesn't matter
+        sent->Append(send_buffer.data);
+      }
+      send_buffer.data.CommitRead(sent_length);
+      break;
+    }
+    sent_length -= send_buffer.Size();
+    if (!send_buffer.file) {
+      sent_data_length += send_buffer.Size();
+    }
+    if (sent) {
+      sent->Append(std::move(send_buffer.data));
+    }
+    sending_buffers_.pop_front();
+    ++num_sent_packets;
+  }
+  if (sent_data_length > 0) {
+    RemoveQueuedBytes(sent_data_length);
+  }
+  return num_sent_packets;
+}
+
+bool TcpConnection::NotifyReceived(std::shared_ptr<TcpConnection>* self) {
+  if (handler_) {
+    return handler_->OnReceived(*this);
+  }
+  if (!received_callback_) {
+    return true;
+  }
+  if (!*self) {
+    *self = std::static_pointer_cast<TcpConnection>(shared_from_this());
+  }
+  return received_callback_(*self);
+}
+
+void TcpConnection::FireSentCallbacks(size_t num_sent_packets) {
+  if (num_sent_packets == 0) {
+    return;
+  }
+  if (handler_) {
+    for (size_t i = 0; i < num_sent_packets && state_ != State::kClosed; ++i) {
+      handler_->OnSent(true, *this);
+    }
+    return;
+  }
+  if (!sent_callback_) {
+    return;
+  }
+  auto connection = std::static_pointer_cast<TcpConnection>(shared_from_this());
+  for (size_t i = 0; i < num_sent_packets && state_ != State::kClosed; ++i) {
+    sent_callback_(true, connection);
+  }
+}
+
+void TcpConnection::SetZeroCopyThreshold(size_t zero_copy_threshold) {
+  if (zero_copy_threshold > 0 && socket_.SetZeroCopy(true)) {
+    zero_copy_threshold_ = zero_copy_threshold;
+    zero_copy_enabled_ = true;
+  } else {
+    zero_copy_threshold_ = 0;
+  }
+}
+
+void TcpConnection::SetSendWatermarks(size_t high_watermark,
+                                      size_t low_watermark,
+                                      bool pause_reading) {
+  high_watermark_ = high_watermark;
+  low_watermark_ = low_watermark;
+  pause_reading_ = pause_reading && high_watermark > 0;
+}
+
+bool TcpConnection::AddQueuedBytes(size_t length) {
+  size_t queued =
+      queued_bytes_.fetch_add(length, std::memory_order_relaxed) + length;
+  if (high_watermark_ == 0 || queued < high_watermark_ ||
+      above_high_watermark_.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  above_high_watermark_.store(true, std::memory_order_relaxed);
+  return true;
+}
+
+void TcpConnection::RemoveQueuedBytes(size_t length) {
+  concurrency::SpinLock::ScopeGuard guard(send_lock_);
+  size_t queued =
+      queued_bytes_.fetch_sub(length, std::memory_order_relaxed) - length;
+  if (queued <= low_watermark_ &&
+      above_high_watermark_.load(std::memory_order_relaxed)) {
+    above_high_watermark_.store(false, std::memory_order_relaxed);
+    low_watermark_reached_ = true;
+  }
+}
+
+void TcpConnection::HandleLowWatermark(EventCenter* event_center) {
+  if (!low_watermark_reached_) {
+    return;
+  }
+  low_watermark_reached_ = false;
+  if (pause_reading_ && !reading_paused()) {
+    // resume reading, the data left in the socket produces no new edge in
+    // edge-triggered mode, and the write interest is kept otherwise
+    int type = static_cast<int>(Command::Type::kReadable);
+    if (!event_center->edge_triggered()) {
+      type |= static_cast<int>(Command::Type::kWriteable);
+    }
+    event_center->AddCommand(Command(type, this), false);
+  }
+  if (low_watermark_callback_) {
+    low_watermark_callback_(
+        std::static_pointer_cast<TcpConnection>(shared_from_this()),
+        queued_bytes());
+  }
+}
+
+bool TcpConnection::HandleErrorEvent(EventCenter* event_center) {
+  if (zero_copy_enabled_) {
+    uint32_t first = 0;
+    uint32_t last = 0;
+    bool copied = false;
+    size_t num_sent_packets = 0;
+    while (socket_.ReceiveZeroCopyCompletion(&first, &last, &copied)) {
+      if (copied) {
+        // e.g. over the loopback, pinning the pages buys nothing
+        zero_copy_threshold_ = 0;
+      }
+      // the completions of a tcp socket arrive in order
+      while (!zero_copy_batches_.empty() &&
+          static_cast<int32_t>(zero_copy_batches_.front().seq - last) <= 0) {
+        num_sent_packets += zero_copy_batches_.front().num_packets;
+        zero_copy_batches_.pop_front();
+      }
+    }
+    FireSentCallbacks(num_sent_packets);
+  }
+
+  int error = 0;
+  socklen_t error_length = sizeof(error);
+  if (!socket_.GetOption(SOL_SOCKET, SO_ERROR, &error, &error_length) ||
+      error != 0) {
+    status_ = error;
+    MarkAsClosed(true);
+    return false;
+  }
+  if (state_ == State::kClosing && zero_copy_batches_.empty()) {
+    // the connection was waiting for the zero-copy sends to complete
+    HandleWriteableEvent(event_center);
+    return false;
+  }
+  return true;
+}
+
 void TcpConnection::HandleCloseConnection() {
+  if (state_ == State::kClosed) {
+    return;
+  }
+  // the deferred packets have been sent, report them before the closed
+  // callback
+  FireDeferredSentCallbacks();
   if (state_ == State::kClosed) {
     return;
   }
   state_ = State::kClosed;
-  if (closed_callback_) {
+  if (handler_) {
+    handler_->OnClosed(*this);
+  } else if (closed_callback_) {
     closed_callback_(
         std::static_pointer_cast<TcpConnection>(shared_from_this()));
   }
@@ -243,12 +773,7 @@ void TcpConnection::MarkAsClosed(bool immediately) {
   } else {
     type = static_cast<int>(Command::Type::kRemoveConn);
   }
-  Command command(type, shared_from_this());
-  auto event_center = event_center_.lock();
-  if (event_center.get()) {
-    event_center->AddCommand(command,
-        ep_thread_id_ != std::this_thread::get_id());
-  }
+  PostCommand(type);
 }
 
 }  // namespace tcp
@@ -28,12 +28,17 @@
 #define CNETPP_TCP_CONNECTION_H_
 
 #include <cnetpp/tcp/connection_base.h>
+#include <cnetpp/tcp/io_buf.h>
 #include <cnetpp/tcp/ring_buffer.h>
 #include <cnetpp/tcp/tcp_callbacks.h>
+#include <cnetpp/tcp/timer_wheel.h>
 #include <cnetpp/base/string_piece.h>
 #include <cnetpp/concurrency/spin_lock.h>
 
+#include <sys/types.h>
+
 #include <atomic>
+#include <deque>
 #include <memory>
 #include <string>
 #include <list>
@@ -58,6 +63,33 @@ class TcpConnection : public ConnectionBase {
     receive_buffer_size_ = recv_buffer_size;
   }
 
+  // see TcpOptions::read_budget()
+  void SetReadBudget(size_t read_budget) {
+    read_budget_ = read_budget;
+  }
+
+  // see TcpOptions::coalesce_received_callbacks()
+  void SetCoalesceReceivedCallbacks(bool coalesce) {
+    coalesce_received_callbacks_ = coalesce;
+  }
+
+  // the writes of at least zero_copy_threshold bytes are sent with
+  // MSG_ZEROCOPY, and their packets are released and reported by
+  // sent_callback only after the kernel completes them. 0 disables it, so
+  // does a socket not supporting SO_ZEROCOPY.
+  void SetZeroCopyThreshold(size_t zero_copy_threshold);
+
+  // see TcpOptions::send_high_watermark(), the low watermark should be less
+  // than the high one
+  void SetSendWatermarks(size_t high_watermark,
+                         size_t low_watermark,
+                         bool pause_reading);
+
+  // the bytes queued by SendPacket() but not written to the socket yet
+  size_t queued_bytes() const {
+    return queued_bytes_.load(std::memory_order_relaxed);
+  }
+
   const RingBuffer& recv_buffer() const {
     return recv_buffer_;
   }
@@ -93,6 +125,20 @@ class TcpConnection : public ConnectionBase {
     sent_callback_ = sent_callback;
   }
 
+  const WatermarkCallbackType& high_watermark_callback() const {
+    return high_watermark_callback_;
+  }
+  void set_high_watermark_callback(const WatermarkCallbackType& callback) {
+    high_watermark_callback_ = callback;
+  }
+
+  const WatermarkCallbackType& low_watermark_callback() const {
+    return low_watermark_callback_;
+  }
+  void set_low_watermark_callback(const WatermarkCallbackType& callback) {
+    low_watermark_callback_ = callback;
+  }
+
   const ReceivedCallbackType& received_callback() const {
     return received_callback_;
   }
@@ -103,6 +149,15 @@ class TcpConnection : public ConnectionBase {
     received_callback_ = received_callback;
   }
 
+  // see TcpServerOptions::handler(), it replaces the closed, sent and
+  // received callbacks
+  TcpHandler* handler() const {
+    return handler_;
+  }
+  void set_handler(TcpHandler* handler) {
+    handler_ = handler;
+  }
+
   std::shared_ptr<void> cookie() {
     return cookie_;
   }
@@ -110,6 +165,16 @@ class TcpConnection : public ConnectionBase {
     cookie_ = cookie;
   }
 
+  // the object of the protocol layered on this connection, e.g. the http
+  // connection, which the callbacks reach without any lookup. It isn't owned
+  // by this connection, and is only accessed by the event poller thread.
+  void* context() const {
+    return context_;
+  }
+  void set_context(void* context) {
+    context_ = context;
+  }
+
   const base::EndPoint& remote_end_point() const {
     return remote_end_point_;
   }
@@ -123,8 +188,41 @@ class TcpConnection : public ConnectionBase {
     remote_end_point_ = std::move(remote_end_point);
   }
 
+  // Every call queues one packet, sent_callback is called once it has been
+  // sent completely.
+  // When called from the callbacks of this connection's own events, e.g. in
+  // the received_callback, the packet is written at once if nothing is
+  // queued ahead of it. Either way, sent_callback is called once that
+  // callback has returned, not inside SendPacket().
+  // The data is copied
   bool SendPacket(base::StringPiece data);
+  // The readable data of the buffer is sent without being copied
   bool SendPacket(std::unique_ptr<RingBuffer>&& data);
+  // The slices are sent without being copied, e.g. adopt a std::string by
+  // SendPacket(IOBuf(std::move(str)))
+  bool SendPacket(IOBuf&& data);
+  // Queue 'length' bytes of the file from 'offset' as one packet, sent by
+  // sendfile() without passing through the user space. If fd refers to a
+  // pipe, the offset is ignored and its data is moved by splice(), the data
+  // should be in the pipe already since only the socket is polled. The fd is
+  // duplicated, so the caller may close it right after the call. The
+  // connection is closed if the file ends before 'length' bytes are sent.
+  bool SendFile(int fd, off_t offset, size_t length);
+
+  // Call 'callback' on the event poller thread of this connection after
+  // delay_ms milliseconds, unless the connection has been closed by then or
+  // the timer has been cancelled. e.g. for idle or request timeouts.
+  // NOTE: they must be called within the event poller thread, i.e. in the
+  // callbacks of this connection
+  TimerWheel::TimerId AddTimer(int64_t delay_ms,
+                               const TimerCallbackType& callback);
+  bool CancelTimer(TimerWheel::TimerId id);
+
+  // the connection is closed with status ETIMEDOUT if it's not established
+  // in connect_timeout milliseconds, 0 means no timeout
+  void set_connect_timeout(int64_t connect_timeout) {
+    connect_timeout_ = connect_timeout;
+  }
 
   // These three methods will be called by the event poller thread when a
   // socket fd becomes readable or writable
@@ -132,6 +230,11 @@ class TcpConnection : public ConnectionBase {
   void HandleReadableEvent(EventCenter* event_center) override;
   void HandleWriteableEvent(EventCenter* event_center) override;
   void HandleCloseConnection() override;
+  bool HandleErrorEvent(EventCenter* event_center) override;
+  bool reading_paused() const override {
+    return pause_reading_ &&
+        above_high_watermark_.load(std::memory_order_relaxed);
+  }
 
   void MarkAsClosed(bool immediately = true) override;
 
@@ -142,24 +245,159 @@ class TcpConnection : public ConnectionBase {
   }
 
   bool SendPacket();
+  // process a command of this connection at once if called by the event
+  // poller thread, which touches no reference count, otherwise queue it
+  bool PostCommand(int type);
+
+  // call the handler or the received callback, '*self' holds the strong
+  // reference the callback takes, created once for a readable event
+  bool NotifyReceived(std::shared_ptr<TcpConnection>* self);
+  // write the packet directly while an event of this connection is handled,
+  // return true if it has been sent completely, otherwise the unsent part is
+  // left in 'data'. Its sent callback is deferred to deferred_sent_packets_.
+  bool SendDirectly(IOBuf* data);
+
+  // counts the event handlers of this connection on the stack, the outermost
+  // one calls the deferred sent callbacks as it returns
+  class EventScope {
+   public:
+    explicit EventScope(TcpConnection* connection);
+    ~EventScope();
+    EventScope(const EventScope&) = delete;
+    EventScope& operator=(const EventScope&) = delete;
+
+   private:
+    TcpConnection* connection_;
+  };
+  // call the deferred sent callbacks, including those of the packets the
+  // callbacks send directly in turn
+  void FireDeferredSentCallbacks();
+
+  // check the result of the non-blocking connect, return false if it's still
+  // in progress or failed, in the latter case *failed is set to true
+  bool FinishConnecting(EventCenter* event_center, bool* failed);
+
+  // arm shrink_timer_ unless it's armed already
+  void ScheduleReceiveBufferShrink();
 
   base::EndPoint remote_end_point_;
 
   int status_ { 0 }; // equal to errno
   std::string error_message_;
 
+  // fill 'buffers' with at most max_count slices of the unsent data in
+  // sending_buffers_, return the number of iovecs filled. It stops at the
+  // first file packet.
+  size_t GatherSendBuffers(struct iovec* buffers, size_t max_count);
+  // consume sent_length bytes from the front of sending_buffers_, return the
+  // number of packets sent completely. The sent data is appended to 'sent'
+  // if it's not null.
+  size_t CommitSendBuffers(size_t sent_length, IOBuf* sent);
+  // a callback may close this connection, the rest are not called then
+  void FireSentCallbacks(size_t num_sent_packets);
+  // send the file packet at the front of sending_buffers_
+  bool SendFileRegion(size_t* sent_length);
+  // account the bytes queued by any thread and written by the event poller
+  // thread. Both are done under send_lock_, so that the bytes of a packet
+  // are never removed before they are added. AddQueuedBytes() must be called
+  // with send_lock_ held, and returns true on crossing the high watermark,
+  // whose callback is called by the caller once the lock is released.
+  bool AddQueuedBytes(size_t length);
+  void RemoveQueuedBytes(size_t length);
+  // called out of CommitSendBuffers(), as resuming reading may send packets
+  void HandleLowWatermark(EventCenter* event_center);
+
+  // the part of a file queued by SendFile() which is not sent yet
+  struct FileRegion {
+    FileRegion(int fd, off_t offset, size_t length, bool pipe)
+        : fd(fd), offset(offset), length(length), pipe(pipe) {
+    }
+    ~FileRegion();
+    FileRegion(const FileRegion&) = delete;
+    FileRegion& operator=(const FileRegion&) = delete;
+
+    int fd;  // owned
+    off_t offset;
+    size_t length;
+    bool pipe;
+  };
+
+  // a packet queued by SendPacket() or SendFile()
+  struct SendBuffer {
+    explicit SendBuffer(IOBuf&& data) : data(std::move(data)) {
+    }
+    explicit SendBuffer(std::unique_ptr<FileRegion>&& file)
+        : file(std::move(file)) {
+    }
+
+    size_t Size() const {
+      return file ? file->length : data.Size();
+    }
+
+    IOBuf data;
+    std::unique_ptr<FileRegion> file;
+  };
+
   concurrency::SpinLock send_lock_;
-  std::list<std::unique_ptr<RingBuffer>> send_buffers_;
+  // the packets queued by SendPacket(), protected by send_lock_
+  std::list<SendBuffer> send_buffers_;
+  // the packets taken from send_buffers_ and being sent, only accessed by the
+  // event poller thread
+  std::list<SendBuffer> sending_buffers_;
+
+  // modified under send_lock_, read without it
+  std::atomic<size_t> queued_bytes_ { 0 };
+  size_t high_watermark_ { 0 };
+  size_t low_watermark_ { 0 };
+  bool pause_reading_ { false };
+  // modified under send_lock_, read without it
+  std::atomic<bool> above_high_watermark_ { false };
+  // only accessed by the event poller thread
+  bool low_watermark_reached_ { false };
+  WatermarkCallbackType high_watermark_callback_ { nullptr };
+  WatermarkCallbackType low_watermark_callback_ { nullptr };
 
   RingBuffer recv_buffer_;
+  // the receive buffer grew past its initial size since it was allocated
+  bool recv_buffer_grown_ { false };
+  // gives back the empty receive buffer of an idle connection, data arrived
+  // since it was armed defers it once more
+  TimerWheel::TimerId shrink_timer_ { TimerWheel::kInvalidTimerId };
+  bool received_since_shrink_timer_ { false };
+  size_t read_budget_ { 0 };
+  bool coalesce_received_callbacks_ { false };
 
-  size_t receive_buffer_size_;
-  size_t send_buffer_size_;
+  size_t receive_buffer_size_ { 0 };
+  size_t send_buffer_size_ { 0 };
 
   ClosedCallbackType closed_callback_ { nullptr };
   SentCallbackType sent_callback_ { nullptr };
   ReceivedCallbackType received_callback_ { nullptr };
+  TcpHandler* handler_ { nullptr };
   std::shared_ptr<void> cookie_ { nullptr };
+  void* context_ { nullptr };
+
+  // the data of a MSG_ZEROCOPY send, kept until the kernel completes it
+  struct ZeroCopyBatch {
+    uint32_t seq { 0 };
+    IOBuf data;
+    // the packets completed by this send and the following copied ones
+    size_t num_packets { 0 };
+  };
+  size_t zero_copy_threshold_ { 0 };
+  bool zero_copy_enabled_ { false };
+  // the sequence number the kernel assigns to the next zero-copy send
+  uint32_t zero_copy_seq_ { 0 };
+  std::deque<ZeroCopyBatch> zero_copy_batches_;
+
+  // the depth of EventScope, and the packets sent by SendDirectly() or by a
+  // nested writable event whose sent callbacks are not called yet, only
+  // accessed by the event poller thread
+  int handling_events_ { 0 };
+  size_t deferred_sent_packets_ { 0 };
+
+  int64_t connect_timeout_ { 0 };
+  TimerWheel::TimerId connect_timer_ { TimerWheel::kInvalidTimerId };
 };
 
 }  // namespace tcp
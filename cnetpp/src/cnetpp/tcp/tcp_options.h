@@ -29,6 +29,7 @@
 
 #include <memory>
 #include <functional>
+#include <vector>
 
 #include "event_center.h"
 #include "tcp_callbacks.h"
@@ -49,6 +50,26 @@ class TcpOptions {
     worker_count_ = worker_count;
   }
 
+  // the i-th worker (event poller thread) is pinned on
+  // worker_cpu_affinity[i % worker_cpu_affinity.size()], e.g. the cpu serving
+  // the matching NIC RSS queue. Empty means no pinning.
+  const std::vector<int>& worker_cpu_affinity() const {
+    return worker_cpu_affinity_;
+  }
+  void set_worker_cpu_affinity(const std::vector<int>& cpus) {
+    worker_cpu_affinity_ = cpus;
+  }
+
+  // the i-th worker allocates its memory from the numa node
+  // worker_numa_nodes[i % worker_numa_nodes.size()], and runs on the cpus of
+  // that node unless worker_cpu_affinity is set. Empty means no preference.
+  const std::vector<int>& worker_numa_nodes() const {
+    return worker_numa_nodes_;
+  }
+  void set_worker_numa_nodes(const std::vector<int>& numa_nodes) {
+    worker_numa_nodes_ = numa_nodes;
+  }
+
   size_t max_command_queue_len() const {
     return max_command_queue_len_;
   }
@@ -84,6 +105,139 @@ class TcpOptions {
     receive_buffer_size_ = size;
   }
 
+  // the maximum number of bytes read from a connection for one readable
+  // event, the rest is read after the other connections on the same event
+  // poller are served, so that a fast sender can't starve them. 0 means
+  // reading till the socket is drained.
+  size_t read_budget() const {
+    return read_budget_;
+  }
+  void set_read_budget(size_t read_budget) {
+    read_budget_ = read_budget;
+  }
+
+  // If true, the received callback is called once per readable event after
+  // reading as much as the read budget allows, rather than after every
+  // read from the socket
+  bool coalesce_received_callbacks() const {
+    return coalesce_received_callbacks_;
+  }
+  void set_coalesce_received_callbacks(bool coalesce) {
+    coalesce_received_callbacks_ = coalesce;
+  }
+
+  // If true, the receive buffers are mapped twice back to back, so that the
+  // received data is always contiguous and finding a delimiter in it never
+  // moves the data, see RingBuffer::SetMirrored(). Every buffer takes two
+  // memory mappings, mind vm.max_map_count with many connections.
+  bool mirrored_receive_buffer() const {
+    return mirrored_receive_buffer_;
+  }
+  void set_mirrored_receive_buffer(bool mirrored_receive_buffer) {
+    mirrored_receive_buffer_ = mirrored_receive_buffer;
+  }
+
+  // If true, sockets are registered with EPOLLET once and the connections
+  // track their own readiness, so no epoll_ctl is needed on every send.
+  // Only the epoll event poller supports it, the io_uring one always works in
+  // this mode and the others ignore this option.
+  bool edge_triggered() const {
+    return edge_triggered_;
+  }
+  void set_edge_triggered(bool edge_triggered) {
+    edge_triggered_ = edge_triggered;
+  }
+
+  // how new connections are distributed among the event pollers
+  EventCenter::PlacementPolicy placement_policy() const {
+    return placement_policy_;
+  }
+  void set_placement_policy(EventCenter::PlacementPolicy placement_policy) {
+    placement_policy_ = placement_policy;
+  }
+
+  // the event poller implementation, it falls back to the default one if the
+  // platform or the kernel doesn't support it
+  EventPoller::Type event_poller_type() const {
+    return event_poller_type_;
+  }
+  void set_event_poller_type(EventPoller::Type event_poller_type) {
+    event_poller_type_ = event_poller_type;
+  }
+
+  // If positive, the epoll event poller spins on a non-blocking epoll_wait()
+  // for at most this many microseconds before it blocks. The budget actually
+  // spent adapts to the observed event inter-arrival time, so an idle event
+  // poller stops spinning. 0 disables busy polling.
+  int64_t busy_poll_us() const {
+    return busy_poll_us_;
+  }
+  void set_busy_poll_us(int64_t busy_poll_us) {
+    busy_poll_us_ = busy_poll_us;
+  }
+
+  // If positive, SO_BUSY_POLL is set to this many microseconds together with
+  // SO_PREFER_BUSY_POLL on the sockets, so that the kernel polls the device
+  // queue on receiving. Raising it above net.core.busy_read may require
+  // CAP_NET_ADMIN, and a failure is only logged. 0 leaves the sockets alone.
+  int socket_busy_poll_us() const {
+    return socket_busy_poll_us_;
+  }
+  void set_socket_busy_poll_us(int socket_busy_poll_us) {
+    socket_busy_poll_us_ = socket_busy_poll_us;
+  }
+
+  // the writes of at least this many bytes are sent with MSG_ZEROCOPY, which
+  // saves copying large payloads into the kernel at the cost of pinning
+  // pages and reading completions. The packets are released and reported by
+  // the sent callback once the kernel completes them. 0 disables it.
+  size_t zero_copy_threshold() const {
+    return zero_copy_threshold_;
+  }
+  void set_zero_copy_threshold(size_t zero_copy_threshold) {
+    zero_copy_threshold_ = zero_copy_threshold;
+  }
+
+  // the bytes of the packets queued on a connection but not written to the
+  // socket yet. Once they reach send_high_watermark the high watermark
+  // callback is called by the thread queuing the packet, and once they drop
+  // to send_low_watermark the low watermark callback is called by the event
+  // poller thread. 0 disables them. The files queued by SendFile() are not
+  // counted since they don't take memory.
+  size_t send_high_watermark() const {
+    return send_high_watermark_;
+  }
+  void set_send_high_watermark(size_t send_high_watermark) {
+    send_high_watermark_ = send_high_watermark;
+  }
+  size_t send_low_watermark() const {
+    return send_low_watermark_;
+  }
+  void set_send_low_watermark(size_t send_low_watermark) {
+    send_low_watermark_ = send_low_watermark;
+  }
+
+  // If true, a connection stops reading from its socket from reaching the
+  // high watermark till dropping to the low watermark, so that a peer not
+  // reading the responses can't make us buffer without bound
+  bool pause_reading_on_high_watermark() const {
+    return pause_reading_on_high_watermark_;
+  }
+  void set_pause_reading_on_high_watermark(bool pause_reading) {
+    pause_reading_on_high_watermark_ = pause_reading;
+  }
+
+  // If positive, TCP_NOTSENT_LOWAT is set to this many bytes on the sockets,
+  // which keeps the unsent data in the kernel short and leaves it queued on
+  // the connection instead, where the watermarks apply. 0 leaves the sockets
+  // alone.
+  int tcp_not_sent_lowat() const {
+    return tcp_not_sent_lowat_;
+  }
+  void set_tcp_not_sent_lowat(int tcp_not_sent_lowat) {
+    tcp_not_sent_lowat_ = tcp_not_sent_lowat;
+  }
+
   const ConnectedCallbackType& connected_callback() const {
     return connected_callback_;
   }
@@ -124,17 +278,56 @@ class TcpOptions {
     sent_callback_ = sent_callback;
   }
 
+  const WatermarkCallbackType& high_watermark_callback() const {
+    return high_watermark_callback_;
+  }
+  WatermarkCallbackType& mutable_high_watermark_callback() {
+    return high_watermark_callback_;
+  }
+  void set_high_watermark_callback(const WatermarkCallbackType& callback) {
+    high_watermark_callback_ = callback;
+  }
+
+  const WatermarkCallbackType& low_watermark_callback() const {
+    return low_watermark_callback_;
+  }
+  WatermarkCallbackType& mutable_low_watermark_callback() {
+    return low_watermark_callback_;
+  }
+  void set_low_watermark_callback(const WatermarkCallbackType& callback) {
+    low_watermark_callback_ = callback;
+  }
+
  private:
   size_t worker_count_ { 0 };
+  std::vector<int> worker_cpu_affinity_;
+  std::vector<int> worker_numa_nodes_;
   size_t max_command_queue_len_ { 1024 };
   size_t tcp_send_buffer_size_ { 32 * 1024 };
   size_t tcp_receive_buffer_size_ { 32 * 1024 };
   size_t send_buffer_size_ { 0 };
   size_t receive_buffer_size_ { 0 };
+  bool mirrored_receive_buffer_ { false };
+  size_t read_budget_ { 0 };
+  bool coalesce_received_callbacks_ { false };
+  bool edge_triggered_ { false };
+  EventCenter::PlacementPolicy placement_policy_ {
+    EventCenter::PlacementPolicy::kRoundRobin
+  };
+  EventPoller::Type event_poller_type_ { EventPoller::Type::kDefault };
+  int64_t busy_poll_us_ { 0 };
+  int socket_busy_poll_us_ { 0 };
+  size_t zero_copy_threshold_ { 0 };
+  size_t send_high_watermark_ { 0 };
+  size_t send_low_watermark_ { 0 };
+  bool pause_reading_on_high_watermark_ { false };
+  int tcp_not_sent_lowat_ { 0 };
   ConnectedCallbackType connected_callback_ { nullptr };
   ClosedCallbackType closed_callback_ { nullptr };
   ReceivedCallbackType received_callback_ { nullptr };
   SentCallbackType sent_callback_ { nullptr };
+  WatermarkCallbackType high_watermark_callback_ { nullptr };
+  WatermarkCallbackType low_watermark_callback_ { nullptr };
 };
 
 class TcpServerOptions final : public TcpOptions {
@@ -149,14 +342,58 @@ class TcpServerOptions final : public TcpOptions {
     name_ = name;
   }
 
+  // If true, every event poller owns a SO_REUSEPORT listen socket bound to
+  // the same address, and serves the connections it accepted by itself
+  bool reuse_port() const {
+    return reuse_port_;
+  }
+  void set_reuse_port(bool reuse_port) {
+    reuse_port_ = reuse_port;
+  }
+
+  // the maximum number of connections accepted for one readable event of
+  // the listen socket, so that the other connections on the same event
+  // poller are not starved during a connection storm
+  size_t accept_budget() const {
+    return accept_budget_;
+  }
+  void set_accept_budget(size_t accept_budget) {
+    accept_budget_ = accept_budget;
+  }
+
+  // If set, the accepted connections call this handler instead of the
+  // connected, received, sent and closed callbacks. It must outlive the
+  // server, TcpHandlerServer sets it to the handler it owns.
+  TcpHandler* handler() const {
+    return handler_;
+  }
+  void set_handler(TcpHandler* handler) {
+    handler_ = handler;
+  }
+
  private:
   std::string name_ { "dft" };
+  bool reuse_port_ { false };
+  size_t accept_budget_ { 64 };
+  TcpHandler* handler_ { nullptr };
 };
 
 class TcpClientOptions final : public TcpOptions {
  public:
   TcpClientOptions() = default;
   virtual ~TcpClientOptions() = default;
+
+  // in milliseconds, the connection is closed if it's not established in
+  // time, 0 means no timeout
+  int64_t connect_timeout() const {
+    return connect_timeout_;
+  }
+  void set_connect_timeout(int64_t connect_timeout) {
+    connect_timeout_ = connect_timeout;
+  }
+
+ private:
+  int64_t connect_timeout_ { 0 };
 };
 
 }  // namespace tcp
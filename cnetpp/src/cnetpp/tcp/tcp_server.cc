@@ -28,58 +28,184 @@
 #include <cnetpp/tcp/connection_factory.h>
 #include <cnetpp/tcp/listen_connection.h>
 #include <cnetpp/base/socket.h>
+#include <cnetpp/base/log.h>
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/tcp.h>
 #include <netinet/in.h>
+#include <unistd.h>
+
+#include <vector>
 
 namespace cnetpp {
 namespace tcp {
 
+namespace {
+
+// A socket file left by a server which wasn't shut down makes binding to its
+// path fail. It's removed unless a server still accepts on it, and a regular
+// file given by mistake is never removed.
+void RemoveStaleSocketFile(const base::EndPoint& local_address) {
+  struct stat st;
+  const auto& path = local_address.unix_path();
+  if (::lstat(path.c_str(), &st) != 0 || !S_ISSOCK(st.st_mode)) {
+    return;
+  }
+  base::TcpSocket probe;
+  if (probe.Create(local_address) && !probe.Connect(local_address) &&
+      base::Socket::GetLastError() == ECONNREFUSED) {
+    ::unlink(path.c_str());
+  }
+}
+
+// Removes the listen connections added by a Launch() which fails half way,
+// also when a listen socket throws as it can't be bound, so that no event
+// poller is left accepting on its own.
+class ListenerRollback final {
+ public:
+  explicit ListenerRollback(EventCenter* event_center)
+      : event_center_(event_center) {
+  }
+  ~ListenerRollback() {
+    // the listen sockets are closed once the connections are removed
+    for (auto& listener : listeners_) {
+      event_center_->AddCommand(Command(
+          static_cast<int>(Command::Type::kRemoveConnImmediately), listener),
+          true);
+    }
+  }
+  ListenerRollback(const ListenerRollback&) = delete;
+  ListenerRollback& operator=(const ListenerRollback&) = delete;
+
+  void Add(std::shared_ptr<ConnectionBase> listener) {
+    listeners_.emplace_back(std::move(listener));
+  }
+  // all of them are added, keep them
+  void Commit() {
+    listeners_.clear();
+  }
+
+ private:
+  EventCenter* event_center_;
+  std::vector<std::shared_ptr<ConnectionBase>> listeners_;
+};
+
+}  // namespace
+
 bool TcpServer::Launch(const base::EndPoint& local_address,
                        const TcpServerOptions& options) {
-  event_center_ = EventCenter::New(options.name(), options.worker_count());
+  event_center_ = EventCenter::New(options.name(), options);
   assert(event_center_.get());
   if (!event_center_->Launch()) {
     return false;
   }
 
+  listen_address_ = local_address;
+  if (local_address.IsUnixDomain()) {
+    // only one socket can be bound to a path, so the accepted connections
+    // are spread among the event pollers as usual
+    TcpServerOptions unix_options(options);
+    unix_options.set_reuse_port(false);
+    if (local_address.IsAbstractUnixDomain()) {
+      return Listen(local_address, unix_options, -1);
+    }
+    RemoveStaleSocketFile(local_address);
+    if (!Listen(local_address, unix_options, -1)) {
+      // the path may belong to another server which is still running
+      return false;
+    }
+    unix_path_ = local_address.unix_path();
+    return true;
+  }
+
+  // Without reuse_port one listen socket serves all the event pollers.
+  // Otherwise every event poller accepts on its own, and the kernel spreads
+  // the incoming connections among them. They must share the port, so an
+  // ephemeral one is chosen by the first and reused by the others.
+  size_t num_listeners = options.reuse_port() ? event_center_->thread_num() : 1;
+  ListenerRollback rollback(event_center_.get());
+  for (size_t i = 0; i < num_listeners; ++i) {
+    int event_poller_id = options.reuse_port() ? static_cast<int>(i) : -1;
+    std::shared_ptr<ConnectionBase> listener;
+    if (!Listen(listen_address_, options, event_poller_id, &listener)) {
+      return false;
+    }
+    rollback.Add(listener);
+    if (listen_address_.port() == 0 &&
+        !listener->socket().GetLocalEndPoint(&listen_address_)) {
+      return false;
+    }
+  }
+  rollback.Commit();
+  return true;
+}
+
+bool TcpServer::Listen(const base::EndPoint& local_address,
+                       const TcpServerOptions& options,
+                       int event_poller_id,
+                       std::shared_ptr<ConnectionBase>* listener) {
   // create listen socket
-  base::ListenSocket listen_socket(local_address);
+  base::ListenSocket listen_socket(local_address, options.reuse_port());
   if (!listen_socket.IsValid()) {
     return false;
   }
 
+  // the tcp options don't apply to the unix domain sockets
+  bool is_tcp = !local_address.IsUnixDomain();
   if (!listen_socket.SetCloexec(true) ||
       !listen_socket.SetBlocking(false) ||
       !listen_socket.SetReceiveBufferSize(options.tcp_receive_buffer_size()) ||
       !listen_socket.SetSendBufferSize(options.tcp_send_buffer_size()) ||
       !listen_socket.SetReuseAddress(true) ||
+      (is_tcp && !listen_socket.SetTcpNoDelay(true)) ||
+      !listen_socket.SetKeepAlive(true) ||
       !listen_socket.Listen()) {
     return false;
   }
+  // the accepted sockets inherit the busy polling options
+  if (options.socket_busy_poll_us() > 0 &&
+      (!listen_socket.SetBusyPoll(options.socket_busy_poll_us()) ||
+       !listen_socket.SetPreferBusyPoll(true))) {
+    Info("Failed to enable busy polling on the listen socket of %s",
+         local_address.ToString().c_str());
+  }
+  if (is_tcp && options.tcp_not_sent_lowat() > 0 &&
+      !listen_socket.SetTcpNotSentLowat(options.tcp_not_sent_lowat())) {
+    Info("Failed to set TCP_NOTSENT_LOWAT on the listen socket of %s",
+         local_address.ToString().c_str());
+  }
 
   ConnectionFactory cf;
   auto connection =
       cf.CreateConnection(event_center_, listen_socket.fd(), true);
   assert(connection.get());
   connection->set_connected_callback(options.connected_callback());
-  auto listener = std::static_pointer_cast<ListenConnection>(connection);
-  listener->set_tcp_server_options(options);
+  connection->set_event_poller_id(event_poller_id);
+  auto listen_connection =
+      std::static_pointer_cast<ListenConnection>(connection);
+  listen_connection->set_tcp_server_options(options);
 
   // add the listen fd onto multiplexer
   Command cmd(static_cast<int>(Command::Type::kAddConn),
-              std::static_pointer_cast<ConnectionBase>(listener));
-  event_center_->AddCommand(cmd, true);
+              std::static_pointer_cast<ConnectionBase>(listen_connection));
+  event_center_->AddCommand(std::move(cmd), true);
 
   listen_socket.Detach();
+  if (listener) {
+    *listener = listen_connection;
+  }
   return true;
 }
 
 bool TcpServer::Shutdown() {
   event_center_->Shutdown();
+  if (!unix_path_.empty()) {
+    ::unlink(unix_path_.c_str());
+    unix_path_.clear();
+  }
   return true;
 }
 
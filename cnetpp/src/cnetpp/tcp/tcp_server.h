@@ -34,6 +34,8 @@
 
 #include <memory>
 #include <functional>
+#include <string>
+#include <utility>
 
 namespace cnetpp {
 namespace tcp {
@@ -45,12 +47,32 @@ const size_t kDefaultMaxCommandQueueLen = 1024;
 class TcpServer final {
  public:
   // you must first call this method before you do any requests
+  // local_address may be a unix domain socket, see EndPoint::UnixDomain(),
+  // whose socket file is removed on Shutdown()
   bool Launch(const base::EndPoint& local_address,
               const TcpServerOptions& options = TcpServerOptions());
   bool Shutdown();
 
+  // the address Launch() listens on, with the port chosen by the kernel if
+  // it was 0 in local_address
+  const base::EndPoint& listen_address() const {
+    return listen_address_;
+  }
+
  private:
   std::shared_ptr<EventCenter> event_center_;
+  base::EndPoint listen_address_;
+
+  // create a listen socket and add it onto the given event poller, a
+  // negative event_poller_id lets the event center choose one. The listen
+  // connection is stored in '*listener' if it's not null.
+  bool Listen(const base::EndPoint& local_address,
+              const TcpServerOptions& options,
+              int event_poller_id,
+              std::shared_ptr<ConnectionBase>* listener = nullptr);
+
+  // the socket file bound by a unix domain listen socket
+  std::string unix_path_;
 
   // all callbacks
   ConnectedCallbackType connected_callback_;
@@ -59,6 +81,64 @@ class TcpServer final {
   SentCallbackType sent_callback_;
 };
 
+// TcpHandlerServer serves all the accepted connections with one Handler known
+// at compile time, instead of the callbacks of TcpServerOptions, so that no
+// connection copies any std::function and every event is passed to the
+// handler by reference. Handler has the methods of TcpHandler, e.g.
+//
+//   struct EchoHandler {
+//     bool OnConnected(TcpConnection& connection);
+//     bool OnReceived(TcpConnection& connection);
+//     bool OnSent(bool success, TcpConnection& connection);
+//     bool OnClosed(TcpConnection& connection);
+//   };
+//   TcpHandlerServer<EchoHandler> server;
+//   server.Launch(local_address, options);
+//
+// The handler is called by all the event poller threads at the same time.
+template <typename Handler>
+class TcpHandlerServer final {
+ public:
+  template <typename... Args>
+  explicit TcpHandlerServer(Args&&... args)
+      : handler_(std::forward<Args>(args)...) {
+  }
+
+  ~TcpHandlerServer() {
+    // the event pollers must stop calling the handler before it's destroyed
+    Shutdown();
+  }
+
+  Handler& handler() {
+    return handler_.handler();
+  }
+
+  bool Launch(const base::EndPoint& local_address,
+              const TcpServerOptions& options = TcpServerOptions()) {
+    TcpServerOptions handler_options(options);
+    handler_options.set_handler(&handler_);
+    launched_ = true;
+    return server_.Launch(local_address, handler_options);
+  }
+
+  bool Shutdown() {
+    if (!launched_) {
+      return true;
+    }
+    launched_ = false;
+    return server_.Shutdown();
+  }
+
+  const base::EndPoint& listen_address() const {
+    return server_.listen_address();
+  }
+
+ private:
+  TcpHandlerAdapter<Handler> handler_;
+  TcpServer server_;
+  bool launched_ { false };
+};
+
 }  // namespace tcp
 }  // namespace cnetpp
 
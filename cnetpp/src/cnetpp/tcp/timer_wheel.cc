@@ -0,0 +1,245 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/tcp/timer_wheel.h>
+
+#include <assert.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace cnetpp {
+namespace tcp {
+
+const TimerWheel::TimerId TimerWheel::kInvalidTimerId;
+const int32_t TimerWheel::kNil;
+
+TimerWheel::TimerWheel(int64_t now)
+    : current_(now),
+      slots_(kLevels * kSlots + 1, kNil),
+      tails_(kLevels * kSlots + 1, kNil) {
+}
+
+TimerWheel::TimerId TimerWheel::Add(int64_t expire, Callback callback) {
+  int32_t index = AllocateNode();
+  nodes_[index].expire = expire;
+  nodes_[index].callback = std::move(callback);
+  Link(index);
+  ++size_;
+  // the index is increased by one, so that a valid id is never 0
+  return (static_cast<TimerId>(nodes_[index].generation) << 32) |
+      static_cast<uint32_t>(index + 1);
+}
+
+bool TimerWheel::Cancel(TimerId id) {
+  int64_t index = static_cast<int64_t>(id & 0xffffffffu) - 1;
+  if (index < 0 || index >= static_cast<int64_t>(nodes_.size())) {
+    return false;
+  }
+  auto& node = nodes_[index];
+  if (node.slot == kNil || node.generation != static_cast<uint32_t>(id >> 32)) {
+    return false;
+  }
+  Unlink(static_cast<int32_t>(index));
+  FreeNode(static_cast<int32_t>(index));
+  --size_;
+  return true;
+}
+
+size_t TimerWheel::Advance(int64_t now) {
+  size_t count = 0;
+  while (current_ <= now) {
+    // skip the ticks having nothing to do
+    int64_t next = size_ > 0 ? NextTick() : now + 1;
+    if (next > now) {
+      current_ = now + 1;
+      break;
+    }
+    current_ = next;
+
+    int index = static_cast<int>(current_ & kSlotMask);
+    if (index == 0) {
+      // the lowest level wraps around, bring the timers of the next slot of
+      // the upper levels down
+      for (int level = 1; level < kLevels; ++level) {
+        int i = static_cast<int>(
+            (current_ >> (level * kLevelBits)) & kSlotMask);
+        Cascade(level, i);
+        if (i != 0) {
+          break;
+        }
+      }
+    }
+
+    // timers added by the callbacks below must not go into this slot again
+    slots_[kRunningSlot] = slots_[index];
+    tails_[kRunningSlot] = tails_[index];
+    for (int32_t i = slots_[index]; i != kNil; i = nodes_[i].next) {
+      nodes_[i].slot = kRunningSlot;
+    }
+    slots_[index] = tails_[index] = kNil;
+    ++current_;
+
+    while (slots_[kRunningSlot] != kNil) {
+      int32_t i = slots_[kRunningSlot];
+      Unlink(i);
+      Callback callback = std::move(nodes_[i].callback);
+      FreeNode(i);
+      --size_;
+      ++count;
+      callback();
+    }
+  }
+  return count;
+}
+
+int64_t TimerWheel::NextTimeout(int64_t now) const {
+  if (size_ == 0) {
+    return -1;
+  }
+  return std::max<int64_t>(NextTick() - now, 0);
+}
+
+int64_t TimerWheel::NextTick() const {
+  // all the timers of the lowest level expire within one round from
+  // current_, and those which expired already are in the current slot
+  int64_t next = std::numeric_limits<int64_t>::max();
+  for (int64_t tick = current_; tick < current_ + kSlots; ++tick) {
+    if (slots_[tick & kSlotMask] != kNil) {
+      next = tick;
+      break;
+    }
+  }
+  // a slot of an upper level is cascaded when all the lower levels wrap
+  // around to it
+  for (int level = 1; level < kLevels; ++level) {
+    int shift = level * kLevelBits;
+    int64_t block = current_ >> shift;
+    bool at_boundary = (block << shift) == current_;
+    int64_t first = at_boundary ? block : block + 1;
+    if ((first << shift) >= next) {
+      // neither this level nor the upper ones can be earlier
+      break;
+    }
+    for (int64_t i = first - block; i <= kSlots; ++i) {
+      int64_t tick = (block + i) << shift;
+      if (tick >= next) {
+        break;
+      }
+      if (slots_[level * kSlots + ((block + i) & kSlotMask)] != kNil) {
+        next = tick;
+        break;
+      }
+    }
+  }
+  return next;
+}
+
+int32_t TimerWheel::AllocateNode() {
+  if (!free_nodes_.empty()) {
+    int32_t index = free_nodes_.back();
+    free_nodes_.pop_back();
+    return index;
+  }
+  nodes_.emplace_back();
+  return static_cast<int32_t>(nodes_.size() - 1);
+}
+
+void TimerWheel::FreeNode(int32_t index) {
+  auto& node = nodes_[index];
+  node.callback = nullptr;
+  node.slot = kNil;
+  // so that the stale ids can't cancel the next timer using this node
+  ++node.generation;
+  free_nodes_.push_back(index);
+}
+
+void TimerWheel::Link(int32_t index) {
+  int64_t expire = nodes_[index].expire;
+  int64_t delta = expire - current_;
+  if (delta < 0) {
+    // expired already, run it at the next tick
+    LinkToSlot(index, static_cast<int32_t>(current_ & kSlotMask));
+    return;
+  }
+  int level = 0;
+  while (level < kLevels - 1 &&
+      delta >= (static_cast<int64_t>(1) << ((level + 1) * kLevelBits))) {
+    ++level;
+  }
+  if (level == kLevels - 1) {
+    // beyond the range of the wheel, park it in the farthest slot and it
+    // will be linked again when cascaded
+    int64_t max_delta = (static_cast<int64_t>(1) << (kLevels * kLevelBits)) - 1;
+    expire = current_ + std::min(delta, max_delta);
+  }
+  int slot = static_cast<int>((expire >> (level * kLevelBits)) & kSlotMask);
+  LinkToSlot(index, level * kSlots + slot);
+}
+
+void TimerWheel::LinkToSlot(int32_t index, int32_t slot) {
+  // appended, so that the timers expiring at the same tick run in order
+  auto& node = nodes_[index];
+  node.slot = slot;
+  node.next = kNil;
+  node.prev = tails_[slot];
+  if (node.prev != kNil) {
+    nodes_[node.prev].next = index;
+  } else {
+    slots_[slot] = index;
+  }
+  tails_[slot] = index;
+}
+
+void TimerWheel::Unlink(int32_t index) {
+  auto& node = nodes_[index];
+  assert(node.slot != kNil);
+  if (node.prev != kNil) {
+    nodes_[node.prev].next = node.next;
+  } else {
+    slots_[node.slot] = node.next;
+  }
+  if (node.next != kNil) {
+    nodes_[node.next].prev = node.prev;
+  } else {
+    tails_[node.slot] = node.prev;
+  }
+  node.slot = node.prev = node.next = kNil;
+}
+
+void TimerWheel::Cascade(int level, int index) {
+  int32_t slot = level * kSlots + index;
+  int32_t i = slots_[slot];
+  slots_[slot] = tails_[slot] = kNil;
+  while (i != kNil) {
+    int32_t next = nodes_[i].next;
+    Link(i);
+    i = next;
+  }
+}
+
+}  // namespace tcp
+}  // namespace cnetpp
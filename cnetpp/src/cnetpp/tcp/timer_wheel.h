@@ -0,0 +1,131 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_TCP_TIMER_WHEEL_H_
+#define CNETPP_TCP_TIMER_WHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+namespace cnetpp {
+namespace tcp {
+
+// A hierarchical timing wheel with four levels of 256 slots. A timer is kept
+// in the level whose range covers its expiry and moved down level by level
+// as the time goes, so adding, cancelling and expiring a timer cost O(1).
+// The time is counted in ticks (milliseconds for the event pollers) and
+// supplied by the caller.
+// NOTE: it's not thread safe, every event poller owns one and uses it in its
+// own thread only
+class TimerWheel final {
+ public:
+  using TimerId = uint64_t;
+  using Callback = std::function<void()>;
+
+  static const TimerId kInvalidTimerId = 0;
+
+  // 'now' is the current tick, all of the ticks before it are treated as
+  // passed
+  explicit TimerWheel(int64_t now = 0);
+  ~TimerWheel() = default;
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Add a timer which expires at tick 'expire', if it has passed already the
+  // timer expires at the next call to Advance()
+  TimerId Add(int64_t expire, Callback callback);
+
+  // returns false if the timer has expired or been cancelled
+  bool Cancel(TimerId id);
+
+  // Run the callbacks of all the timers expired at tick 'now' in the order
+  // of their expiries, returns the number of them. The callbacks can add or
+  // cancel timers.
+  size_t Advance(int64_t now);
+
+  // the number of ticks from 'now' to the next time Advance() needs to be
+  // called, -1 if there is no timer at all
+  // NOTE: it may be earlier than the nearest expiry when the timers in the
+  // upper levels need to be moved down by then
+  int64_t NextTimeout(int64_t now) const;
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  static const int kLevelBits = 8;
+  static const int kLevels = 4;
+  static const int kSlots = 1 << kLevelBits;
+  static const int kSlotMask = kSlots - 1;
+  // the timers being run by Advance(), so that they can be cancelled by
+  // the callbacks like the others
+  static const int kRunningSlot = kLevels * kSlots;
+  static const int32_t kNil = -1;
+
+  struct Node {
+    int64_t expire { 0 };
+    Callback callback;
+    uint32_t generation { 0 };
+    int32_t slot { kNil };
+    int32_t prev { kNil };
+    int32_t next { kNil };
+  };
+
+  // the next tick to be processed
+  int64_t current_;
+  size_t size_ { 0 };
+
+  std::vector<Node> nodes_;
+  std::vector<int32_t> free_nodes_;
+  // the first and the last node of every slot
+  std::vector<int32_t> slots_;
+  std::vector<int32_t> tails_;
+
+  // the first tick from current_ at which some timer expires or some slot
+  // of the upper levels needs to be cascaded
+  int64_t NextTick() const;
+
+  int32_t AllocateNode();
+  void FreeNode(int32_t index);
+
+  // put the node into the slot matching its expiry
+  void Link(int32_t index);
+  void LinkToSlot(int32_t index, int32_t slot);
+  void Unlink(int32_t index);
+
+  // move the timers of the slot 'index' in 'level' to the lower levels
+  void Cascade(int level, int index);
+};
+
+}  // namespace tcp
+}  // namespace cnetpp
+
+#endif  // CNETPP_TCP_TIMER_WHEEL_H_
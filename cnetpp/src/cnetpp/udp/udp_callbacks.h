@@ -0,0 +1,55 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_UDP_UDP_CALLBACKS_H_
+#define CNETPP_UDP_UDP_CALLBACKS_H_
+
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/string_piece.h>
+
+#include <functional>
+#include <memory>
+
+namespace cnetpp {
+namespace udp {
+
+class UdpConnection;
+
+// Called by the event poller thread for every datagram received, with the
+// address it comes from. Both of them are only valid during the call.
+// Returning false closes the socket.
+using ReceivedCallbackType =
+    std::function<bool(const std::shared_ptr<UdpConnection>&,
+                       const base::EndPoint&,
+                       base::StringPiece)>;
+using ClosedCallbackType =
+    std::function<bool(const std::shared_ptr<UdpConnection>&)>;
+
+}  // namespace udp
+}  // namespace cnetpp
+
+#endif  // CNETPP_UDP_UDP_CALLBACKS_H_
+
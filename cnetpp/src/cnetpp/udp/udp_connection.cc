@@ -0,0 +1,491 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/udp/udp_connection.h>
+#include <cnetpp/tcp/buffer_pool.h>
+#include <cnetpp/tcp/command.h>
+#include <cnetpp/tcp/event_center.h>
+#include <cnetpp/base/log.h>
+#include <cnetpp/concurrency/this_thread.h>
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+namespace cnetpp {
+namespace udp {
+
+namespace {
+
+// the datagrams of more slices are copied into one
+const size_t kMaxDatagramSlices = 8;
+
+// the maximum number of datagrams in one UDP_SEGMENT message,
+// UDP_MAX_SEGMENTS of the older kernels
+const size_t kMaxGsoSegments = 64;
+
+// the maximum payload of a udp message
+const size_t kMaxMessageLength = 65507;
+
+// the receive buffer of every message when GRO is enabled, large enough for
+// any coalesced message
+const size_t kGroDatagramBufferSize = 65536;
+
+const size_t kSendControlSize = CMSG_SPACE(sizeof(uint16_t));
+const size_t kReceiveControlSize = CMSG_SPACE(sizeof(int));
+
+}  // namespace
+
+UdpConnection::UdpConnection(std::shared_ptr<tcp::EventCenter> event_center,
+                             int fd,
+                             const UdpServerOptions& options)
+    : ConnectionBase(event_center, fd),
+      batch_size_(std::max<size_t>(options.batch_size(), 1)),
+      read_budget_(options.read_budget()),
+      udp_gso_(options.udp_gso()),
+      udp_gro_(options.udp_gro()),
+      datagram_buffer_size_(std::max<size_t>(options.max_datagram_size(), 1)),
+      received_callback_(options.received_callback()),
+      closed_callback_(options.closed_callback()) {
+  udp_socket_.Attach(fd);
+  // probe the kernel, the segment size is set by every message
+  if (udp_gso_ && !udp_socket_.SetUdpSegmentSize(0)) {
+    Info("UDP_SEGMENT is not supported on udp socket %d", fd);
+    udp_gso_ = false;
+  }
+  if (udp_gro_ && !udp_socket_.SetUdpGro(true)) {
+    Info("UDP_GRO is not supported on udp socket %d", fd);
+    udp_gro_ = false;
+  }
+  if (udp_gro_) {
+    datagram_buffer_size_ =
+        std::max(datagram_buffer_size_, kGroDatagramBufferSize);
+  }
+
+  receive_messages_.resize(batch_size_);
+  receive_buffers_.resize(batch_size_);
+  receive_addresses_.resize(batch_size_);
+  receive_controls_.resize(batch_size_ * kReceiveControlSize);
+  send_messages_.resize(batch_size_);
+  send_buffers_.resize(batch_size_ * kMaxDatagramSlices);
+  send_controls_.resize(batch_size_ * kSendControlSize);
+  send_segments_.resize(batch_size_);
+
+  // a bound udp socket is ready once it's added to the event center
+  state_ = State::kConnected;
+}
+
+UdpConnection::~UdpConnection() {
+  // the fd is owned by socket_
+  udp_socket_.Detach();
+  if (receive_block_) {
+    tcp::BufferPool::Free(receive_block_,
+                          batch_size_ * datagram_buffer_size_);
+  }
+}
+
+bool UdpConnection::PostCommand(int type) {
+  if (ep_thread_id_ == std::this_thread::get_id()) {
+    // the event center outlives the running event poller threads
+    event_center_ptr_->AddCommand(tcp::Command(type, this), false);
+    return true;
+  }
+  auto event_center = event_center_.lock();
+  if (!event_center) {
+    return false;
+  }
+  event_center->AddCommand(tcp::Command(type, shared_from_this()), true);
+  return true;
+}
+
+bool UdpConnection::SendTo(const base::EndPoint& destination,
+                           base::StringPiece data) {
+  return SendTo(destination, tcp::IOBuf::Copy(data));
+}
+
+bool UdpConnection::SendTo(const base::EndPoint& destination,
+                           tcp::IOBuf&& data) {
+  Datagram datagram;
+  // zeroed, so that the addresses of the same destination compare equal
+  memset(&datagram.address, 0, sizeof(datagram.address));
+  datagram.address_length = sizeof(datagram.address);
+  if (!destination.ToSockAddr(
+          reinterpret_cast<struct sockaddr*>(&datagram.address),
+          &datagram.address_length)) {
+    return false;
+  }
+  if (data.NumSlices() > kMaxDatagramSlices) {
+    std::vector<struct iovec> slices(data.NumSlices());
+    data.GetReadPositions(&slices[0], slices.size());
+    std::string flattened;
+    flattened.reserve(data.Size());
+    for (auto& slice : slices) {
+      flattened.append(static_cast<const char*>(slice.iov_base),
+                       slice.iov_len);
+    }
+    data = tcp::IOBuf(std::move(flattened));
+  }
+  datagram.data = std::move(data);
+
+  // a command is pending, or the datagrams are waiting for the socket to
+  // become writable, unless the queue was empty
+  bool was_empty = false;
+  if (ep_thread_id_ == std::this_thread::get_id()) {
+    was_empty = sending_datagrams_.empty();
+    sending_datagrams_.emplace_back(std::move(datagram));
+    if (delivering_) {
+      // sent along with the other replies after the received callbacks
+      return true;
+    }
+  } else {
+    concurrency::SpinLock::ScopeGuard guard(send_lock_);
+    was_empty = send_datagrams_.empty();
+    send_datagrams_.emplace_back(std::move(datagram));
+  }
+  if (!was_empty) {
+    return true;
+  }
+  return PostCommand(static_cast<int>(tcp::Command::Type::kReadable) |
+                     static_cast<int>(tcp::Command::Type::kWriteable));
+}
+
+void UdpConnection::HandleReadableEvent(tcp::EventCenter* event_center) {
+  if (state_ != State::kConnected) {
+    return;
+  }
+  if (!receive_block_) {
+    receive_block_ =
+        tcp::BufferPool::Allocate(batch_size_ * datagram_buffer_size_);
+    for (size_t i = 0; i < batch_size_; ++i) {
+      receive_buffers_[i].iov_base =
+          receive_block_ + i * datagram_buffer_size_;
+      receive_buffers_[i].iov_len = datagram_buffer_size_;
+    }
+  }
+
+  bool closed = false;
+  bool budget_used_up = false;
+  size_t total_received_count = 0;
+  // one strong reference serves all the callbacks of this event
+  std::shared_ptr<UdpConnection> self;
+  delivering_ = true;
+  while (!closed) {
+    if (read_budget_ > 0 && total_received_count >= read_budget_) {
+      budget_used_up = true;
+      break;
+    }
+    size_t count = batch_size_;
+    if (read_budget_ > 0) {
+      count = std::min(count, read_budget_ - total_received_count);
+    }
+    // recvmmsg() overwrites the lengths and the flags
+    for (size_t i = 0; i < count; ++i) {
+      auto& header = receive_messages_[i].msg_hdr;
+      header.msg_name = &receive_addresses_[i];
+      header.msg_namelen = sizeof(receive_addresses_[i]);
+      header.msg_iov = &receive_buffers_[i];
+      header.msg_iovlen = 1;
+      header.msg_control = &receive_controls_[i * kReceiveControlSize];
+      header.msg_controllen = udp_gro_ ? kReceiveControlSize : 0;
+      header.msg_flags = 0;
+    }
+    size_t received_count = 0;
+    if (!udp_socket_.ReceiveMultiple(&receive_messages_[0],
+                                     count,
+                                     &received_count)) {
+      status_ = concurrency::ThisThread::GetLastError();
+      if (status_ == EAGAIN || status_ == EWOULDBLOCK) {
+        break;
+      } else if (status_ == ECONNREFUSED || status_ == EHOSTUNREACH ||
+                 status_ == ENETUNREACH) {
+        // reported by an ICMP error of an earlier send, the socket still
+        // works
+        continue;
+      }
+      closed = true;
+      break;
+    }
+    for (size_t i = 0; i < received_count; ++i) {
+      if (!NotifyReceived(receive_messages_[i],
+                          static_cast<const char*>(
+                              receive_buffers_[i].iov_base),
+                          &self)) {
+        closed = true;
+        break;
+      }
+    }
+    total_received_count += received_count;
+    if (received_count < count) {
+      // drained
+      break;
+    }
+  }
+  delivering_ = false;
+
+  if (closed) {
+    if (state_ != State::kClosed) {
+      tcp::Command command(
+          static_cast<int>(tcp::Command::Type::kRemoveConnImmediately),
+          this);
+      event_center->AddCommand(command, false);
+    }
+    return;
+  }
+
+  // send the replies queued by the received callbacks in batches
+  if (!sending_datagrams_.empty() && state_ == State::kConnected) {
+    if (!event_center->edge_triggered()) {
+      if (!SendDatagrams()) {
+        tcp::Command command(
+            static_cast<int>(tcp::Command::Type::kReadable) |
+            static_cast<int>(tcp::Command::Type::kWriteable),
+            this);
+        event_center->AddCommand(command, false);
+      }
+    } else if (writeable_ && !SendDatagrams()) {
+      // the rest is sent on the next writable edge
+      writeable_ = false;
+    }
+  }
+
+  if (budget_used_up && event_center->edge_triggered()) {
+    // no more notification will arrive for the datagrams left in the socket
+    // in edge-triggered mode, so resume receiving after the other events of
+    // this event poller are handled
+    event_center->AddCommand(
+        tcp::Command(static_cast<int>(tcp::Command::Type::kReadable),
+                     shared_from_this()),
+        true);
+  }
+}
+
+bool UdpConnection::NotifyReceived(struct mmsghdr& message,
+                                   const char* data,
+                                   std::shared_ptr<UdpConnection>* self) {
+  auto& header = message.msg_hdr;
+  if (header.msg_flags & MSG_TRUNC) {
+    // longer than max_datagram_size
+    return true;
+  }
+  size_t length = message.msg_len;
+  size_t segment_size = length;
+#if defined(UDP_GRO)
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+       cmsg;
+       cmsg = CMSG_NXTHDR(&header, cmsg)) {
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+      int gso_size = 0;
+      memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+      if (gso_size > 0) {
+        segment_size = static_cast<size_t>(gso_size);
+      }
+    }
+  }
+#endif
+  if (!received_callback_) {
+    return true;
+  }
+  source_.FromSockAddr(*static_cast<const struct sockaddr*>(header.msg_name),
+                       header.msg_namelen);
+  if (!*self) {
+    *self = std::static_pointer_cast<UdpConnection>(shared_from_this());
+  }
+  // a message coalesced by GRO carries several datagrams, all but the last
+  // one are segment_size bytes long
+  do {
+    size_t size = std::min(length, segment_size);
+    if (!received_callback_(*self, source_, base::StringPiece(data, size))) {
+      return false;
+    }
+    data += size;
+    length -= size;
+  } while (length > 0);
+  return true;
+}
+
+void UdpConnection::HandleWriteableEvent(tcp::EventCenter* event_center) {
+  if (state_ == State::kConnected || state_ == State::kClosing) {
+    while (true) {
+      if (sending_datagrams_.empty()) {
+        concurrency::SpinLock::ScopeGuard guard(send_lock_);
+        sending_datagrams_.splice(sending_datagrams_.end(), send_datagrams_);
+      }
+      if (sending_datagrams_.empty()) {
+        break;
+      }
+      if (!SendDatagrams()) {
+        // wait for the socket to become writable again
+        writeable_ = false;
+        return;
+      }
+    }
+  }
+
+  if (state_ == State::kConnected) {
+    if (!event_center->edge_triggered()) {
+      // stop polling for writable
+      tcp::Command command(static_cast<int>(tcp::Command::Type::kReadable),
+                           this);
+      event_center->AddCommand(command, false);
+    }
+  } else if (state_ == State::kClosing) {
+    tcp::Command command(
+        static_cast<int>(tcp::Command::Type::kRemoveConnImmediately),
+        this);
+    event_center->AddCommand(command, false);
+  }
+}
+
+bool UdpConnection::SendDatagrams() {
+  while (!sending_datagrams_.empty()) {
+    size_t count = GatherDatagrams();
+    size_t sent_count = 0;
+    if (!udp_socket_.SendMultiple(&send_messages_[0], count, &sent_count)) {
+      status_ = concurrency::ThisThread::GetLastError();
+      if (status_ == EAGAIN || status_ == EWOULDBLOCK) {
+        return false;
+      }
+      if (send_segments_[0] > 1 && (status_ == EIO || status_ == EINVAL)) {
+        // the device can't checksum the segments, or they exceed the MTU,
+        // send the datagrams one by one from now on
+        Info("Turning off UDP_SEGMENT on udp socket %d: %s",
+             socket_.fd(),
+             concurrency::ThisThread::GetLastErrorString().c_str());
+        udp_gso_ = false;
+        continue;
+      }
+      // the datagrams of the first message are dropped, e.g. EMSGSIZE
+      sent_count = 1;
+    }
+    for (size_t i = 0; i < sent_count; ++i) {
+      for (size_t j = 0; j < send_segments_[i]; ++j) {
+        sending_datagrams_.pop_front();
+      }
+    }
+  }
+  return true;
+}
+
+size_t UdpConnection::GatherDatagrams() {
+  size_t message_count = 0;
+  size_t buffer_count = 0;
+  auto datagram = sending_datagrams_.begin();
+  while (datagram != sending_datagrams_.end() &&
+         message_count < batch_size_ &&
+         buffer_count + datagram->data.NumSlices() <= send_buffers_.size()) {
+    auto first = datagram;
+    auto& header = send_messages_[message_count].msg_hdr;
+    memset(&send_messages_[message_count], 0, sizeof(struct mmsghdr));
+    header.msg_name = &first->address;
+    header.msg_namelen = first->address_length;
+    header.msg_iov = &send_buffers_[buffer_count];
+
+    // the datagrams of the same size to the same destination go in one
+    // UDP_SEGMENT message, only the last one of them may be shorter
+    size_t segment_size = first->data.Size();
+    size_t segments = 0;
+    size_t length = 0;
+    while (true) {
+      size_t size = datagram->data.Size();
+      buffer_count += datagram->data.GetReadPositions(
+          &send_buffers_[buffer_count], send_buffers_.size() - buffer_count);
+      length += size;
+      ++segments;
+      ++datagram;
+      if (!udp_gso_ || segment_size == 0 || size != segment_size ||
+          segments >= kMaxGsoSegments ||
+          datagram == sending_datagrams_.end() ||
+          datagram->data.Size() == 0 ||
+          datagram->data.Size() > segment_size ||
+          length + datagram->data.Size() > kMaxMessageLength ||
+          buffer_count + datagram->data.NumSlices() > send_buffers_.size() ||
+          datagram->address_length != first->address_length ||
+          memcmp(&datagram->address,
+                 &first->address,
+                 first->address_length) != 0) {
+        break;
+      }
+    }
+    header.msg_iovlen = &send_buffers_[0] + buffer_count - header.msg_iov;
+
+#if defined(UDP_SEGMENT)
+    if (segments > 1) {
+      header.msg_control = &send_controls_[message_count * kSendControlSize];
+      header.msg_controllen = kSendControlSize;
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t gso_size = static_cast<uint16_t>(segment_size);
+      memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+    }
+#endif
+    send_segments_[message_count] = segments;
+    ++message_count;
+  }
+  return message_count;
+}
+
+bool UdpConnection::HandleErrorEvent(tcp::EventCenter* event_center) {
+  (void) event_center;
+  // clear the pending error, it belongs to an earlier datagram
+  int error = 0;
+  if (udp_socket_.GetError(&error) && error != 0) {
+    status_ = error;
+  }
+  return true;
+}
+
+void UdpConnection::HandleCloseConnection() {
+  if (state_ == State::kClosed) {
+    return;
+  }
+  state_ = State::kClosed;
+  if (closed_callback_) {
+    closed_callback_(
+        std::static_pointer_cast<UdpConnection>(shared_from_this()));
+  }
+  udp_socket_.Detach();
+  socket_.Close();
+}
+
+void UdpConnection::MarkAsClosed(bool immediately) {
+  int type = 0;
+  if (immediately) {
+    type = static_cast<int>(tcp::Command::Type::kRemoveConnImmediately);
+  } else {
+    type = static_cast<int>(tcp::Command::Type::kRemoveConn);
+  }
+  PostCommand(type);
+}
+
+}  // namespace udp
+}  // namespace cnetpp
+
@@ -0,0 +1,162 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_UDP_UDP_CONNECTION_H_
+#define CNETPP_UDP_UDP_CONNECTION_H_
+
+#include <cnetpp/udp/udp_callbacks.h>
+#include <cnetpp/udp/udp_options.h>
+#include <cnetpp/tcp/connection_base.h>
+#include <cnetpp/tcp/io_buf.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/socket.h>
+#include <cnetpp/base/string_piece.h>
+#include <cnetpp/concurrency/spin_lock.h>
+
+#include <sys/socket.h>
+
+#include <list>
+#include <memory>
+#include <vector>
+
+namespace cnetpp {
+namespace udp {
+
+// A bound udp socket served by an event poller. The datagrams are received
+// by recvmmsg() in batches into a buffer taken from the BufferPool, and the
+// ones queued by SendTo() are sent by sendmmsg() in batches.
+class UdpConnection final : public tcp::ConnectionBase {
+ public:
+  UdpConnection(std::shared_ptr<tcp::EventCenter> event_center,
+                int fd,
+                const UdpServerOptions& options);
+  ~UdpConnection();
+
+  // Queue a datagram, it's sent by the event poller thread. It's thread
+  // safe, and the datagrams queued by the received callback are sent in
+  // one batch after the datagrams received are delivered.
+  // @return false if the destination is invalid
+  bool SendTo(const base::EndPoint& destination, base::StringPiece data);
+  bool SendTo(const base::EndPoint& destination, tcp::IOBuf&& data);
+
+  const ReceivedCallbackType& received_callback() const {
+    return received_callback_;
+  }
+  void set_received_callback(const ReceivedCallbackType& received_callback) {
+    received_callback_ = received_callback;
+  }
+
+  const ClosedCallbackType& closed_callback() const {
+    return closed_callback_;
+  }
+  void set_closed_callback(const ClosedCallbackType& closed_callback) {
+    closed_callback_ = closed_callback;
+  }
+
+  // false if UDP_SEGMENT has been turned off, either by the options or since
+  // the kernel doesn't support it
+  bool udp_gso() const {
+    return udp_gso_;
+  }
+
+  void HandleReadableEvent(tcp::EventCenter* event_center) override;
+  void HandleWriteableEvent(tcp::EventCenter* event_center) override;
+  void HandleCloseConnection() override;
+  // the errors queued on a udp socket, e.g. by an ICMP port unreachable, are
+  // not fatal
+  bool HandleErrorEvent(tcp::EventCenter* event_center) override;
+  // the queued datagrams are still sent unless immediately
+  void MarkAsClosed(bool immediately = true) override;
+
+ private:
+  struct Datagram {
+    struct sockaddr_storage address;
+    socklen_t address_length;
+    tcp::IOBuf data;
+  };
+
+  bool PostCommand(int type);
+
+  // deliver the datagrams of a message received, false if the received
+  // callback asks for closing
+  bool NotifyReceived(struct mmsghdr& message,
+                      const char* data,
+                      std::shared_ptr<UdpConnection>* self);
+
+  // send the datagrams of sending_datagrams_ in batches
+  // @return false if the socket is full, errno is left in status_
+  bool SendDatagrams();
+  // fill send_messages_ by the first datagrams of sending_datagrams_, and
+  // send_segments_[i] by the number of datagrams in the i-th message
+  size_t GatherDatagrams();
+
+  base::UdpSocket udp_socket_;
+
+  size_t batch_size_;
+  size_t read_budget_;
+  bool udp_gso_;
+  bool udp_gro_;
+  // the size of the receive buffer of every message
+  size_t datagram_buffer_size_;
+  // batch_size_ * datagram_buffer_size_ bytes from the BufferPool, taken on
+  // the first readable event
+  char* receive_block_ { nullptr };
+
+  // the per-message state of recvmmsg() and sendmmsg(), reused by every
+  // batch
+  std::vector<struct mmsghdr> receive_messages_;
+  std::vector<struct iovec> receive_buffers_;
+  std::vector<struct sockaddr_storage> receive_addresses_;
+  std::vector<char> receive_controls_;
+  std::vector<struct mmsghdr> send_messages_;
+  std::vector<struct iovec> send_buffers_;
+  std::vector<char> send_controls_;
+  std::vector<size_t> send_segments_;
+
+  // the source address of the datagram being delivered, reused to avoid
+  // reallocating the address every time
+  base::EndPoint source_;
+
+  // the datagrams queued by the other threads
+  concurrency::SpinLock send_lock_;
+  std::list<Datagram> send_datagrams_;
+  // the datagrams being sent, only the event poller thread touches them
+  std::list<Datagram> sending_datagrams_;
+  // true while the received callbacks are called, the datagrams they queue
+  // are sent after the callbacks
+  bool delivering_ { false };
+
+  int status_ { 0 };
+
+  ReceivedCallbackType received_callback_ { nullptr };
+  ClosedCallbackType closed_callback_ { nullptr };
+};
+
+}  // namespace udp
+}  // namespace cnetpp
+
+#endif  // CNETPP_UDP_UDP_CONNECTION_H_
+
@@ -0,0 +1,206 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_UDP_UDP_OPTIONS_H_
+#define CNETPP_UDP_UDP_OPTIONS_H_
+
+#include <cnetpp/udp/udp_callbacks.h>
+#include <cnetpp/tcp/event_poller.h>
+
+#include <stdint.h>
+
+#include <string>
+
+namespace cnetpp {
+namespace udp {
+
+class UdpServerOptions final {
+ public:
+  UdpServerOptions() = default;
+  ~UdpServerOptions() = default;
+
+  const std::string& name() const {
+    return name_;
+  }
+  void set_name(const std::string& name) {
+    name_ = name;
+  }
+
+  size_t worker_count() const {
+    return worker_count_;
+  }
+  void set_worker_count(size_t worker_count) {
+    worker_count_ = worker_count;
+  }
+
+  // If true, every event poller owns a SO_REUSEPORT socket bound to the same
+  // address, and the kernel spreads the flows among them. Otherwise one
+  // socket serves all the datagrams.
+  bool reuse_port() const {
+    return reuse_port_;
+  }
+  void set_reuse_port(bool reuse_port) {
+    reuse_port_ = reuse_port;
+  }
+
+  // SO_SNDBUF and SO_RCVBUF of the sockets, 0 leaves them alone
+  size_t udp_send_buffer_size() const {
+    return udp_send_buffer_size_;
+  }
+  void set_udp_send_buffer_size(size_t size) {
+    udp_send_buffer_size_ = size;
+  }
+
+  size_t udp_receive_buffer_size() const {
+    return udp_receive_buffer_size_;
+  }
+  void set_udp_receive_buffer_size(size_t size) {
+    udp_receive_buffer_size_ = size;
+  }
+
+  // the maximum number of datagrams received by one recvmmsg() or sent by
+  // one sendmmsg()
+  size_t batch_size() const {
+    return batch_size_;
+  }
+  void set_batch_size(size_t batch_size) {
+    batch_size_ = batch_size;
+  }
+
+  // the larger datagrams are truncated by the kernel and dropped. It's
+  // raised to 64K when GRO is enabled, since a receive may carry several
+  // coalesced datagrams then.
+  size_t max_datagram_size() const {
+    return max_datagram_size_;
+  }
+  void set_max_datagram_size(size_t max_datagram_size) {
+    max_datagram_size_ = max_datagram_size;
+  }
+
+  // the maximum number of datagrams received for one readable event, the
+  // rest is received after the other sockets on the same event poller are
+  // served. 0 means receiving till the socket is drained.
+  size_t read_budget() const {
+    return read_budget_;
+  }
+  void set_read_budget(size_t read_budget) {
+    read_budget_ = read_budget;
+  }
+
+  // If true, the queued datagrams of the same size to the same destination
+  // are sent as one UDP_SEGMENT message, which the kernel, or the NIC,
+  // splits. It's turned off if the kernel doesn't support it.
+  bool udp_gso() const {
+    return udp_gso_;
+  }
+  void set_udp_gso(bool udp_gso) {
+    udp_gso_ = udp_gso;
+  }
+
+  // If true, UDP_GRO is enabled on the sockets, and the coalesced datagrams
+  // are split again before they are delivered to the received callback
+  bool udp_gro() const {
+    return udp_gro_;
+  }
+  void set_udp_gro(bool udp_gro) {
+    udp_gro_ = udp_gro;
+  }
+
+  // see TcpOptions
+  bool edge_triggered() const {
+    return edge_triggered_;
+  }
+  void set_edge_triggered(bool edge_triggered) {
+    edge_triggered_ = edge_triggered;
+  }
+
+  tcp::EventPoller::Type event_poller_type() const {
+    return event_poller_type_;
+  }
+  void set_event_poller_type(tcp::EventPoller::Type event_poller_type) {
+    event_poller_type_ = event_poller_type;
+  }
+
+  int64_t busy_poll_us() const {
+    return busy_poll_us_;
+  }
+  void set_busy_poll_us(int64_t busy_poll_us) {
+    busy_poll_us_ = busy_poll_us;
+  }
+
+  int socket_busy_poll_us() const {
+    return socket_busy_poll_us_;
+  }
+  void set_socket_busy_poll_us(int socket_busy_poll_us) {
+    socket_busy_poll_us_ = socket_busy_poll_us;
+  }
+
+  const ReceivedCallbackType& received_callback() const {
+    return received_callback_;
+  }
+  ReceivedCallbackType& mutable_received_callback() {
+    return received_callback_;
+  }
+  void set_received_callback(const ReceivedCallbackType& received_callback) {
+    received_callback_ = received_callback;
+  }
+
+  const ClosedCallbackType& closed_callback() const {
+    return closed_callback_;
+  }
+  ClosedCallbackType& mutable_closed_callback() {
+    return closed_callback_;
+  }
+  void set_closed_callback(const ClosedCallbackType& closed_callback) {
+    closed_callback_ = closed_callback;
+  }
+
+ private:
+  std::string name_ { "udp" };
+  size_t worker_count_ { 0 };
+  bool reuse_port_ { false };
+  size_t udp_send_buffer_size_ { 0 };
+  size_t udp_receive_buffer_size_ { 0 };
+  size_t batch_size_ { 32 };
+  size_t max_datagram_size_ { 2048 };
+  size_t read_budget_ { 0 };
+  bool udp_gso_ { false };
+  bool udp_gro_ { false };
+  bool edge_triggered_ { false };
+  tcp::EventPoller::Type event_poller_type_ {
+    tcp::EventPoller::Type::kDefault
+  };
+  int64_t busy_poll_us_ { 0 };
+  int socket_busy_poll_us_ { 0 };
+  ReceivedCallbackType received_callback_ { nullptr };
+  ClosedCallbackType closed_callback_ { nullptr };
+};
+
+}  // namespace udp
+}  // namespace cnetpp
+
+#endif  // CNETPP_UDP_UDP_OPTIONS_H_
+
@@ -0,0 +1,114 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cnetpp/udp/udp_server.h>
+#include <cnetpp/tcp/command.h>
+#include <cnetpp/tcp/tcp_options.h>
+#include <cnetpp/base/socket.h>
+#include <cnetpp/base/log.h>
+
+#include <assert.h>
+
+namespace cnetpp {
+namespace udp {
+
+bool UdpServer::Launch(const base::EndPoint& local_address,
+                       const UdpServerOptions& options) {
+  tcp::TcpOptions tcp_options;
+  tcp_options.set_worker_count(options.worker_count());
+  tcp_options.set_edge_triggered(options.edge_triggered());
+  tcp_options.set_event_poller_type(options.event_poller_type());
+  tcp_options.set_busy_poll_us(options.busy_poll_us());
+  event_center_ = tcp::EventCenter::New(options.name(), tcp_options);
+  assert(event_center_.get());
+  if (!event_center_->Launch()) {
+    return false;
+  }
+
+  if (!options.reuse_port()) {
+    return Bind(local_address, options, -1);
+  }
+
+  // every event poller receives on its own socket, and the kernel spreads
+  // the flows among them
+  for (size_t i = 0; i < event_center_->thread_num(); ++i) {
+    if (!Bind(local_address, options, static_cast<int>(i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool UdpServer::Bind(const base::EndPoint& local_address,
+                     const UdpServerOptions& options,
+                     int event_poller_id) {
+  base::UdpSocket socket;
+  if (!socket.Create(local_address.Family() == AF_INET6)) {
+    return false;
+  }
+  if (!socket.SetCloexec(true) ||
+      !socket.SetBlocking(false) ||
+      !socket.SetReuseAddress(true) ||
+      (options.reuse_port() && !socket.SetReusePort(true)) ||
+      (options.udp_send_buffer_size() > 0 &&
+       !socket.SetSendBufferSize(options.udp_send_buffer_size())) ||
+      (options.udp_receive_buffer_size() > 0 &&
+       !socket.SetReceiveBufferSize(options.udp_receive_buffer_size())) ||
+      !socket.Bind(local_address)) {
+    return false;
+  }
+  if (options.socket_busy_poll_us() > 0 &&
+      (!socket.SetBusyPoll(options.socket_busy_poll_us()) ||
+       !socket.SetPreferBusyPoll(true))) {
+    Info("Failed to enable busy polling on the udp socket of %s",
+         local_address.ToString().c_str());
+  }
+
+  auto connection = std::make_shared<UdpConnection>(event_center_,
+                                                    socket.fd(),
+                                                    options);
+  socket.Detach();
+  connection->set_event_poller_id(event_poller_id);
+  connections_.push_back(connection);
+
+  // add the fd onto multiplexer
+  tcp::Command cmd(static_cast<int>(tcp::Command::Type::kAddConn),
+                   std::static_pointer_cast<tcp::ConnectionBase>(connection));
+  event_center_->AddCommand(std::move(cmd), true);
+  return true;
+}
+
+bool UdpServer::Shutdown() {
+  if (event_center_) {
+    event_center_->Shutdown();
+  }
+  connections_.clear();
+  return true;
+}
+
+}  // namespace udp
+}  // namespace cnetpp
+
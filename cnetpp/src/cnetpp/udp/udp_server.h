@@ -0,0 +1,74 @@
+// Copyright (c) 2015, myjfm(mwxjmmyjfm@gmail.com).  All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//   * Redistributions of source code must retain the above copyright notice,
+// this list of conditions and the following disclaimer.
+//   * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//   * Neither the name of myjfm nor the names of other contributors may be
+// used to endorse or promote products derived from this software without
+// specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT(INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#ifndef CNETPP_UDP_UDP_SERVER_H_
+#define CNETPP_UDP_UDP_SERVER_H_
+
+#include <cnetpp/udp/udp_connection.h>
+#include <cnetpp/udp/udp_options.h>
+#include <cnetpp/tcp/event_center.h>
+#include <cnetpp/base/end_point.h>
+
+#include <memory>
+#include <vector>
+
+namespace cnetpp {
+namespace udp {
+
+// Serves the datagrams to a local address on the event pollers of its own
+// event center. The received callback replies by
+// UdpConnection::SendTo(), and a server bound to port 0 works as a client.
+class UdpServer final {
+ public:
+  UdpServer() = default;
+  ~UdpServer() = default;
+
+  // you must first call this method before you do any requests
+  bool Launch(const base::EndPoint& local_address,
+              const UdpServerOptions& options = UdpServerOptions());
+  bool Shutdown();
+
+  // one socket per event poller if reuse_port is set, otherwise only one
+  const std::vector<std::shared_ptr<UdpConnection>>& connections() const {
+    return connections_;
+  }
+
+ private:
+  std::shared_ptr<tcp::EventCenter> event_center_;
+  std::vector<std::shared_ptr<UdpConnection>> connections_;
+
+  // create a socket bound to local_address and add it onto the given event
+  // poller, a negative event_poller_id lets the event center choose one
+  bool Bind(const base::EndPoint& local_address,
+            const UdpServerOptions& options,
+            int event_poller_id);
+};
+
+}  // namespace udp
+}  // namespace cnetpp
+
+#endif  // CNETPP_UDP_UDP_SERVER_H_
+
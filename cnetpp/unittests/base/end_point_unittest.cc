@@ -13,3 +13,38 @@ TEST(EndPoint, SockAddrTest) {
   ASSERT_TRUE(endpoint2.FromSockAddr(addr, addr_len));
   ASSERT_EQ(endpoint.ToString(), endpoint2.ToString());
 }
+
+TEST(EndPoint, UnixDomainTest) {
+  sockaddr_storage addr;
+  socklen_t addr_len = sizeof(addr);
+  auto sock_addr = reinterpret_cast<sockaddr*>(&addr);
+
+  auto endpoint = cnetpp::base::EndPoint::UnixDomain("/tmp/cnetpp.sock");
+  ASSERT_EQ(AF_UNIX, endpoint.Family());
+  ASSERT_EQ("unix:/tmp/cnetpp.sock", endpoint.ToString());
+  ASSERT_TRUE(endpoint.ToSockAddr(sock_addr, &addr_len));
+  cnetpp::base::EndPoint endpoint2;
+  ASSERT_TRUE(endpoint2.FromSockAddr(*sock_addr, addr_len));
+  ASSERT_TRUE(endpoint2.IsUnixDomain());
+  ASSERT_EQ(endpoint.unix_path(), endpoint2.unix_path());
+
+  auto abstract = cnetpp::base::EndPoint::UnixDomain("@cnetpp");
+  ASSERT_TRUE(abstract.IsAbstractUnixDomain());
+  ASSERT_EQ(std::string("\0cnetpp", 7), abstract.unix_path());
+  ASSERT_EQ("unix:@cnetpp", abstract.ToString());
+  addr_len = sizeof(addr);
+  ASSERT_TRUE(abstract.ToSockAddr(sock_addr, &addr_len));
+  ASSERT_TRUE(endpoint2.FromSockAddr(*sock_addr, addr_len));
+  ASSERT_EQ(abstract.ToString(), endpoint2.ToString());
+
+  // an ip end point parsed afterwards is not a unix domain one any more
+  cnetpp::base::EndPoint ip("127.0.0.1", 80);
+  addr_len = sizeof(addr);
+  ASSERT_TRUE(ip.ToSockAddr(sock_addr, &addr_len));
+  ASSERT_TRUE(endpoint2.FromSockAddr(*sock_addr, addr_len));
+  ASSERT_EQ(AF_INET, endpoint2.Family());
+  ASSERT_EQ(ip.ToString(), endpoint2.ToString());
+
+  ASSERT_FALSE(cnetpp::base::EndPoint::UnixDomain(std::string(200, 'a'))
+      .ToSockAddr(sock_addr, &addr_len));
+}
@@ -0,0 +1,126 @@
+#include <cnetpp/base/resolver.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// a stub of the name server, answering after the test releases it
+class StubLookup {
+ public:
+  bool operator()(const std::string& hostname,
+                  std::vector<cnetpp::base::IPAddress>* addresses) {
+    std::unique_lock<std::mutex> guard(mutex_);
+    ++queries_;
+    cv_.wait(guard, [this] { return released_; });
+    if (hostname == "unknown.test") {
+      return false;
+    }
+    addresses->emplace_back("10.0.0.1");
+    return true;
+  }
+
+  void Release() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    released_ = true;
+    cv_.notify_all();
+  }
+
+  int queries() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return queries_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool released_ { false };
+  int queries_ { 0 };
+};
+
+}  // namespace
+
+TEST(Resolver, CoalesceAndCache) {
+  StubLookup stub;
+  cnetpp::base::Resolver resolver;
+  resolver.set_lookup_function(
+      [&stub] (const std::string& hostname,
+               std::vector<cnetpp::base::IPAddress>* addresses) {
+        return stub(hostname, addresses);
+      });
+  resolver.set_negative_ttl(60 * 1000);
+  ASSERT_TRUE(resolver.Start());
+
+  std::atomic<int> resolved { 0 };
+  std::atomic<int> failed { 0 };
+  auto callback = [&] (const std::vector<cnetpp::base::IPAddress>& result) {
+    if (result.empty()) {
+      ++failed;
+    } else if (result[0].ToString() == "10.0.0.1") {
+      ++resolved;
+    }
+  };
+  for (int i = 0; i < 10; ++i) {
+    resolver.Resolve("example.test", callback);
+    resolver.Resolve("unknown.test", callback);
+  }
+  // an address literal never goes to the name server
+  bool literal = false;
+  resolver.Resolve("127.0.0.1",
+      [&] (const std::vector<cnetpp::base::IPAddress>& result) {
+        literal = result.size() == 1 && result[0].ToString() == "127.0.0.1";
+      });
+  stub.Release();
+  ASSERT_TRUE(literal);
+  for (int i = 0; i < 1000 && resolved + failed < 20; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(10, resolved);
+  ASSERT_EQ(10, failed);
+  ASSERT_EQ(2, stub.queries());
+
+  // both the positive and the negative results are cached
+  std::vector<cnetpp::base::IPAddress> addresses;
+  ASSERT_TRUE(resolver.Resolve("example.test", &addresses));
+  ASSERT_EQ(1u, addresses.size());
+  ASSERT_FALSE(resolver.Resolve("unknown.test", &addresses));
+  ASSERT_EQ(2, stub.queries());
+
+  resolver.Clear();
+  ASSERT_TRUE(resolver.Resolve("example.test", &addresses));
+  ASSERT_EQ(3, stub.queries());
+  resolver.Stop();
+}
+
+TEST(Resolver, StopWhileResolving) {
+  cnetpp::base::Resolver resolver;
+  resolver.set_lookup_function(
+      [] (const std::string&,
+          std::vector<cnetpp::base::IPAddress>* addresses) {
+        addresses->emplace_back("10.0.0.1");
+        return true;
+      });
+  ASSERT_TRUE(resolver.Start());
+
+  // every callback is called once, whether the query made it into the
+  // resolver threads before Stop() or not
+  const int kQueries = 1000;
+  std::atomic<int> called { 0 };
+  std::thread resolving([&] {
+    for (int i = 0; i < kQueries; ++i) {
+      resolver.Resolve("host" + std::to_string(i) + ".test",
+          [&] (const std::vector<cnetpp::base::IPAddress>&) { ++called; });
+    }
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  resolver.Stop();
+  resolving.join();
+  ASSERT_EQ(kQueries, called);
+}
@@ -0,0 +1,74 @@
+#include <cnetpp/concurrency/mpsc_queue.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+TEST(MpscQueue, Test01) {
+  cnetpp::concurrency::MpscQueue<int> q;
+  ASSERT_TRUE(q.Empty());
+  int value = 0;
+  ASSERT_FALSE(q.TryPop(&value));
+  q.Push(1);
+  q.Push(2);
+  ASSERT_FALSE(q.Empty());
+  ASSERT_TRUE(q.TryPop(&value));
+  ASSERT_EQ(value, 1);
+  q.Push(3);
+  ASSERT_TRUE(q.TryPop(&value));
+  ASSERT_EQ(value, 2);
+  ASSERT_TRUE(q.TryPop(&value));
+  ASSERT_EQ(value, 3);
+  ASSERT_FALSE(q.TryPop(&value));
+  ASSERT_TRUE(q.Empty());
+}
+
+TEST(MpscQueue, Test02) {
+  // remaining elements must be destroyed with the queue
+  auto p = std::make_shared<int>(1);
+  {
+    cnetpp::concurrency::MpscQueue<std::shared_ptr<int>> q;
+    q.Push(p);
+    q.Push(p);
+    std::shared_ptr<int> v;
+    ASSERT_TRUE(q.TryPop(&v));
+    ASSERT_EQ(p.use_count(), 3);
+  }
+  ASSERT_EQ(p.use_count(), 1);
+}
+
+TEST(MpscQueue, Test03) {
+  const int kProducers = 4;
+  const int kCount = 100000;
+  cnetpp::concurrency::MpscQueue<int> q;
+  std::vector<std::thread> producers;
+  for (int i = 0; i < kProducers; ++i) {
+    producers.emplace_back([&q, i] () {
+      for (int j = 0; j < kCount; ++j) {
+        q.Push(i * kCount + j);
+      }
+    });
+  }
+
+  // elements from the same producer must keep their order
+  std::vector<int> last(kProducers, -1);
+  int popped = 0;
+  while (popped < kProducers * kCount) {
+    int value = 0;
+    if (!q.TryPop(&value)) {
+      std::this_thread::yield();
+      continue;
+    }
+    int producer = value / kCount;
+    ASSERT_LT(last[producer], value);
+    last[producer] = value;
+    popped++;
+  }
+  for (auto& t : producers) {
+    t.join();
+  }
+  ASSERT_TRUE(q.Empty());
+}
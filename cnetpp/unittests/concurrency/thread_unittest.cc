@@ -4,6 +4,7 @@
 
 #include <string.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include <atomic>
 #include <memory>
@@ -28,3 +29,33 @@ TEST(Thread, Test01) {
   ASSERT_EQ(strcmp("Test01-1", name), 0);
 }
 
+
+TEST(Thread, Test02) {
+  // pin the thread on the last cpu this process may run on
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  ASSERT_EQ(sched_getaffinity(0, sizeof(cpu_set), &cpu_set), 0);
+  int cpu = -1;
+  for (int i = 0; i < CPU_SETSIZE; ++i) {
+    if (CPU_ISSET(i, &cpu_set)) {
+      cpu = i;
+    }
+  }
+  ASSERT_GE(cpu, 0);
+
+  std::atomic<int> running_cpu { -1 };
+  std::atomic<int> num_allowed_cpus { 0 };
+  auto t = std::make_shared<cnetpp::concurrency::Thread>([&] () -> bool {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    num_allowed_cpus = CPU_COUNT(&allowed);
+    running_cpu = sched_getcpu();
+    return true;
+  }, "Test02-1");
+  t->set_cpu_affinity({ cpu });
+  t->Start();
+  t->Stop();
+  ASSERT_EQ(num_allowed_cpus, 1);
+  ASSERT_EQ(running_cpu, cpu);
+}
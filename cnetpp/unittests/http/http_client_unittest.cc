@@ -0,0 +1,412 @@
+#include <cnetpp/http/http_client.h>
+#include <cnetpp/http/http_server.h>
+#include <cnetpp/http/http_connection.h>
+#include <cnetpp/http/http_request.h>
+#include <cnetpp/http/http_response.h>
+#include <cnetpp/tcp/tcp_connection.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using cnetpp::base::EndPoint;
+using cnetpp::base::IPAddress;
+using cnetpp::http::HttpClient;
+using cnetpp::http::HttpClientOptions;
+using cnetpp::http::HttpConnection;
+using cnetpp::http::HttpRequest;
+using cnetpp::http::HttpResponse;
+using cnetpp::http::HttpServer;
+using cnetpp::http::HttpServerOptions;
+
+bool WaitFor(std::function<bool()> done) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+// a port of the loopback which is free for now
+int UnusedPort() {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  ::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(addr);
+  int port = -1;
+  if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), length) == 0 &&
+      ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                    &length) == 0) {
+    port = ntohs(addr.sin_port);
+  }
+  ::close(fd);
+  return port;
+}
+
+// Answers every request with the port of the client as the body, so that
+// the tests tell which pooled connection has been used. While holding, the
+// requests are answered by Release() instead.
+class PortServer {
+ public:
+  PortServer() : address_(IPAddress("127.0.0.1"), UnusedPort()) {
+  }
+
+  bool Launch() {
+    HttpServerOptions options;
+    options.set_worker_count(1);
+    options.set_connected_callback(
+        [this] (std::shared_ptr<HttpConnection> c) {
+          std::lock_guard<std::mutex> guard(mutex_);
+          ++connected_;
+          connections_.push_back(c);
+          return true;
+        });
+    options.set_closed_callback(
+        [this] (std::shared_ptr<HttpConnection>) {
+          std::lock_guard<std::mutex> guard(mutex_);
+          ++closed_;
+          return true;
+        });
+    options.set_received_callback(
+        [this] (std::shared_ptr<HttpConnection> c) {
+          std::unique_lock<std::mutex> guard(mutex_);
+          if (holding_) {
+            held_.push_back(c);
+            return true;
+          }
+          guard.unlock();
+          return Answer(c);
+        });
+    return server_.Launch(address_, options);
+  }
+
+  void Shutdown() {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      held_.clear();
+      connections_.clear();
+    }
+    server_.Shutdown();
+  }
+
+  const EndPoint& address() const {
+    return address_;
+  }
+
+  void Hold(bool holding) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    holding_ = holding;
+  }
+
+  // answer the request held for the longest time
+  bool Release() {
+    std::unique_lock<std::mutex> guard(mutex_);
+    if (held_.empty()) {
+      return false;
+    }
+    auto c = held_.front();
+    held_.pop_front();
+    guard.unlock();
+    return Answer(c);
+  }
+
+  // close the connections accepted so far
+  void CloseAll() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto& c : connections_) {
+      c->MarkAsClosed();
+    }
+    connections_.clear();
+  }
+
+  size_t held() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return held_.size();
+  }
+  int connected() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return connected_;
+  }
+  int closed() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return closed_;
+  }
+
+ private:
+  static bool Answer(std::shared_ptr<HttpConnection> c) {
+    auto port = std::to_string(c->tcp_connection()->remote_end_point().port());
+    std::shared_ptr<HttpResponse> response(new HttpResponse);
+    response->set_status(HttpResponse::StatusCode::kOk);
+    response->SetHttpHeader("Content-Length", std::to_string(port.size()));
+    response->set_http_body(port);
+    return c->SendPacket(response);
+  }
+
+  EndPoint address_;
+  HttpServer server_;
+  std::mutex mutex_;
+  bool holding_ { false };
+  std::deque<std::shared_ptr<HttpConnection>> held_;
+  std::vector<std::shared_ptr<HttpConnection>> connections_;
+  int connected_ { 0 };
+  int closed_ { 0 };
+};
+
+// the responses of a client, by the order of the requests, "" means nullptr
+class Responses {
+ public:
+  cnetpp::http::ResponseCallbackType Expect() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    size_t index = bodies_.size();
+    bodies_.emplace_back();
+    calls_.push_back(0);
+    return [this, index] (std::shared_ptr<HttpResponse> response) {
+      std::lock_guard<std::mutex> guard(mutex_);
+      bodies_[index] = response ? response->http_body() : "";
+      ++calls_[index];
+    };
+  }
+
+  // wait for the response of the request, return its body
+  std::string Wait(size_t index) {
+    WaitFor([this, index] {
+      std::lock_guard<std::mutex> guard(mutex_);
+      return calls_[index] > 0;
+    });
+    std::lock_guard<std::mutex> guard(mutex_);
+    return bodies_[index];
+  }
+
+  int calls(size_t index) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return calls_[index];
+  }
+
+ private:
+  std::mutex mutex_;
+  std::vector<std::string> bodies_;
+  std::vector<int> calls_;
+};
+
+std::shared_ptr<HttpRequest> NewRequest() {
+  std::shared_ptr<HttpRequest> request(new HttpRequest);
+  request->set_method(HttpRequest::MethodType::kGet);
+  request->set_uri("/");
+  request->SetHttpHeader("Host", "localhost");
+  return request;
+}
+
+}  // namespace
+
+TEST(HttpClient, ReuseMostRecentlyUsed) {
+  PortServer server;
+  ASSERT_TRUE(server.Launch());
+  HttpClientOptions options;
+  options.set_worker_count(1);
+  HttpClient client;
+  ASSERT_TRUE(client.Launch(options));
+
+  // two connections, released one after the other
+  Responses responses;
+  server.Hold(true);
+  ASSERT_TRUE(client.SendRequest(server.address(), NewRequest(),
+                                 responses.Expect()));
+  ASSERT_TRUE(client.SendRequest(server.address(), NewRequest(),
+                                 responses.Expect()));
+  ASSERT_TRUE(WaitFor([&] { return server.held() == 2; }));
+  server.Hold(false);
+  ASSERT_TRUE(server.Release());
+  auto first = responses.Wait(0);
+  ASSERT_TRUE(server.Release());
+  auto second = responses.Wait(1);
+  ASSERT_NE("", first);
+  ASSERT_NE("", second);
+  ASSERT_NE(first, second);
+
+  // the one released last is taken first
+  for (size_t i = 2; i < 5; ++i) {
+    ASSERT_TRUE(client.SendRequest(server.address(), NewRequest(),
+                                   responses.Expect()));
+    ASSERT_EQ(second, responses.Wait(i));
+  }
+  ASSERT_EQ(2, server.connected());
+
+  client.Shutdown();
+  server.Shutdown();
+}
+
+TEST(HttpClient, MaxConnectionsWithWaitingRequests) {
+  PortServer server;
+  ASSERT_TRUE(server.Launch());
+  HttpClientOptions options;
+  options.set_worker_count(1);
+  options.set_max_connections_per_endpoint(2);
+  HttpClient client;
+  ASSERT_TRUE(client.Launch(options));
+
+  const size_t kRequests = 6;
+  Responses responses;
+  server.Hold(true);
+  for (size_t i = 0; i < kRequests; ++i) {
+    ASSERT_TRUE(client.SendRequest(server.address(), NewRequest(),
+                                   responses.Expect()));
+  }
+  ASSERT_TRUE(WaitFor([&] { return server.held() == 2; }));
+  // the others wait for these two connections
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  ASSERT_EQ(2u, server.held());
+  ASSERT_EQ(2, server.connected());
+
+  server.Hold(false);
+  while (server.Release()) {
+  }
+  for (size_t i = 0; i < kRequests; ++i) {
+    ASSERT_NE("", responses.Wait(i));
+    ASSERT_EQ(1, responses.calls(i));
+  }
+  ASSERT_EQ(2, server.connected());
+
+  client.Shutdown();
+  server.Shutdown();
+}
+
+TEST(HttpClient, MaxIdleConnections) {
+  PortServer server;
+  ASSERT_TRUE(server.Launch());
+  HttpClientOptions options;
+  options.set_worker_count(1);
+  options.set_max_idle_connections_per_endpoint(1);
+  HttpClient client;
+  ASSERT_TRUE(client.Launch(options));
+
+  const size_t kRequests = 3;
+  Responses responses;
+  server.Hold(true);
+  for (size_t i = 0; i < kRequests; ++i) {
+    ASSERT_TRUE(client.SendRequest(server.address(), NewRequest(),
+                                   responses.Expect()));
+  }
+  ASSERT_TRUE(WaitFor([&] { return server.held() == kRequests; }));
+  server.Hold(false);
+  std::vector<std::string> ports;
+  for (size_t i = 0; i < kRequests; ++i) {
+    ASSERT_TRUE(server.Release());
+    ports.push_back(responses.Wait(i));
+  }
+
+  // only the one released last stays idle, the older ones are closed
+  ASSERT_TRUE(WaitFor([&] { return server.closed() == 2; }));
+  ASSERT_TRUE(client.SendRequest(server.address(), NewRequest(),
+                                 responses.Expect()));
+  ASSERT_EQ(ports.back(), responses.Wait(kRequests));
+  ASSERT_EQ(3, server.connected());
+
+  client.Shutdown();
+  server.Shutdown();
+}
+
+TEST(HttpClient, StaleIdleConnection) {
+  PortServer server;
+  ASSERT_TRUE(server.Launch());
+  HttpClientOptions options;
+  options.set_worker_count(1);
+  options.set_idle_connection_timeout(50);
+  HttpClient client;
+  ASSERT_TRUE(client.Launch(options));
+
+  Responses responses;
+  ASSERT_TRUE(client.SendRequest(server.address(), NewRequest(),
+                                 responses.Expect()));
+  auto first = responses.Wait(0);
+  ASSERT_NE("", first);
+
+  // idle for too long, it's closed on checkout and replaced
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ASSERT_TRUE(client.SendRequest(server.address(), NewRequest(),
+                                 responses.Expect()));
+  auto second = responses.Wait(1);
+  ASSERT_NE("", second);
+  ASSERT_NE(first, second);
+  ASSERT_TRUE(WaitFor([&] { return server.closed() == 1; }));
+  ASSERT_EQ(2, server.connected());
+
+  client.Shutdown();
+  server.Shutdown();
+}
+
+TEST(HttpClient, PeerClosedIdleConnection) {
+  PortServer server;
+  ASSERT_TRUE(server.Launch());
+  HttpClientOptions options;
+  options.set_worker_count(1);
+  HttpClient client;
+  ASSERT_TRUE(client.Launch(options));
+
+  Responses responses;
+  ASSERT_TRUE(client.SendRequest(server.address(), NewRequest(),
+                                 responses.Expect()));
+  auto first = responses.Wait(0);
+  ASSERT_NE("", first);
+
+  // the idle connection closed by the server is never handed out, whether
+  // the client has noticed the FIN before the checkout or not
+  server.CloseAll();
+  ASSERT_TRUE(WaitFor([&] { return server.closed() == 1; }));
+  ASSERT_TRUE(client.SendRequest(server.address(), NewRequest(),
+                                 responses.Expect()));
+  auto second = responses.Wait(1);
+  ASSERT_NE("", second);
+  ASSERT_NE(first, second);
+
+  client.Shutdown();
+  server.Shutdown();
+}
+
+TEST(HttpClient, ConnectFailure) {
+  HttpClientOptions options;
+  options.set_worker_count(1);
+  options.set_max_connections_per_endpoint(1);
+  HttpClient client;
+  ASSERT_TRUE(client.Launch(options));
+
+  // nobody listens on it, the waiting requests fail along with the first
+  EndPoint address(IPAddress("127.0.0.1"), UnusedPort());
+  const size_t kRequests = 3;
+  Responses responses;
+  for (size_t i = 0; i < kRequests; ++i) {
+    ASSERT_TRUE(client.SendRequest(address, NewRequest(),
+                                   responses.Expect()));
+  }
+  for (size_t i = 0; i < kRequests; ++i) {
+    ASSERT_EQ("", responses.Wait(i));
+  }
+  // and never called again
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  for (size_t i = 0; i < kRequests; ++i) {
+    ASSERT_EQ(1, responses.calls(i));
+  }
+
+  client.Shutdown();
+}
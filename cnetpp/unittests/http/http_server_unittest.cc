@@ -0,0 +1,184 @@
+#include <cnetpp/http/http_server.h>
+#include <cnetpp/http/http_client.h>
+#include <cnetpp/http/http_connection.h>
+#include <cnetpp/http/http_request.h>
+#include <cnetpp/http/http_response.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using cnetpp::base::EndPoint;
+using cnetpp::base::IPAddress;
+using cnetpp::http::HttpClient;
+using cnetpp::http::HttpClientOptions;
+using cnetpp::http::HttpConnection;
+using cnetpp::http::HttpRequest;
+using cnetpp::http::HttpResponse;
+using cnetpp::http::HttpServer;
+using cnetpp::http::HttpServerOptions;
+
+// the server answers every request with its uri as the body
+void RequestTest(const EndPoint& server_address) {
+  HttpServerOptions server_options;
+  server_options.set_worker_count(1);
+  server_options.set_received_callback(
+      [] (std::shared_ptr<HttpConnection> connection) {
+        auto request =
+            std::static_pointer_cast<HttpRequest>(connection->http_packet());
+        std::shared_ptr<HttpResponse> response(new HttpResponse);
+        response->set_status(HttpResponse::StatusCode::kOk);
+        response->SetHttpHeader("Content-Length",
+                                std::to_string(request->uri().size()));
+        response->set_http_body(request->uri());
+        return connection->SendPacket(response);
+      });
+  HttpServer server;
+  ASSERT_TRUE(server.Launch(server_address, server_options));
+
+  HttpClientOptions client_options;
+  client_options.set_worker_count(1);
+  HttpClient client;
+  ASSERT_TRUE(client.Launch(client_options));
+
+  for (int i = 0; i < 20; ++i) {
+    std::shared_ptr<HttpRequest> request(new HttpRequest);
+    request->set_method(HttpRequest::MethodType::kGet);
+    request->set_uri("/" + std::to_string(i));
+    request->SetHttpHeader("Host", "localhost");
+    auto promise = std::make_shared<std::promise<std::string>>();
+    auto future = promise->get_future();
+    client.SendRequest(server_address, request,
+        [promise] (std::shared_ptr<HttpResponse> response) {
+          promise->set_value(response ? response->http_body() : "failed");
+        });
+    ASSERT_EQ(std::future_status::ready,
+              future.wait_for(std::chrono::seconds(5)));
+    ASSERT_EQ("/" + std::to_string(i), future.get());
+  }
+
+  client.Shutdown();
+  server.Shutdown();
+}
+
+// a port of the loopback which is free for now
+int UnusedPort() {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  ::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(addr);
+  int port = -1;
+  if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), length) == 0 &&
+      ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                    &length) == 0) {
+    port = ntohs(addr.sin_port);
+  }
+  ::close(fd);
+  return port;
+}
+
+// Every connection sends one request, which is answered and the connection
+// closed at once from the received callback, dropping the http connection
+// from the registry in the middle of handling it. The tcp connection reaches
+// the http one through its context until then, and no more once closed.
+void CloseFromReceivedCallbackTest(const EndPoint& server_address) {
+  const int kConnections = 20;
+  std::atomic<int> received { 0 };
+  std::atomic<int> closed { 0 };
+  HttpServerOptions server_options;
+  server_options.set_worker_count(1);
+  server_options.set_received_callback(
+      [&] (std::shared_ptr<HttpConnection> connection) {
+        received++;
+        EXPECT_EQ(connection.get(),
+                  connection->tcp_connection()->context());
+        std::shared_ptr<HttpResponse> response(new HttpResponse);
+        response->set_status(HttpResponse::StatusCode::kOk);
+        response->SetHttpHeader("Content-Length", "2");
+        response->set_http_body("ok");
+        EXPECT_TRUE(connection->SendPacket(response));
+        connection->MarkAsClosed(true);
+        return true;
+      });
+  server_options.set_closed_callback(
+      [&] (std::shared_ptr<HttpConnection> connection) {
+        EXPECT_TRUE(connection);
+        if (connection) {
+          EXPECT_EQ(nullptr, connection->tcp_connection()->context());
+        }
+        closed++;
+        return true;
+      });
+  HttpServer server;
+  ASSERT_TRUE(server.Launch(server_address, server_options));
+
+  std::atomic<int> client_closed { 0 };
+  HttpClientOptions client_options;
+  client_options.set_worker_count(1);
+  client_options.set_connected_callback(
+      [] (std::shared_ptr<HttpConnection> connection) {
+        std::shared_ptr<HttpRequest> request(new HttpRequest);
+        request->set_method(HttpRequest::MethodType::kGet);
+        request->set_uri("/");
+        request->SetHttpHeader("Host", "localhost");
+        return connection->SendPacket(request);
+      });
+  client_options.set_closed_callback(
+      [&] (std::shared_ptr<HttpConnection>) {
+        client_closed++;
+        return true;
+      });
+  HttpClient client;
+  ASSERT_TRUE(client.Launch(client_options));
+  for (int i = 0; i < kConnections; ++i) {
+    ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+              client.Connect(&server_address, client_options));
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while ((closed < kConnections || client_closed < kConnections) &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  client.Shutdown();
+  server.Shutdown();
+  ASSERT_EQ(kConnections, received);
+  ASSERT_EQ(kConnections, closed);
+  ASSERT_EQ(kConnections, client_closed);
+}
+
+}  // namespace
+
+TEST(HttpServer, RequestOverUnixDomainPath) {
+  std::string path =
+      "/tmp/cnetpp-http-" + std::to_string(::getpid()) + ".sock";
+  RequestTest(EndPoint::UnixDomain(path));
+  ASSERT_NE(0, ::access(path.c_str(), F_OK));
+}
+
+TEST(HttpServer, RequestOverAbstractUnixDomain) {
+  RequestTest(EndPoint::UnixDomain("@cnetpp-http-" +
+                                   std::to_string(::getpid())));
+}
+
+TEST(HttpServer, CloseFromReceivedCallback) {
+  CloseFromReceivedCallbackTest(EndPoint(IPAddress("127.0.0.1"),
+                                         UnusedPort()));
+}
@@ -0,0 +1,56 @@
+#include <cnetpp/tcp/buffer_pool.h>
+#include <cnetpp/tcp/ring_buffer.h>
+
+#include <sys/uio.h>
+#include <string.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+TEST(BufferPool, Test01) {
+  using cnetpp::tcp::BufferPool;
+  ASSERT_EQ(1024, BufferPool::BlockSize(1));
+  ASSERT_EQ(4096, BufferPool::BlockSize(4000));
+  ASSERT_EQ(4096, BufferPool::BlockSize(4096));
+  ASSERT_EQ(6 * 1024 * 1024, BufferPool::BlockSize(5 * 1024 * 1024));
+  ASSERT_EQ(nullptr, BufferPool::Allocate(0));
+
+  BufferPool::Trim();
+  ASSERT_EQ(0, BufferPool::CachedBytes());
+  char* block = BufferPool::Allocate(3000);
+  ::memset(block, 'a', 4096);
+  BufferPool::Free(block, 3000);
+  ASSERT_EQ(4096, BufferPool::CachedBytes());
+  // the block is recycled by the same size class
+  ASSERT_EQ(block, BufferPool::Allocate(4096));
+  ASSERT_EQ(0, BufferPool::CachedBytes());
+  BufferPool::Free(block, 4096);
+
+  // the larger blocks are not cached
+  char* large = BufferPool::Allocate(5 * 1024 * 1024);
+  BufferPool::Free(large, 5 * 1024 * 1024);
+  ASSERT_EQ(4096, BufferPool::CachedBytes());
+  BufferPool::Trim();
+  ASSERT_EQ(0, BufferPool::CachedBytes());
+}
+
+TEST(BufferPool, Test02) {
+  using cnetpp::tcp::BufferPool;
+  BufferPool::Trim();
+  cnetpp::tcp::RingBuffer rb(0);
+  ASSERT_EQ(0, rb.Capacity());
+  ASSERT_TRUE(rb.Resize(8192));
+  ASSERT_TRUE(rb.Write("abc"));
+  // not empty, kept
+  rb.Shrink();
+  ASSERT_EQ(8192, rb.Capacity());
+  std::string data;
+  rb.ReadAll(&data);
+  ASSERT_EQ("abc", data);
+  rb.Shrink();
+  ASSERT_EQ(0, rb.Capacity());
+  ASSERT_EQ(8192, BufferPool::CachedBytes());
+  ASSERT_TRUE(rb.Resize(8192));
+  ASSERT_EQ(0, BufferPool::CachedBytes());
+}
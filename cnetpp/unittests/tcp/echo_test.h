@@ -0,0 +1,97 @@
+#ifndef CNETPP_UNITTESTS_TCP_ECHO_TEST_H_
+#define CNETPP_UNITTESTS_TCP_ECHO_TEST_H_
+
+#include <cnetpp/tcp/tcp_server.h>
+#include <cnetpp/tcp/tcp_client.h>
+#include <cnetpp/tcp/tcp_connection.h>
+#include <cnetpp/base/end_point.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace cnetpp {
+namespace tcp {
+
+// The server listens on 'server_address', the client connects to it and
+// sends packets of various lengths, and the server echoes them back. The
+// options set up everything but the callbacks, e.g. worker_count,
+// edge_triggered and event_poller_type.
+inline void EchoTest(const base::EndPoint& server_address,
+                     TcpServerOptions server_options,
+                     TcpClientOptions client_options) {
+  server_options.set_received_callback(
+      [] (const std::shared_ptr<TcpConnection>& connection) {
+        std::string data;
+        connection->mutable_recv_buffer().ReadAll(&data);
+        return connection->SendPacket(data);
+      });
+  TcpServer server;
+  ASSERT_TRUE(server.Launch(server_address, server_options));
+
+  std::mutex mutex;
+  std::shared_ptr<TcpConnection> client_connection;
+  std::string echoed;
+  client_options.set_connected_callback(
+      [&] (const std::shared_ptr<TcpConnection>& connection) {
+        std::lock_guard<std::mutex> guard(mutex);
+        client_connection = connection;
+        return true;
+      });
+  client_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& connection) {
+        std::lock_guard<std::mutex> guard(mutex);
+        connection->mutable_recv_buffer().ReadAll(&echoed);
+        return true;
+      });
+  TcpClient client;
+  ASSERT_TRUE(client.Launch("echo", client_options));
+  ASSERT_NE(kInvalidConnectionId,
+            client.Connect(&server_address, client_options));
+
+  auto wait_for = [&] (std::function<bool()> done) {
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (std::chrono::steady_clock::now() < deadline) {
+      {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (done()) {
+          return;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  };
+  wait_for([&] { return client_connection != nullptr; });
+  std::shared_ptr<TcpConnection> connection;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    connection = client_connection;
+  }
+  ASSERT_TRUE(connection);
+
+  // far more than the socket buffers hold, so the writes wait for writable
+  // events
+  std::string sent;
+  for (int i = 0; i < 200; ++i) {
+    std::string data(1000 + i * 997, static_cast<char>('a' + i % 26));
+    ASSERT_TRUE(connection->SendPacket(data));
+    sent += data;
+  }
+  wait_for([&] { return echoed.size() >= sent.size(); });
+
+  client.Shutdown();
+  server.Shutdown();
+  std::lock_guard<std::mutex> guard(mutex);
+  ASSERT_TRUE(sent == echoed);
+}
+
+}  // namespace tcp
+}  // namespace cnetpp
+
+#endif  // CNETPP_UNITTESTS_TCP_ECHO_TEST_H_
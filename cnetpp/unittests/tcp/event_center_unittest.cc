@@ -0,0 +1,174 @@
+#include <cnetpp/tcp/event_center.h>
+#include <cnetpp/tcp/command.h>
+#include <cnetpp/tcp/connection_factory.h>
+#include <cnetpp/tcp/event.h>
+#include <cnetpp/tcp/tcp_connection.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using cnetpp::tcp::Command;
+using cnetpp::tcp::ConnectionBase;
+using cnetpp::tcp::ConnectionFactory;
+using cnetpp::tcp::Event;
+using cnetpp::tcp::EventCenter;
+using cnetpp::tcp::TcpConnection;
+
+// true if done() turns true within 10 seconds
+bool WaitFor(const std::function<bool()>& done) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+std::shared_ptr<TcpConnection> NewConnection(
+    std::shared_ptr<EventCenter> event_center, int fd) {
+  ConnectionFactory cf;
+  auto connection = std::static_pointer_cast<TcpConnection>(
+      cf.CreateConnection(event_center, fd, false));
+  connection->set_state(TcpConnection::State::kConnected);
+  return connection;
+}
+
+// Runs 'body' on the only event poller thread of 'event_center', within the
+// received callback of a connection of its own, and waits for it.
+void RunOnEventPoller(std::shared_ptr<EventCenter> event_center,
+                      std::function<void()> body) {
+  int fds[2];
+  ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+  std::atomic<bool> done { false };
+  auto driver = NewConnection(event_center, fds[0]);
+  driver->set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& connection) {
+        std::string data;
+        connection->mutable_recv_buffer().ReadAll(&data);
+        if (!data.empty() && !done) {
+          body();
+          done = true;
+        }
+        return true;
+      });
+  event_center->AddCommand(
+      Command(static_cast<int>(Command::Type::kAddConn), driver), true);
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  ASSERT_TRUE(WaitFor([&] { return done.load(); }));
+  driver->MarkAsClosed(true);
+  ::close(fds[1]);
+}
+
+}  // namespace
+
+// The events of a connection which are still on their way when its fd is
+// closed and reused by another connection are not delivered to the new one.
+TEST(EventCenter, StaleGenerationDropped) {
+  auto event_center = EventCenter::New("gen", 1);
+  ASSERT_TRUE(event_center->Launch());
+
+  int received = 0;
+  int closed_fd = -1;
+  uint32_t old_generation = 0;
+  uint32_t new_generation = 0;
+  int received_on_stale = -1;
+  RunOnEventPoller(event_center, [&] () {
+    int fds[2];
+    ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    auto old_connection = NewConnection(event_center, fds[0]);
+    event_center->AddCommand(
+        Command(static_cast<int>(Command::Type::kAddConn), old_connection),
+        false);
+    old_generation = old_connection->generation();
+    // closes its fd at once
+    old_connection->MarkAsClosed(true);
+    ::close(fds[1]);
+    closed_fd = fds[0];
+
+    ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    if (fds[0] != closed_fd) {
+      ASSERT_EQ(closed_fd, ::dup2(fds[0], closed_fd));
+      ::close(fds[0]);
+    }
+    auto new_connection = NewConnection(event_center, closed_fd);
+    new_connection->set_received_callback(
+        [&] (const std::shared_ptr<TcpConnection>& connection) {
+          std::string data;
+          connection->mutable_recv_buffer().ReadAll(&data);
+          received += static_cast<int>(data.size());
+          return true;
+        });
+    event_center->AddCommand(
+        Command(static_cast<int>(Command::Type::kAddConn), new_connection),
+        false);
+    new_generation = new_connection->generation();
+    ASSERT_EQ(1, ::write(fds[1], "y", 1));
+
+    // the event of the old connection, then the one of the new connection
+    int read = static_cast<int>(Event::Type::kRead);
+    event_center->ProcessEvent(Event(closed_fd, read, old_generation), 0);
+    received_on_stale = received;
+    event_center->ProcessEvent(Event(closed_fd, read, new_generation), 0);
+
+    new_connection->MarkAsClosed(true);
+    ::close(fds[1]);
+  });
+
+  event_center->Shutdown();
+  ASSERT_NE(old_generation, new_generation);
+  ASSERT_EQ(0, received_on_stale);
+  ASSERT_EQ(1, received);
+}
+
+// A command borrowing its connection may remove it, the event center keeps
+// it alive till the next loop, so that the caller can still touch it.
+TEST(EventCenter, BorrowedConnectionOutlivesRemoval) {
+  auto event_center = EventCenter::New("borrow", 1);
+  ASSERT_TRUE(event_center->Launch());
+
+  std::weak_ptr<ConnectionBase> removed;
+  bool alive_after_removal = false;
+  bool closed_after_removal = false;
+  RunOnEventPoller(event_center, [&] () {
+    int fds[2];
+    ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds));
+    ConnectionBase* connection = nullptr;
+    {
+      auto owner = NewConnection(event_center, fds[0]);
+      event_center->AddCommand(
+          Command(static_cast<int>(Command::Type::kAddConn), owner), false);
+      connection = owner.get();
+      removed = owner;
+    }
+    // owned by the event center only
+    event_center->AddCommand(
+        Command(static_cast<int>(Command::Type::kRemoveConnImmediately),
+                connection),
+        false);
+    alive_after_removal = !removed.expired();
+    closed_after_removal =
+        connection->state() == ConnectionBase::State::kClosed &&
+        !connection->socket().IsValid();
+    ::close(fds[1]);
+  });
+
+  // the driver has been closed by another loop, which drops the removed
+  // connections of the last one first
+  ASSERT_TRUE(WaitFor([&] { return removed.expired(); }));
+  event_center->Shutdown();
+  ASSERT_TRUE(alive_after_removal);
+  ASSERT_TRUE(closed_after_removal);
+}
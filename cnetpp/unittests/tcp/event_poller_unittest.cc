@@ -0,0 +1,166 @@
+#include <cnetpp/tcp/event_poller.h>
+#include <cnetpp/tcp/epoll_event_poller_impl.h>
+#include <cnetpp/tcp/io_uring_event_poller_impl.h>
+#include <cnetpp/tcp/poll_event_poller_impl.h>
+#include <cnetpp/tcp/select_event_poller_impl.h>
+#include <cnetpp/tcp/tcp_options.h>
+#include <cnetpp/base/end_point.h>
+
+#include <unistd.h>
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "echo_test.h"
+
+namespace {
+
+using cnetpp::base::EndPoint;
+using cnetpp::tcp::EventPoller;
+using cnetpp::tcp::TcpClientOptions;
+using cnetpp::tcp::TcpServerOptions;
+
+bool IoUringSupported() {
+#if defined(CNETPP_HAVE_IO_URING)
+  return cnetpp::tcp::IoUringEventPollerImpl::IsSupported();
+#else
+  return false;
+#endif
+}
+
+// The server and the client both run on event pollers of 'type'.
+void EchoTest(EventPoller::Type type, bool edge_triggered) {
+  auto server_address = EndPoint::UnixDomain("@cnetpp-poller-" +
+      std::to_string(::getpid()) + "-" +
+      std::to_string(static_cast<int>(type)));
+  TcpServerOptions server_options;
+  server_options.set_worker_count(2);
+  server_options.set_edge_triggered(edge_triggered);
+  server_options.set_event_poller_type(type);
+  TcpClientOptions client_options;
+  client_options.set_worker_count(1);
+  client_options.set_edge_triggered(edge_triggered);
+  client_options.set_event_poller_type(type);
+  cnetpp::tcp::EchoTest(server_address, server_options, client_options);
+}
+
+// exposes the adaptive busy polling of the epoll event poller
+class BusyPollEventPoller : public cnetpp::tcp::EpollEventPollerImpl {
+ public:
+  BusyPollEventPoller() : EpollEventPollerImpl(0, 1024) {
+  }
+
+  using EventPoller::BusyPollBudget;
+  using EventPoller::UpdateBusyPoll;
+};
+
+template <typename T>
+bool IsA(const std::shared_ptr<EventPoller>& event_poller) {
+  return std::dynamic_pointer_cast<T>(event_poller) != nullptr;
+}
+
+}  // namespace
+
+TEST(EventPoller, New) {
+  ASSERT_TRUE(IsA<cnetpp::tcp::EpollEventPollerImpl>(EventPoller::New(0)));
+  ASSERT_TRUE(IsA<cnetpp::tcp::EpollEventPollerImpl>(
+      EventPoller::New(0, 1024, false, EventPoller::Type::kEpoll)));
+  ASSERT_TRUE(IsA<cnetpp::tcp::PollEventPollerImpl>(
+      EventPoller::New(0, 1024, false, EventPoller::Type::kPoll)));
+  ASSERT_TRUE(IsA<cnetpp::tcp::SelectEventPollerImpl>(
+      EventPoller::New(0, 1024, false, EventPoller::Type::kSelect)));
+}
+
+TEST(EventPoller, NewIoUringFallback) {
+  auto event_poller =
+      EventPoller::New(0, 1024, false, EventPoller::Type::kIoUring);
+  if (IoUringSupported()) {
+#if defined(CNETPP_HAVE_IO_URING)
+    ASSERT_TRUE(IsA<cnetpp::tcp::IoUringEventPollerImpl>(event_poller));
+#endif
+    return;
+  }
+  // the default one instead, which works as requested
+  ASSERT_TRUE(IsA<cnetpp::tcp::EpollEventPollerImpl>(event_poller));
+  for (bool edge_triggered : { false, true }) {
+    EchoTest(EventPoller::Type::kIoUring, edge_triggered);
+  }
+}
+
+TEST(EventPoller, EchoEpoll) {
+  for (bool edge_triggered : { false, true }) {
+    EchoTest(EventPoller::Type::kEpoll, edge_triggered);
+  }
+}
+
+TEST(EventPoller, EchoIoUring) {
+  if (!IoUringSupported()) {
+    std::cout << "io_uring is not supported, skipped" << std::endl;
+    return;
+  }
+  // always edge-triggered, whichever is requested
+  for (bool edge_triggered : { false, true }) {
+    EchoTest(EventPoller::Type::kIoUring, edge_triggered);
+  }
+}
+
+TEST(EventPoller, EchoPoll) {
+  // the edge-triggered mode is ignored
+  for (bool edge_triggered : { false, true }) {
+    EchoTest(EventPoller::Type::kPoll, edge_triggered);
+  }
+}
+
+TEST(EventPoller, EchoSelect) {
+  // the edge-triggered mode is ignored
+  for (bool edge_triggered : { false, true }) {
+    EchoTest(EventPoller::Type::kSelect, edge_triggered);
+  }
+}
+
+// It spins while the events arrive more often than the budget, stops after
+// a few idle waits and spins again once they're frequent again.
+TEST(EventPoller, AdaptiveBusyPoll) {
+  const int64_t kBusyPollUs = 100;
+  BusyPollEventPoller event_poller;
+  ASSERT_EQ(0, event_poller.BusyPollBudget());
+  event_poller.set_busy_poll_us(kBusyPollUs);
+
+  auto spinning = [&] () {
+    int64_t budget = event_poller.BusyPollBudget();
+    EXPECT_LE(budget, kBusyPollUs);
+    EXPECT_TRUE(budget == 0 || budget >= kBusyPollUs / 4);
+    return budget > 0;
+  };
+  ASSERT_TRUE(spinning());
+  // frequent events keep it spinning
+  for (int i = 0; i < 100; ++i) {
+    event_poller.UpdateBusyPoll(10);
+    ASSERT_TRUE(spinning());
+  }
+
+  // idle for seconds
+  int waits = 0;
+  while (spinning()) {
+    event_poller.UpdateBusyPoll(5 * 1000 * 1000);
+    ASSERT_LT(++waits, 8);
+  }
+  for (int i = 0; i < 100; ++i) {
+    event_poller.UpdateBusyPoll(5 * 1000 * 1000);
+    ASSERT_FALSE(spinning());
+  }
+
+  // the long waits above are clamped, so the traffic resuming turns it back
+  // soon
+  waits = 0;
+  while (!spinning()) {
+    event_poller.UpdateBusyPoll(10);
+    ASSERT_LT(++waits, 16);
+  }
+
+  event_poller.set_busy_poll_us(0);
+  ASSERT_FALSE(spinning());
+}
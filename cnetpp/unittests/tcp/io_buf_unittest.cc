@@ -0,0 +1,102 @@
+#include <cnetpp/tcp/io_buf.h>
+
+#include <sys/uio.h>
+
+#include <memory>
+#include <string>
+
+#include <gtest/gtest.h>
+
+TEST(IOBuf, Test01) {
+  std::string data(100, 'a');
+  const char* bytes = data.data();
+  cnetpp::tcp::IOBuf buf(std::move(data));
+  ASSERT_EQ(100, buf.Size());
+  ASSERT_EQ(1, buf.NumSlices());
+  struct iovec read_positions[4];
+  ASSERT_EQ(1, buf.GetReadPositions(read_positions, 4));
+  // the string is adopted rather than copied
+  ASSERT_EQ(bytes, read_positions[0].iov_base);
+  ASSERT_EQ(100, read_positions[0].iov_len);
+
+  cnetpp::tcp::IOBuf empty { std::string() };
+  ASSERT_TRUE(empty.Empty());
+  ASSERT_EQ(0, empty.NumSlices());
+  ASSERT_EQ(0, empty.GetReadPositions(read_positions, 4));
+}
+
+TEST(IOBuf, Test02) {
+  auto shared = std::make_shared<const std::string>("0123456789");
+  cnetpp::tcp::IOBuf buf = cnetpp::tcp::IOBuf::Copy("abc");
+  buf.Append(cnetpp::tcp::IOBuf(shared));
+  buf.Append(cnetpp::tcp::IOBuf(shared, shared->data() + 5, 3));
+  ASSERT_EQ(16, buf.Size());
+  ASSERT_EQ(3, buf.NumSlices());
+  ASSERT_EQ("abc0123456789567", buf.ToString());
+
+  // a copy shares the slices
+  cnetpp::tcp::IOBuf copy(buf);
+  ASSERT_EQ(5, shared.use_count());
+
+  struct iovec read_positions[2];
+  ASSERT_EQ(2, buf.GetReadPositions(read_positions, 2));
+  ASSERT_EQ(3, read_positions[0].iov_len);
+  ASSERT_EQ(shared->data(), read_positions[1].iov_base);
+
+  // commit across the slice boundaries
+  buf.CommitRead(5);
+  ASSERT_EQ(11, buf.Size());
+  ASSERT_EQ(2, buf.NumSlices());
+  ASSERT_EQ("23456789567", buf.ToString());
+  buf.CommitRead(8);
+  ASSERT_EQ(1, buf.NumSlices());
+  ASSERT_EQ("567", buf.ToString());
+  buf.CommitRead(3);
+  ASSERT_TRUE(buf.Empty());
+  ASSERT_EQ(0, buf.NumSlices());
+  ASSERT_EQ(3, shared.use_count());
+  ASSERT_EQ("abc0123456789567", copy.ToString());
+}
+
+TEST(IOBuf, Test03) {
+  // more slices than the inline one, read and refilled from the front
+  auto shared = std::make_shared<const std::string>("0123456789");
+  cnetpp::tcp::IOBuf buf;
+  std::string expected;
+  for (int i = 0; i < 10; ++i) {
+    buf.Append(cnetpp::tcp::IOBuf(shared, shared->data() + i, 1));
+    expected += static_cast<char>('0' + i);
+  }
+  ASSERT_EQ(10, buf.NumSlices());
+  ASSERT_EQ(expected, buf.ToString());
+
+  struct iovec read_positions[16];
+  ASSERT_EQ(4, buf.GetReadPositions(read_positions, 4));
+  ASSERT_EQ(shared->data() + 3, read_positions[3].iov_base);
+  buf.CommitRead(7);
+  ASSERT_EQ(3, buf.NumSlices());
+  ASSERT_EQ("789", buf.ToString());
+  ASSERT_EQ(3, buf.GetReadPositions(read_positions, 16));
+  ASSERT_EQ(shared->data() + 7, read_positions[0].iov_base);
+
+  cnetpp::tcp::IOBuf other = cnetpp::tcp::IOBuf::Copy("ab");
+  other.Append(cnetpp::tcp::IOBuf::Copy("cd"));
+  buf.Append(std::move(other));
+  ASSERT_TRUE(other.Empty());
+  ASSERT_EQ(0, other.NumSlices());
+  ASSERT_EQ(5, buf.NumSlices());
+  ASSERT_EQ("789abcd", buf.ToString());
+  buf.CommitRead(7);
+  ASSERT_TRUE(buf.Empty());
+  ASSERT_EQ(1, shared.use_count());
+
+  // the moved-from one is empty and reusable
+  buf.Append(cnetpp::tcp::IOBuf::Copy("xyz"));
+  cnetpp::tcp::IOBuf moved(std::move(buf));
+  ASSERT_TRUE(buf.Empty());
+  ASSERT_EQ(0, buf.NumSlices());
+  ASSERT_EQ("", buf.ToString());
+  buf.Append(moved);
+  ASSERT_EQ("xyz", buf.ToString());
+  ASSERT_EQ("xyz", moved.ToString());
+}
@@ -1,6 +1,7 @@
 #include <cnetpp/tcp/ring_buffer.h>
 
 #include <sys/uio.h>
+#include <string.h>
 
 #include <string>
 
@@ -410,3 +411,61 @@ TEST(RingBuffer, FindCharAndReform4) {
   ASSERT_EQ("41", result.as_string());
 }
 
+
+TEST(RingBuffer, FindInMirrored) {
+  cnetpp::tcp::RingBuffer rb(0);
+  ASSERT_TRUE(rb.SetMirrored(true));
+  ASSERT_TRUE(rb.Resize(100));
+  if (!rb.mirrored()) {
+    // memfd is not available
+    return;
+  }
+  size_t capacity = rb.Capacity();
+  ASSERT_LE(100, capacity);
+  std::string data(capacity - 4, 'x');
+  ASSERT_TRUE(rb.Write(data));
+  ASSERT_TRUE(rb.Read(&data, capacity - 4));
+  // wraps around the end of the storage
+  ASSERT_TRUE(rb.Write("0123456789\n"));
+  struct iovec read_positions[2];
+  rb.GetReadPositions(read_positions, 2);
+  ASSERT_EQ(11, read_positions[0].iov_len);
+  ASSERT_EQ(0, read_positions[1].iov_len);
+  const char* begin = static_cast<const char*>(read_positions[0].iov_base);
+  ASSERT_EQ(0, ::memcmp(begin, "0123456789\n", 11));
+
+  cnetpp::base::StringPiece result;
+  ASSERT_TRUE(rb.Find('\n', &result));
+  ASSERT_EQ("0123456789", result.as_string());
+  // not moved
+  ASSERT_EQ(begin, result.data());
+
+  uint32_t value = 0;
+  ASSERT_TRUE(rb.ReadUint32(&value));
+  ASSERT_EQ(0x30313233u, value);
+  ASSERT_EQ(7, rb.Size());
+
+  struct iovec write_positions[2];
+  rb.GetWritePositions(write_positions, 2);
+  ASSERT_EQ(capacity - 7, write_positions[0].iov_len);
+  ASSERT_EQ(0, write_positions[1].iov_len);
+}
+
+TEST(RingBuffer, FindCharAndReformOverlapped) {
+  cnetpp::tcp::RingBuffer rb(10);
+  ASSERT_TRUE(rb.Write("abcdefghij"));
+  std::string data;
+  ASSERT_TRUE(rb.Read(&data, 3));
+  ASSERT_EQ("abc", data);
+  // wraps around, and the readable data is longer than its new offset, so
+  // the head of the data moves onto itself
+  ASSERT_TRUE(rb.Write("\n"));
+  ASSERT_EQ(8, rb.Size());
+
+  cnetpp::base::StringPiece result;
+  ASSERT_TRUE(rb.Find('\n', &result));
+  ASSERT_EQ("defghij", result.as_string());
+  std::string rest;
+  ASSERT_TRUE(rb.Read(&rest, 8));
+  ASSERT_EQ("defghij\n", rest);
+}
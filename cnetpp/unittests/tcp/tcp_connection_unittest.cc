@@ -0,0 +1,724 @@
+#include <cnetpp/tcp/tcp_connection.h>
+#include <cnetpp/tcp/tcp_server.h>
+#include <cnetpp/tcp/tcp_client.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using cnetpp::base::EndPoint;
+using cnetpp::base::IPAddress;
+using cnetpp::tcp::IOBuf;
+using cnetpp::tcp::RingBuffer;
+using cnetpp::tcp::TcpClient;
+using cnetpp::tcp::TcpClientOptions;
+using cnetpp::tcp::TcpConnection;
+using cnetpp::tcp::TcpServer;
+using cnetpp::tcp::TcpServerOptions;
+
+bool WaitFor(std::function<bool()> done) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+// a port of the loopback which is free for now
+int UnusedPort() {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  ::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(addr);
+  int port = -1;
+  if (::bind(fd, reinterpret_cast<struct sockaddr*>(&addr), length) == 0 &&
+      ::getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                    &length) == 0) {
+    port = ntohs(addr.sin_port);
+  }
+  ::close(fd);
+  return port;
+}
+
+// A server and a client connected over the loopback. The tests set their
+// callbacks on server_options and client_options before Start(), the
+// connected callbacks are taken to catch the connections.
+class Loopback {
+ public:
+  explicit Loopback(bool edge_triggered) {
+    server_options.set_worker_count(1);
+    server_options.set_edge_triggered(edge_triggered);
+    client_options.set_worker_count(1);
+    client_options.set_edge_triggered(edge_triggered);
+  }
+
+  ~Loopback() {
+    Stop();
+  }
+
+  bool Start() {
+    EndPoint server_address(IPAddress("127.0.0.1"), UnusedPort());
+    auto server_connected = server_options.connected_callback();
+    server_options.set_connected_callback(
+        [this, server_connected] (const std::shared_ptr<TcpConnection>& c) {
+          {
+            std::lock_guard<std::mutex> guard(mutex_);
+            server_connection_ = c;
+          }
+          return !server_connected || server_connected(c);
+        });
+    auto client_connected = client_options.connected_callback();
+    client_options.set_connected_callback(
+        [this, client_connected] (const std::shared_ptr<TcpConnection>& c) {
+          {
+            std::lock_guard<std::mutex> guard(mutex_);
+            client_connection_ = c;
+          }
+          return !client_connected || client_connected(c);
+        });
+    if (!server_.Launch(server_address, server_options) ||
+        !client_.Launch("lo", client_options)) {
+      return false;
+    }
+    running_ = true;
+    if (client_.Connect(&server_address, client_options) ==
+        cnetpp::tcp::kInvalidConnectionId) {
+      return false;
+    }
+    return WaitFor([this] {
+      return server_connection() && client_connection();
+    });
+  }
+
+  void Stop() {
+    if (running_) {
+      running_ = false;
+      client_.Shutdown();
+      server_.Shutdown();
+    }
+  }
+
+  std::shared_ptr<TcpConnection> server_connection() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return server_connection_;
+  }
+  std::shared_ptr<TcpConnection> client_connection() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return client_connection_;
+  }
+
+  TcpServerOptions server_options;
+  TcpClientOptions client_options;
+
+ private:
+  TcpServer server_;
+  TcpClient client_;
+  bool running_ { false };
+  std::mutex mutex_;
+  std::shared_ptr<TcpConnection> server_connection_;
+  std::shared_ptr<TcpConnection> client_connection_;
+};
+
+// The server queues a large packet and many small ones behind it, more than
+// one writev() gathers, and closes gracefully from its first sent callback,
+// which flushes the rest while the first writable event is still handled.
+// No sent callback is called once it's closed.
+void CloseFromSentCallbackTest(bool edge_triggered) {
+  const size_t kLargeLength = 4 * 1024 * 1024;
+  const size_t kSmallPackets = 3000;
+  Loopback loopback(edge_triggered);
+  std::atomic<size_t> sent_packets { 0 };
+  std::atomic<bool> server_closed { false };
+  loopback.server_options.set_received_callback(
+      [=] (const std::shared_ptr<TcpConnection>& c) {
+        c->mutable_recv_buffer().CommitRead(c->mutable_recv_buffer().Size());
+        EXPECT_TRUE(c->SendPacket(std::string(kLargeLength, 'x')));
+        for (size_t i = 0; i < kSmallPackets; ++i) {
+          EXPECT_TRUE(c->SendPacket("0123456789"));
+        }
+        return true;
+      });
+  loopback.server_options.set_sent_callback(
+      [&] (bool success, const std::shared_ptr<TcpConnection>& c) {
+        EXPECT_TRUE(success);
+        EXPECT_FALSE(server_closed);
+        if (sent_packets++ == 0) {
+          c->MarkAsClosed(false);
+        }
+        return true;
+      });
+  loopback.server_options.set_closed_callback(
+      [&] (const std::shared_ptr<TcpConnection>&) {
+        server_closed = true;
+        return true;
+      });
+  std::atomic<size_t> received_length { 0 };
+  std::atomic<bool> client_closed { false };
+  loopback.client_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        received_length += c->mutable_recv_buffer().Size();
+        c->mutable_recv_buffer().CommitRead(c->mutable_recv_buffer().Size());
+        return true;
+      });
+  loopback.client_options.set_closed_callback(
+      [&] (const std::shared_ptr<TcpConnection>&) {
+        client_closed = true;
+        return true;
+      });
+  ASSERT_TRUE(loopback.Start());
+  ASSERT_TRUE(loopback.client_connection()->SendPacket("go"));
+
+  ASSERT_TRUE(WaitFor([&] { return client_closed && server_closed; }));
+  ASSERT_EQ(kLargeLength + kSmallPackets * 10, received_length);
+  ASSERT_LE(1u, sent_packets);
+  ASSERT_GE(kSmallPackets + 1, sent_packets);
+}
+
+// The server writes much more than the high watermark to a slow reader from
+// a thread other than its event poller, so the event poller drains the queue
+// while it's being filled.
+void WatermarksTest(bool edge_triggered) {
+  const size_t kHighWatermark = 1024 * 1024;
+  const size_t kLowWatermark = 256 * 1024;
+  const size_t kPacketLength = 16 * 1024;
+  const size_t kPackets = 1024;
+  Loopback loopback(edge_triggered);
+  loopback.server_options.set_tcp_send_buffer_size(64 * 1024);
+  loopback.server_options.set_send_high_watermark(kHighWatermark);
+  loopback.server_options.set_send_low_watermark(kLowWatermark);
+  loopback.server_options.set_pause_reading_on_high_watermark(true);
+  std::atomic<int> highs { 0 };
+  std::atomic<int> lows { 0 };
+  std::atomic<size_t> max_queued { 0 };
+  loopback.server_options.set_high_watermark_callback(
+      [&] (const std::shared_ptr<TcpConnection>&, size_t queued) {
+        EXPECT_LE(kHighWatermark, queued);
+        max_queued = std::max(max_queued.load(), queued);
+        EXPECT_EQ(lows, highs++);
+      });
+  loopback.server_options.set_low_watermark_callback(
+      [&] (const std::shared_ptr<TcpConnection>&, size_t queued) {
+        EXPECT_GE(kLowWatermark, queued);
+        EXPECT_EQ(highs, ++lows);
+      });
+  std::atomic<size_t> server_received { 0 };
+  loopback.server_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        server_received += c->mutable_recv_buffer().Size();
+        c->mutable_recv_buffer().CommitRead(c->mutable_recv_buffer().Size());
+        return true;
+      });
+  loopback.client_options.set_tcp_receive_buffer_size(64 * 1024);
+  std::atomic<size_t> client_received { 0 };
+  loopback.client_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        client_received += c->mutable_recv_buffer().Size();
+        c->mutable_recv_buffer().CommitRead(c->mutable_recv_buffer().Size());
+        // a slow reader
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        return true;
+      });
+  ASSERT_TRUE(loopback.Start());
+
+  auto connection = loopback.server_connection();
+  for (size_t i = 0; i < kPackets; ++i) {
+    ASSERT_TRUE(connection->SendPacket(std::string(kPacketLength, 'x')));
+    // never wraps around
+    ASSERT_GE(kPackets * kPacketLength, connection->queued_bytes());
+  }
+  ASSERT_TRUE(WaitFor([&] {
+    return client_received == kPackets * kPacketLength;
+  }));
+  ASSERT_TRUE(WaitFor([&] { return lows == highs; }));
+  ASSERT_LE(1, highs);
+  ASSERT_GE(kPackets * kPacketLength, max_queued);
+  ASSERT_EQ(0u, connection->queued_bytes());
+
+  // reading has been resumed
+  ASSERT_TRUE(loopback.client_connection()->SendPacket("ping"));
+  ASSERT_TRUE(WaitFor([&] { return server_received == 4; }));
+}
+
+// The server queues more packets than one writev() gathers, of every kind
+// SendPacket() takes, from a thread other than its event poller, and the
+// small socket buffers split them at arbitrary bytes. They arrive complete
+// and in order, and every one of them is reported sent once.
+void GatherTest(bool edge_triggered) {
+  const size_t kPackets = 3000;
+  Loopback loopback(edge_triggered);
+  loopback.server_options.set_tcp_send_buffer_size(16 * 1024);
+  std::atomic<size_t> sent_packets { 0 };
+  loopback.server_options.set_sent_callback(
+      [&] (bool success, const std::shared_ptr<TcpConnection>&) {
+        EXPECT_TRUE(success);
+        sent_packets++;
+        return true;
+      });
+  loopback.client_options.set_tcp_receive_buffer_size(16 * 1024);
+  std::mutex mutex;
+  std::string received;
+  std::atomic<size_t> received_length { 0 };
+  loopback.client_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        std::lock_guard<std::mutex> guard(mutex);
+        c->mutable_recv_buffer().ReadAll(&received);
+        received_length = received.size();
+        return true;
+      });
+  ASSERT_TRUE(loopback.Start());
+
+  auto connection = loopback.server_connection();
+  std::string sent;
+  for (size_t i = 0; i < kPackets; ++i) {
+    std::string data(1 + i * 7 % 2000, static_cast<char>('a' + i % 26));
+    sent += data;
+    switch (i % 4) {
+      case 0:
+        ASSERT_TRUE(connection->SendPacket(data));
+        break;
+      case 1:
+        ASSERT_TRUE(connection->SendPacket(IOBuf(std::move(data))));
+        break;
+      case 2: {
+        // a chain of two slices
+        IOBuf chain(std::string(data, 0, data.size() / 2));
+        chain.Append(IOBuf(std::string(data, data.size() / 2)));
+        ASSERT_TRUE(connection->SendPacket(std::move(chain)));
+        break;
+      }
+      default: {
+        std::unique_ptr<RingBuffer> buffer(new RingBuffer(data.size()));
+        ASSERT_TRUE(buffer->Write(data));
+        ASSERT_TRUE(connection->SendPacket(std::move(buffer)));
+        break;
+      }
+    }
+  }
+
+  ASSERT_TRUE(WaitFor([&] { return received_length == sent.size(); }));
+  ASSERT_TRUE(WaitFor([&] { return sent_packets == kPackets; }));
+  std::lock_guard<std::mutex> guard(mutex);
+  ASSERT_EQ(sent, received);
+}
+
+// The large packets are sent with MSG_ZEROCOPY, unless the socket doesn't
+// support it, and the small ones are copied in between, some of them written
+// directly as they are sent from the received callback. The server closes
+// gracefully right after queueing them, so the completions arrive while it's
+// closing. The stream is intact, and every packet is reported sent once
+// before the connection is closed.
+void ZeroCopyTest(bool edge_triggered) {
+  const size_t kPackets = 64;
+  const size_t kLargeLength = 256 * 1024;
+  const size_t kSmallLength = 100;
+  Loopback loopback(edge_triggered);
+  loopback.server_options.set_zero_copy_threshold(64 * 1024);
+  loopback.server_options.set_tcp_send_buffer_size(64 * 1024);
+  std::string sent;
+  std::vector<std::string> packets;
+  for (size_t i = 0; i < kPackets; ++i) {
+    packets.emplace_back(i % 4 == 3 ? kLargeLength : kSmallLength,
+                         static_cast<char>('a' + i % 26));
+    sent += packets.back();
+  }
+  std::atomic<size_t> sent_packets { 0 };
+  std::atomic<bool> server_closed { false };
+  loopback.server_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        c->mutable_recv_buffer().CommitRead(c->mutable_recv_buffer().Size());
+        for (auto& packet : packets) {
+          EXPECT_TRUE(c->SendPacket(IOBuf(std::string(packet))));
+        }
+        c->MarkAsClosed(false);
+        return true;
+      });
+  loopback.server_options.set_sent_callback(
+      [&] (bool success, const std::shared_ptr<TcpConnection>&) {
+        EXPECT_TRUE(success);
+        EXPECT_FALSE(server_closed);
+        sent_packets++;
+        return true;
+      });
+  loopback.server_options.set_closed_callback(
+      [&] (const std::shared_ptr<TcpConnection>&) {
+        server_closed = true;
+        return true;
+      });
+  std::mutex mutex;
+  std::string received;
+  std::atomic<bool> client_closed { false };
+  loopback.client_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        std::lock_guard<std::mutex> guard(mutex);
+        c->mutable_recv_buffer().ReadAll(&received);
+        return true;
+      });
+  loopback.client_options.set_closed_callback(
+      [&] (const std::shared_ptr<TcpConnection>&) {
+        client_closed = true;
+        return true;
+      });
+  ASSERT_TRUE(loopback.Start());
+  ASSERT_TRUE(loopback.client_connection()->SendPacket("go"));
+
+  ASSERT_TRUE(WaitFor([&] { return client_closed && server_closed; }));
+  ASSERT_EQ(kPackets, sent_packets);
+  std::lock_guard<std::mutex> guard(mutex);
+  ASSERT_EQ(sent, received);
+}
+
+// A temporary file holding 'data', removed at once as the fd is enough.
+int TemporaryFile(const std::string& data) {
+  char path[] = "/tmp/cnetpp-send-file-XXXXXX";
+  int fd = ::mkstemp(path);
+  if (fd >= 0) {
+    ::unlink(path);
+    if (::write(fd, data.data(), data.size()) !=
+        static_cast<ssize_t>(data.size())) {
+      ::close(fd);
+      return -1;
+    }
+  }
+  return fd;
+}
+
+// Part of a file is sent by sendfile() and the data of a pipe by splice(),
+// queued from a thread other than the event poller between the packets of
+// memory, and with a small socket buffer, so that both are sent in pieces.
+void SendFileTest(bool edge_triggered) {
+  const size_t kFileLength = 1024 * 1024 + 123;
+  const size_t kFileOffset = 1000;
+  const size_t kFileRegionLength = 512 * 1024;
+  const size_t kPipeLength = 32 * 1024;
+  Loopback loopback(edge_triggered);
+  loopback.server_options.set_tcp_send_buffer_size(16 * 1024);
+  std::atomic<size_t> sent_packets { 0 };
+  loopback.server_options.set_sent_callback(
+      [&] (bool success, const std::shared_ptr<TcpConnection>&) {
+        EXPECT_TRUE(success);
+        sent_packets++;
+        return true;
+      });
+  std::mutex mutex;
+  std::string received;
+  std::atomic<size_t> received_length { 0 };
+  loopback.client_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        std::lock_guard<std::mutex> guard(mutex);
+        c->mutable_recv_buffer().ReadAll(&received);
+        received_length = received.size();
+        return true;
+      });
+  ASSERT_TRUE(loopback.Start());
+
+  std::string file_data;
+  for (size_t i = 0; i < kFileLength; ++i) {
+    file_data.push_back(static_cast<char>(i % 251));
+  }
+  int file_fd = TemporaryFile(file_data);
+  ASSERT_LE(0, file_fd);
+  std::string pipe_data(kPipeLength, 'p');
+  int pipe_fds[2];
+  ASSERT_EQ(0, ::pipe(pipe_fds));
+  ASSERT_EQ(static_cast<ssize_t>(kPipeLength),
+            ::write(pipe_fds[1], pipe_data.data(), kPipeLength));
+
+  auto connection = loopback.server_connection();
+  ASSERT_TRUE(connection->SendPacket("head"));
+  ASSERT_TRUE(connection->SendFile(file_fd, kFileOffset, kFileRegionLength));
+  ASSERT_TRUE(connection->SendPacket("middle"));
+  ASSERT_TRUE(connection->SendFile(pipe_fds[0], 0, kPipeLength));
+  ASSERT_TRUE(connection->SendPacket("tail"));
+  // the fds are duplicated
+  ::close(file_fd);
+  ::close(pipe_fds[0]);
+  ::close(pipe_fds[1]);
+
+  std::string sent = "head" +
+      file_data.substr(kFileOffset, kFileRegionLength) + "middle" +
+      pipe_data + "tail";
+  ASSERT_TRUE(WaitFor([&] { return received_length == sent.size(); }));
+  ASSERT_TRUE(WaitFor([&] { return sent_packets == 5; }));
+  std::lock_guard<std::mutex> guard(mutex);
+  ASSERT_EQ(sent, received);
+}
+
+// The connection is closed once a file ends before the promised length has
+// been sent, after the part there is.
+void SendShortFileTest(bool edge_triggered) {
+  Loopback loopback(edge_triggered);
+  std::atomic<bool> server_closed { false };
+  loopback.server_options.set_closed_callback(
+      [&] (const std::shared_ptr<TcpConnection>&) {
+        server_closed = true;
+        return true;
+      });
+  std::mutex mutex;
+  std::string received;
+  std::atomic<bool> client_closed { false };
+  loopback.client_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        std::lock_guard<std::mutex> guard(mutex);
+        c->mutable_recv_buffer().ReadAll(&received);
+        return true;
+      });
+  loopback.client_options.set_closed_callback(
+      [&] (const std::shared_ptr<TcpConnection>&) {
+        client_closed = true;
+        return true;
+      });
+  ASSERT_TRUE(loopback.Start());
+
+  int fd = TemporaryFile("0123456789");
+  ASSERT_LE(0, fd);
+  ASSERT_TRUE(loopback.server_connection()->SendFile(fd, 5, 100));
+  ::close(fd);
+
+  ASSERT_TRUE(WaitFor([&] { return client_closed && server_closed; }));
+  std::lock_guard<std::mutex> guard(mutex);
+  ASSERT_EQ("56789", received);
+}
+
+// A packet sent from the received callback is written at once when nothing
+// is queued, but no sent callback is called inside SendPacket(), only once
+// the received callback has returned. One sent behind a packet still queued
+// waits for its turn, and so do the packets sent from the sent callbacks.
+void DirectWriteTest(bool edge_triggered) {
+  const size_t kLargeLength = 8 * 1024 * 1024;
+  const size_t kChainedPackets = 1000;
+  Loopback loopback(edge_triggered);
+  loopback.server_options.set_tcp_send_buffer_size(64 * 1024);
+  // only touched by the event poller thread of the server
+  bool in_send_packet = false;
+  std::atomic<size_t> sent_packets { 0 };
+  loopback.server_options.set_sent_callback(
+      [&] (bool success, const std::shared_ptr<TcpConnection>& c) {
+        EXPECT_TRUE(success);
+        EXPECT_FALSE(in_send_packet);
+        size_t n = ++sent_packets;
+        // "last" is sent, go on from here, each packet sends the next one
+        if (n >= 3 && n < 3 + kChainedPackets) {
+          in_send_packet = true;
+          EXPECT_TRUE(c->SendPacket("chained"));
+          in_send_packet = false;
+        }
+        return true;
+      });
+  loopback.server_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        c->mutable_recv_buffer().CommitRead(c->mutable_recv_buffer().Size());
+        in_send_packet = true;
+        EXPECT_TRUE(c->SendPacket("first"));
+        // far more than the socket buffer holds
+        EXPECT_TRUE(c->SendPacket(std::string(kLargeLength, 'x')));
+        EXPECT_TRUE(c->SendPacket("last"));
+        in_send_packet = false;
+        EXPECT_EQ(0u, sent_packets);
+        return true;
+      });
+  std::mutex mutex;
+  std::string received;
+  std::atomic<size_t> received_length { 0 };
+  loopback.client_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        std::lock_guard<std::mutex> guard(mutex);
+        c->mutable_recv_buffer().ReadAll(&received);
+        received_length = received.size();
+        return true;
+      });
+  ASSERT_TRUE(loopback.Start());
+  ASSERT_TRUE(loopback.client_connection()->SendPacket("go"));
+
+  std::string sent = "first" + std::string(kLargeLength, 'x') + "last";
+  for (size_t i = 0; i < kChainedPackets; ++i) {
+    sent += "chained";
+  }
+  ASSERT_TRUE(WaitFor([&] { return received_length == sent.size(); }));
+  ASSERT_TRUE(WaitFor([&] { return sent_packets == 3 + kChainedPackets; }));
+  std::lock_guard<std::mutex> guard(mutex);
+  ASSERT_TRUE(sent == received);
+}
+
+// The server reads at most about read_budget bytes per readable event,
+// with the received callbacks coalesced into one per event, while the client
+// sends much more than that and closes gracefully right after. All of it is
+// delivered, in edge-triggered mode as well, where the rest is read without
+// another notification, and before the closed callback.
+void ReadBudgetTest(bool edge_triggered) {
+  const size_t kReadBudget = 16 * 1024;
+  const size_t kPacketLength = 64 * 1024;
+  const size_t kPackets = 64;
+  Loopback loopback(edge_triggered);
+  loopback.server_options.set_read_budget(kReadBudget);
+  loopback.server_options.set_coalesce_received_callbacks(true);
+  std::atomic<size_t> received_length { 0 };
+  std::atomic<size_t> max_event_length { 0 };
+  std::atomic<size_t> received_on_closed { 0 };
+  std::atomic<bool> server_closed { false };
+  loopback.server_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        size_t length = c->mutable_recv_buffer().Size();
+        EXPECT_LT(0u, length);
+        max_event_length = std::max(max_event_length.load(), length);
+        received_length += length;
+        c->mutable_recv_buffer().CommitRead(length);
+        return true;
+      });
+  loopback.server_options.set_closed_callback(
+      [&] (const std::shared_ptr<TcpConnection>&) {
+        received_on_closed = received_length.load();
+        server_closed = true;
+        return true;
+      });
+  ASSERT_TRUE(loopback.Start());
+
+  auto connection = loopback.client_connection();
+  for (size_t i = 0; i < kPackets; ++i) {
+    ASSERT_TRUE(connection->SendPacket(std::string(kPacketLength, 'x')));
+  }
+  connection->MarkAsClosed(false);
+
+  ASSERT_TRUE(WaitFor([&] { return server_closed.load(); }));
+  ASSERT_EQ(kPackets * kPacketLength, received_on_closed);
+  // the last read of an event may take as much as the receive buffer holds
+  ASSERT_GT(4 * kReadBudget, max_event_length);
+}
+
+// The receive buffer is kept between small messages and given back once the
+// connection is idle, while a buffer grown for a large message is given back
+// as soon as it's drained. The capacities are checked by timers on the event
+// poller thread, after the read events are done.
+void ReceiveBufferShrinkTest(bool edge_triggered) {
+  const size_t kLargeLength = 1024 * 1024;
+  Loopback loopback(edge_triggered);
+  std::atomic<int> after_small { -1 };
+  std::atomic<int> after_idle { -1 };
+  std::atomic<int> after_large { -1 };
+  loopback.server_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& c) {
+        auto& buffer = c->mutable_recv_buffer();
+        if (buffer.Size() == 5) {
+          buffer.CommitRead(buffer.Size());
+          c->AddTimer(100, [&] (std::shared_ptr<TcpConnection> c) {
+            after_small = c->mutable_recv_buffer().Capacity();
+          });
+          c->AddTimer(2500, [&] (std::shared_ptr<TcpConnection> c) {
+            after_idle = c->mutable_recv_buffer().Capacity();
+          });
+        } else if (buffer.Size() == kLargeLength) {
+          buffer.CommitRead(buffer.Size());
+          c->AddTimer(100, [&] (std::shared_ptr<TcpConnection> c) {
+            after_large = c->mutable_recv_buffer().Capacity();
+          });
+        }
+        return true;
+      });
+  ASSERT_TRUE(loopback.Start());
+
+  auto connection = loopback.client_connection();
+  ASSERT_TRUE(connection->SendPacket("small"));
+  ASSERT_TRUE(WaitFor([&] { return after_idle >= 0; }));
+  ASSERT_LT(0, after_small);
+  ASSERT_EQ(0, after_idle);
+
+  ASSERT_TRUE(connection->SendPacket(std::string(kLargeLength, 'x')));
+  ASSERT_TRUE(WaitFor([&] { return after_large >= 0; }));
+  ASSERT_EQ(0, after_large);
+}
+
+}  // namespace
+
+TEST(TcpConnection, CloseFromSentCallback) {
+  CloseFromSentCallbackTest(false);
+}
+
+TEST(TcpConnection, CloseFromSentCallbackEdgeTriggered) {
+  CloseFromSentCallbackTest(true);
+}
+
+TEST(TcpConnection, Gather) {
+  GatherTest(false);
+}
+
+TEST(TcpConnection, GatherEdgeTriggered) {
+  GatherTest(true);
+}
+
+TEST(TcpConnection, ZeroCopy) {
+  ZeroCopyTest(false);
+}
+
+TEST(TcpConnection, ZeroCopyEdgeTriggered) {
+  ZeroCopyTest(true);
+}
+
+TEST(TcpConnection, SendFile) {
+  SendFileTest(false);
+}
+
+TEST(TcpConnection, SendFileEdgeTriggered) {
+  SendFileTest(true);
+}
+
+TEST(TcpConnection, SendShortFile) {
+  SendShortFileTest(false);
+}
+
+TEST(TcpConnection, SendShortFileEdgeTriggered) {
+  SendShortFileTest(true);
+}
+
+TEST(TcpConnection, DirectWrite) {
+  DirectWriteTest(false);
+}
+
+TEST(TcpConnection, DirectWriteEdgeTriggered) {
+  DirectWriteTest(true);
+}
+
+TEST(TcpConnection, Watermarks) {
+  WatermarksTest(false);
+}
+
+TEST(TcpConnection, WatermarksEdgeTriggered) {
+  WatermarksTest(true);
+}
+
+TEST(TcpConnection, ReadBudget) {
+  ReadBudgetTest(false);
+}
+
+TEST(TcpConnection, ReadBudgetEdgeTriggered) {
+  ReadBudgetTest(true);
+}
+
+TEST(TcpConnection, ReceiveBufferShrink) {
+  ReceiveBufferShrinkTest(false);
+}
+
+TEST(TcpConnection, ReceiveBufferShrinkEdgeTriggered) {
+  ReceiveBufferShrinkTest(true);
+}
@@ -0,0 +1,550 @@
+#include <cnetpp/tcp/tcp_server.h>
+#include <cnetpp/tcp/tcp_client.h>
+#include <cnetpp/tcp/tcp_connection.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "echo_test.h"
+
+namespace {
+
+using cnetpp::base::EndPoint;
+using cnetpp::base::IPAddress;
+using cnetpp::tcp::EventCenter;
+using cnetpp::tcp::TcpClient;
+using cnetpp::tcp::TcpClientOptions;
+using cnetpp::tcp::TcpConnection;
+using cnetpp::tcp::TcpHandlerServer;
+using cnetpp::tcp::TcpServer;
+using cnetpp::tcp::TcpServerOptions;
+
+bool SocketFileExists(const std::string& path) {
+  struct stat st;
+  return ::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode);
+}
+
+void EchoTest(const EndPoint& server_address, bool edge_triggered) {
+  TcpServerOptions server_options;
+  server_options.set_worker_count(1);
+  server_options.set_edge_triggered(edge_triggered);
+  TcpClientOptions client_options;
+  client_options.set_worker_count(1);
+  client_options.set_edge_triggered(edge_triggered);
+  cnetpp::tcp::EchoTest(server_address, server_options, client_options);
+}
+
+std::string UniqueName(const std::string& prefix) {
+  return prefix + std::to_string(::getpid());
+}
+
+// true if done() turns true within 10 seconds
+bool WaitFor(const std::function<bool()>& done) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+// echoes what it receives and counts the events it's handed
+struct EchoHandler {
+  std::atomic<int> connected { 0 };
+  std::atomic<int> received { 0 };
+  std::atomic<int> sent { 0 };
+  std::atomic<int> closed { 0 };
+
+  bool OnConnected(TcpConnection&) {
+    connected++;
+    return true;
+  }
+  bool OnReceived(TcpConnection& connection) {
+    std::string data;
+    connection.mutable_recv_buffer().ReadAll(&data);
+    received++;
+    return connection.SendPacket(data);
+  }
+  bool OnSent(bool success, TcpConnection&) {
+    if (success) {
+      sent++;
+    }
+    return true;
+  }
+  bool OnClosed(TcpConnection&) {
+    closed++;
+    return true;
+  }
+};
+
+// the highest fd open in this process
+int MaxOpenFd() {
+  int max_fd = -1;
+  DIR* dir = ::opendir("/proc/self/fd");
+  if (!dir) {
+    return -1;
+  }
+  while (struct dirent* entry = ::readdir(dir)) {
+    if (entry->d_name[0] != '.') {
+      max_fd = std::max(max_fd, ::atoi(entry->d_name));
+    }
+  }
+  ::closedir(dir);
+  return max_fd;
+}
+
+}  // namespace
+
+TEST(TcpServer, EchoOverUnixDomainPath) {
+  for (bool edge_triggered : { false, true }) {
+    std::string path = "/tmp/" + UniqueName("cnetpp-tcp-") + ".sock";
+    EchoTest(EndPoint::UnixDomain(path), edge_triggered);
+    // removed by Shutdown()
+    ASSERT_FALSE(SocketFileExists(path));
+  }
+}
+
+TEST(TcpServer, EchoOverAbstractUnixDomain) {
+  for (bool edge_triggered : { false, true }) {
+    EchoTest(EndPoint::UnixDomain("@" + UniqueName("cnetpp-tcp-")),
+             edge_triggered);
+  }
+}
+
+TEST(TcpServer, UnixDomainPathInUse) {
+  std::string path = "/tmp/" + UniqueName("cnetpp-in-use-") + ".sock";
+  auto address = EndPoint::UnixDomain(path);
+  TcpServer server;
+  ASSERT_TRUE(server.Launch(address));
+  ASSERT_TRUE(SocketFileExists(path));
+
+  // the socket file of a live server is neither replaced nor removed, the
+  // listen socket throws as it can't be bound
+  TcpServer another;
+  ASSERT_ANY_THROW(another.Launch(address));
+  another.Shutdown();
+  ASSERT_TRUE(SocketFileExists(path));
+
+  server.Shutdown();
+  ASSERT_FALSE(SocketFileExists(path));
+}
+
+// With reuse_port every event poller listens on its own socket. Port 0 is
+// chosen by the kernel once and shared by all of them, and each accepts.
+TEST(TcpServer, ReusePortEphemeral) {
+  const size_t kEventPollers = 4;
+  const int kConnections = 64;
+  std::mutex mutex;
+  std::set<std::thread::id> accepting_threads;
+  std::atomic<int> accepted { 0 };
+  TcpServerOptions server_options;
+  server_options.set_worker_count(kEventPollers);
+  server_options.set_reuse_port(true);
+  server_options.set_connected_callback(
+      [&] (const std::shared_ptr<TcpConnection>&) {
+        {
+          // called by the event poller of the listen socket
+          std::lock_guard<std::mutex> guard(mutex);
+          accepting_threads.insert(std::this_thread::get_id());
+        }
+        accepted++;
+        return true;
+      });
+  TcpServer server;
+  ASSERT_TRUE(server.Launch(EndPoint(IPAddress("127.0.0.1"), 0),
+                            server_options));
+  EndPoint server_address = server.listen_address();
+  ASSERT_NE(0, server_address.port());
+
+  TcpClientOptions client_options;
+  client_options.set_worker_count(1);
+  TcpClient client;
+  ASSERT_TRUE(client.Launch("reuse", client_options));
+  for (int i = 0; i < kConnections; ++i) {
+    ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+              client.Connect(&server_address, client_options));
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (accepted < kConnections &&
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  client.Shutdown();
+  server.Shutdown();
+  ASSERT_EQ(kConnections, accepted);
+  // a listener left out would take none, it happens by chance with a
+  // probability of about 4 * (3/4)^64
+  std::lock_guard<std::mutex> guard(mutex);
+  ASSERT_EQ(kEventPollers, accepting_threads.size());
+}
+
+// A burst far beyond accept_budget is accepted in turns, in the
+// edge-triggered mode too where no new edge arrives for the rest.
+TEST(TcpServer, AcceptBudget) {
+  const int kConnections = 32;
+  for (bool edge_triggered : { false, true }) {
+    std::atomic<int> accepted { 0 };
+    TcpServerOptions server_options;
+    server_options.set_worker_count(1);
+    server_options.set_edge_triggered(edge_triggered);
+    server_options.set_accept_budget(1);
+    server_options.set_connected_callback(
+        [&] (const std::shared_ptr<TcpConnection>&) {
+          accepted++;
+          return true;
+        });
+    TcpServer server;
+    ASSERT_TRUE(server.Launch(EndPoint(IPAddress("127.0.0.1"), 0),
+                              server_options));
+    EndPoint server_address = server.listen_address();
+
+    TcpClientOptions client_options;
+    client_options.set_worker_count(1);
+    TcpClient client;
+    ASSERT_TRUE(client.Launch("budget", client_options));
+    for (int i = 0; i < kConnections; ++i) {
+      ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+                client.Connect(&server_address, client_options));
+    }
+    WaitFor([&] { return accepted == kConnections; });
+
+    client.Shutdown();
+    server.Shutdown();
+    ASSERT_EQ(kConnections, accepted);
+  }
+}
+
+// Out of fds, the listener backs off instead of spinning on EMFILE, and
+// picks up the pending connections once fds are available again, in the
+// edge-triggered mode too.
+TEST(TcpServer, AcceptOutOfFds) {
+  const int kConnections = 8;
+  for (bool edge_triggered : { false, true }) {
+    std::atomic<int> accepted { 0 };
+    TcpServerOptions server_options;
+    server_options.set_worker_count(1);
+    server_options.set_edge_triggered(edge_triggered);
+    server_options.set_connected_callback(
+        [&] (const std::shared_ptr<TcpConnection>&) {
+          accepted++;
+          return true;
+        });
+    TcpServer server;
+    ASSERT_TRUE(server.Launch(EndPoint(IPAddress("127.0.0.1"), 0),
+                              server_options));
+    EndPoint server_address = server.listen_address();
+    struct sockaddr_storage addr;
+    socklen_t addr_len = 0;
+    ASSERT_TRUE(server_address.ToSockAddr(
+          reinterpret_cast<struct sockaddr*>(&addr), &addr_len));
+
+    std::vector<int> client_fds;
+    for (int i = 0; i < kConnections; ++i) {
+      int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+      ASSERT_GE(fd, 0);
+      client_fds.push_back(fd);
+    }
+
+    // no fd is left: the limit is right above the highest one, and the
+    // holes below are filled
+    struct rlimit limit;
+    ASSERT_EQ(0, ::getrlimit(RLIMIT_NOFILE, &limit));
+    struct rlimit lowered = limit;
+    lowered.rlim_cur = MaxOpenFd() + 1;
+    ASSERT_EQ(0, ::setrlimit(RLIMIT_NOFILE, &lowered));
+    std::vector<int> fillers;
+    for (int fd = ::dup(0); fd >= 0; fd = ::dup(0)) {
+      fillers.push_back(fd);
+    }
+
+    // completed by the kernel, though not accepted
+    for (int fd : client_fds) {
+      ASSERT_EQ(0, ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr),
+                             addr_len));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    int accepted_without_fds = accepted;
+
+    for (int fd : fillers) {
+      ::close(fd);
+    }
+    ASSERT_EQ(0, ::setrlimit(RLIMIT_NOFILE, &limit));
+    WaitFor([&] { return accepted == kConnections; });
+
+    for (int fd : client_fds) {
+      ::close(fd);
+    }
+    server.Shutdown();
+    ASSERT_EQ(0, accepted_without_fds);
+    ASSERT_EQ(kConnections, accepted);
+  }
+}
+
+// The listener is not counted as a connection of its event poller, which
+// would look busier than the others otherwise.
+TEST(TcpServer, PlaceLeastConnections) {
+  const int kEventPollers = 4;
+  std::mutex mutex;
+  std::vector<std::shared_ptr<TcpConnection>> placed;
+  std::thread::id listener_thread;
+  std::map<int, std::thread::id> event_poller_threads;
+  std::atomic<int> sent { 0 };
+  std::atomic<int> closed { 0 };
+  TcpServerOptions server_options;
+  server_options.set_worker_count(kEventPollers);
+  server_options.set_placement_policy(
+      EventCenter::PlacementPolicy::kLeastConnections);
+  server_options.set_connected_callback(
+      [&] (const std::shared_ptr<TcpConnection>& connection) {
+        // placed before the connected callback, which is called by the
+        // event poller of the listener
+        std::lock_guard<std::mutex> guard(mutex);
+        listener_thread = std::this_thread::get_id();
+        placed.push_back(connection);
+        return true;
+      });
+  server_options.set_sent_callback(
+      [&] (bool, const std::shared_ptr<TcpConnection>& connection) {
+        {
+          std::lock_guard<std::mutex> guard(mutex);
+          event_poller_threads[connection->event_poller_id()] =
+              std::this_thread::get_id();
+        }
+        sent++;
+        return true;
+      });
+  server_options.set_closed_callback(
+      [&] (const std::shared_ptr<TcpConnection>&) {
+        closed++;
+        return true;
+      });
+  TcpServer server;
+  ASSERT_TRUE(server.Launch(EndPoint(IPAddress("127.0.0.1"), 0),
+                            server_options));
+  EndPoint server_address = server.listen_address();
+  auto num_placed = [&] () {
+    std::lock_guard<std::mutex> guard(mutex);
+    return static_cast<int>(placed.size());
+  };
+
+  TcpClientOptions client_options;
+  client_options.set_worker_count(1);
+  TcpClient client;
+  ASSERT_TRUE(client.Launch("least", client_options));
+  for (int i = 0; i < kEventPollers; ++i) {
+    ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+              client.Connect(&server_address, client_options));
+  }
+  ASSERT_TRUE(WaitFor([&] { return num_placed() == kEventPollers; }));
+  std::vector<std::shared_ptr<TcpConnection>> connections;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    connections = placed;
+  }
+  std::set<int> event_poller_ids;
+  for (auto& connection : connections) {
+    event_poller_ids.insert(connection->event_poller_id());
+    // tells the thread of its event poller
+    ASSERT_TRUE(connection->SendPacket("x"));
+  }
+  ASSERT_EQ(static_cast<size_t>(kEventPollers), event_poller_ids.size());
+  ASSERT_TRUE(WaitFor([&] { return sent == kEventPollers; }));
+
+  // the event poller of the listener serves no connection once its only one
+  // is closed, while the others serve one each
+  int listener_event_poller_id = -1;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    for (auto& p : event_poller_threads) {
+      if (p.second == listener_thread) {
+        listener_event_poller_id = p.first;
+      }
+    }
+  }
+  ASSERT_GE(listener_event_poller_id, 0);
+  for (auto& connection : connections) {
+    if (connection->event_poller_id() == listener_event_poller_id) {
+      // uncounted before the closed callback
+      connection->MarkAsClosed(true);
+    }
+  }
+  ASSERT_TRUE(WaitFor([&] { return closed == 1; }));
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+            client.Connect(&server_address, client_options));
+  ASSERT_TRUE(WaitFor([&] { return num_placed() == kEventPollers + 1; }));
+
+  client.Shutdown();
+  server.Shutdown();
+  std::lock_guard<std::mutex> guard(mutex);
+  ASSERT_EQ(listener_event_poller_id, placed.back()->event_poller_id());
+}
+
+// The event poller which was blocked while a wakeup was pending gets no new
+// connection.
+TEST(TcpServer, PlaceLeastLoopLag) {
+  const int kEventPollers = 4;
+  const int kConnections = 16;
+  std::mutex mutex;
+  std::vector<std::shared_ptr<TcpConnection>> placed;
+  std::atomic<bool> block_next { false };
+  std::atomic<bool> blocking { false };
+  std::atomic<int> sent { 0 };
+  TcpServerOptions server_options;
+  server_options.set_worker_count(kEventPollers);
+  server_options.set_placement_policy(
+      EventCenter::PlacementPolicy::kLeastLoopLag);
+  server_options.set_connected_callback(
+      [&] (const std::shared_ptr<TcpConnection>& connection) {
+        std::lock_guard<std::mutex> guard(mutex);
+        placed.push_back(connection);
+        return true;
+      });
+  server_options.set_sent_callback(
+      [&] (bool, const std::shared_ptr<TcpConnection>&) {
+        if (block_next.exchange(false)) {
+          blocking = true;
+          std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        }
+        sent++;
+        return true;
+      });
+  TcpServer server;
+  ASSERT_TRUE(server.Launch(EndPoint(IPAddress("127.0.0.1"), 0),
+                            server_options));
+  EndPoint server_address = server.listen_address();
+
+  TcpClientOptions client_options;
+  client_options.set_worker_count(1);
+  TcpClient client;
+  ASSERT_TRUE(client.Launch("lag", client_options));
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+            client.Connect(&server_address, client_options));
+  ASSERT_TRUE(WaitFor([&] {
+    std::lock_guard<std::mutex> guard(mutex);
+    return placed.size() == 1;
+  }));
+  std::shared_ptr<TcpConnection> slow_connection;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    slow_connection = placed.front();
+  }
+  int slow = slow_connection->event_poller_id();
+
+  // the first packet blocks its event poller, the wakeup for the second one
+  // is picked up 300ms late
+  block_next = true;
+  ASSERT_TRUE(slow_connection->SendPacket("a"));
+  ASSERT_TRUE(WaitFor([&] { return blocking.load(); }));
+  ASSERT_TRUE(slow_connection->SendPacket("b"));
+  ASSERT_TRUE(WaitFor([&] { return sent == 2; }));
+
+  for (int i = 0; i < kConnections; ++i) {
+    ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+              client.Connect(&server_address, client_options));
+  }
+  ASSERT_TRUE(WaitFor([&] {
+    std::lock_guard<std::mutex> guard(mutex);
+    return placed.size() == static_cast<size_t>(kConnections) + 1;
+  }));
+
+  client.Shutdown();
+  server.Shutdown();
+  std::lock_guard<std::mutex> guard(mutex);
+  for (size_t i = 1; i < placed.size(); ++i) {
+    ASSERT_NE(slow, placed[i]->event_poller_id());
+  }
+}
+
+// Every event of an accepted connection reaches the handler, none of the
+// callbacks of the options.
+TEST(TcpHandlerServer, Echo) {
+  TcpServerOptions server_options;
+  server_options.set_worker_count(2);
+  server_options.set_received_callback(
+      [] (const std::shared_ptr<TcpConnection>&) {
+        ADD_FAILURE() << "the received callback is called";
+        return false;
+      });
+  TcpHandlerServer<EchoHandler> server;
+  ASSERT_TRUE(server.Launch(EndPoint(IPAddress("127.0.0.1"), 0),
+                            server_options));
+  EndPoint server_address = server.listen_address();
+  EchoHandler& handler = server.handler();
+
+  std::mutex mutex;
+  std::shared_ptr<TcpConnection> client_connection;
+  std::string echoed;
+  TcpClientOptions client_options;
+  client_options.set_worker_count(1);
+  client_options.set_connected_callback(
+      [&] (const std::shared_ptr<TcpConnection>& connection) {
+        std::lock_guard<std::mutex> guard(mutex);
+        client_connection = connection;
+        return true;
+      });
+  client_options.set_received_callback(
+      [&] (const std::shared_ptr<TcpConnection>& connection) {
+        std::lock_guard<std::mutex> guard(mutex);
+        connection->mutable_recv_buffer().ReadAll(&echoed);
+        return true;
+      });
+  TcpClient client;
+  ASSERT_TRUE(client.Launch("handler", client_options));
+  ASSERT_NE(cnetpp::tcp::kInvalidConnectionId,
+            client.Connect(&server_address, client_options));
+  ASSERT_TRUE(WaitFor([&] {
+    std::lock_guard<std::mutex> guard(mutex);
+    return client_connection != nullptr;
+  }));
+  std::shared_ptr<TcpConnection> connection;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    connection = client_connection;
+  }
+
+  std::string sent;
+  for (int i = 0; i < 100; ++i) {
+    std::string data(100 + i, static_cast<char>('a' + i % 26));
+    ASSERT_TRUE(connection->SendPacket(data));
+    sent += data;
+  }
+  ASSERT_TRUE(WaitFor([&] {
+    std::lock_guard<std::mutex> guard(mutex);
+    return echoed.size() >= sent.size();
+  }));
+  // every packet echoed is reported sent
+  ASSERT_TRUE(WaitFor([&] { return handler.sent == handler.received; }));
+
+  connection->MarkAsClosed(true);
+  ASSERT_TRUE(WaitFor([&] { return handler.closed == 1; }));
+
+  client.Shutdown();
+  server.Shutdown();
+  ASSERT_EQ(1, handler.connected);
+  ASSERT_LT(0, handler.received);
+  std::lock_guard<std::mutex> guard(mutex);
+  ASSERT_EQ(sent, echoed);
+}
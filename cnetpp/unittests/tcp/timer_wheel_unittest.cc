@@ -0,0 +1,98 @@
+#include <cnetpp/tcp/timer_wheel.h>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using cnetpp::tcp::TimerWheel;
+
+TEST(TimerWheel, Test01) {
+  TimerWheel wheel(100);
+  ASSERT_EQ(-1, wheel.NextTimeout(100));
+  std::vector<int> fired;
+  wheel.Add(105, [&fired] () { fired.push_back(1); });
+  wheel.Add(102, [&fired] () { fired.push_back(2); });
+  auto id = wheel.Add(103, [&fired] () { fired.push_back(3); });
+  ASSERT_EQ(3, wheel.size());
+  ASSERT_EQ(2, wheel.NextTimeout(100));
+
+  ASSERT_EQ(0, wheel.Advance(101));
+  ASSERT_TRUE(wheel.Cancel(id));
+  ASSERT_FALSE(wheel.Cancel(id));
+  ASSERT_EQ(1, wheel.Advance(104));
+  ASSERT_EQ(1, wheel.NextTimeout(104));
+  ASSERT_EQ(1, wheel.Advance(110));
+  ASSERT_EQ((std::vector<int> { 2, 1 }), fired);
+  ASSERT_EQ(0, wheel.size());
+  ASSERT_EQ(-1, wheel.NextTimeout(110));
+}
+
+TEST(TimerWheel, Test02) {
+  // timers in the upper levels are cascaded down and fire on time
+  TimerWheel wheel(0);
+  std::vector<int64_t> expires { 300, 70000, 20000000, 5000000000LL };
+  std::vector<int64_t> fired;
+  for (auto expire : expires) {
+    wheel.Add(expire, [&fired, &wheel, expire] () { fired.push_back(expire); });
+  }
+  int64_t now = 0;
+  while (wheel.size() > 0) {
+    auto timeout = wheel.NextTimeout(now);
+    ASSERT_GT(timeout, 0);
+    now += timeout;
+    if (wheel.Advance(now) > 0) {
+      ASSERT_EQ(now, fired.back());
+    }
+  }
+  ASSERT_EQ(expires, fired);
+}
+
+TEST(TimerWheel, Test03) {
+  // callbacks can add and cancel timers
+  TimerWheel wheel(0);
+  int count = 0;
+  TimerWheel::TimerId other = TimerWheel::kInvalidTimerId;
+  wheel.Add(10, [&] () {
+    ++count;
+    ASSERT_TRUE(wheel.Cancel(other));
+    // expired already, fires at the next tick rather than in this one
+    wheel.Add(0, [&count] () { ++count; });
+  });
+  other = wheel.Add(10, [&count] () { count += 100; });
+  ASSERT_EQ(1, wheel.Advance(10));
+  ASSERT_EQ(1, count);
+  ASSERT_EQ(0, wheel.NextTimeout(11));
+  ASSERT_EQ(1, wheel.Advance(11));
+  ASSERT_EQ(2, count);
+}
+
+TEST(TimerWheel, Test04) {
+  // no timer fires early or is missed whatever steps the time goes by
+  TimerWheel wheel(12345);
+  std::mt19937 rng(1);
+  int64_t now = 12345;
+  size_t added = 0;
+  size_t fired = 0;
+  for (int round = 0; round < 2000; ++round) {
+    for (int i = 0; i < 5; ++i) {
+      int64_t delay = rng() % (round % 2 ? 1000 : 100000000);
+      int64_t expire = now + delay;
+      wheel.Add(expire, [&now, &fired, expire] () {
+        ASSERT_LE(expire, now);
+        ++fired;
+      });
+      ++added;
+    }
+    auto timeout = wheel.NextTimeout(now);
+    ASSERT_GE(timeout, 0);
+    now += std::min<int64_t>(timeout, rng() % 5000);
+    wheel.Advance(now);
+  }
+  while (wheel.size() > 0) {
+    now += wheel.NextTimeout(now);
+    wheel.Advance(now);
+  }
+  ASSERT_EQ(added, fired);
+}
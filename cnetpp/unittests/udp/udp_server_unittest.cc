@@ -0,0 +1,107 @@
+#include <cnetpp/udp/udp_server.h>
+#include <cnetpp/base/end_point.h>
+#include <cnetpp/base/ip_address.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using cnetpp::base::EndPoint;
+using cnetpp::base::IPAddress;
+using cnetpp::base::StringPiece;
+using cnetpp::udp::UdpConnection;
+using cnetpp::udp::UdpServer;
+using cnetpp::udp::UdpServerOptions;
+
+void EchoTest(bool edge_triggered, bool gso_and_gro) {
+  UdpServerOptions server_options;
+  server_options.set_worker_count(1);
+  server_options.set_edge_triggered(edge_triggered);
+  server_options.set_udp_gso(gso_and_gro);
+  server_options.set_udp_gro(gso_and_gro);
+  server_options.set_received_callback(
+      [] (const std::shared_ptr<UdpConnection>& connection,
+          const EndPoint& source,
+          StringPiece datagram) {
+        return connection->SendTo(source, datagram);
+      });
+  UdpServer server;
+  ASSERT_TRUE(server.Launch(EndPoint(IPAddress("127.0.0.1"), 0),
+                            server_options));
+  EndPoint server_address;
+  ASSERT_TRUE(server.connections()[0]->socket().GetLocalEndPoint(
+      &server_address));
+  ASSERT_NE(0, server_address.port());
+
+  std::mutex mutex;
+  std::vector<std::string> echoed;
+  UdpServerOptions client_options(server_options);
+  client_options.set_received_callback(
+      [&] (const std::shared_ptr<UdpConnection>&,
+           const EndPoint& source,
+           StringPiece datagram) {
+        EXPECT_EQ(server_address.ToString(), source.ToString());
+        std::lock_guard<std::mutex> guard(mutex);
+        echoed.emplace_back(datagram.as_string());
+        return true;
+      });
+  UdpServer client;
+  ASSERT_TRUE(client.Launch(EndPoint(IPAddress("127.0.0.1"), 0),
+                            client_options));
+
+  auto wait_for_echoes = [&] (size_t count) {
+    auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (std::chrono::steady_clock::now() < deadline) {
+      {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (echoed.size() >= count) {
+          return;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  };
+
+  // every round is a run of the same size with a shorter last one, which
+  // may go in one UDP_SEGMENT message and come back coalesced by GRO. The
+  // rounds are small enough not to overflow the socket receive buffers.
+  std::vector<std::string> datagrams;
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < 10; ++i) {
+      size_t size = i == 9 ? 100 : 1000;
+      datagrams.emplace_back(size, static_cast<char>('a' + round + i));
+      ASSERT_TRUE(client.connections()[0]->SendTo(server_address,
+                                                  datagrams.back()));
+    }
+    wait_for_echoes(datagrams.size());
+  }
+
+  client.Shutdown();
+  server.Shutdown();
+
+  // a single flow on the loopback is neither reordered nor dropped
+  ASSERT_EQ(datagrams, echoed);
+}
+
+}  // namespace
+
+TEST(UdpServer, Echo) {
+  EchoTest(false, false);
+}
+
+TEST(UdpServer, EchoEdgeTriggered) {
+  EchoTest(true, false);
+}
+
+TEST(UdpServer, EchoSegmented) {
+  EchoTest(false, true);
+}